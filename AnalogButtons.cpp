@@ -0,0 +1,203 @@
+#include "AnalogButtons.h"
+
+#if defined(ARDUINO)
+#include "esp32-hal-adc.h"
+#elif defined(ESP_PLATFORM)
+#include "esp_idf_version.h"
+#if ESP_IDF_VERSION_MAJOR >= 5
+#include "esp_adc/adc_oneshot.h"
+#endif
+#endif
+
+static const char* TAG = "IBADC";             // IDF log tag
+
+
+//-- ADC ACCESS (host builds get these from SimHAL) ---------------------------------------------------------
+// Prepares a pin for ibhal_adc_read(): 12 bit raw readings over the full (highest attenuation) input range
+#if defined(ARDUINO)
+static bool ibhal_adc_init(gpio_num_t pin) {
+  analogSetPinAttenuation(pin, ADC_11db);
+  return true;
+}
+
+static int ibhal_adc_read(gpio_num_t pin) {              // Raw reading, 0 - 4095, or -1 if the pin has no ADC channel
+  return analogRead(pin);
+}
+#elif defined(ESP_PLATFORM) && ESP_IDF_VERSION_MAJOR >= 5
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define IBHAL_ADC_ATTEN   ADC_ATTEN_DB_12              // Same full range, ADC_ATTEN_DB_11 is its deprecated name
+#else
+#define IBHAL_ADC_ATTEN   ADC_ATTEN_DB_11
+#endif
+
+static adc_oneshot_unit_handle_t s_adcUnits[SOC_ADC_PERIPH_NUM] = {};  // Created on first use, shared by every pin on the unit
+
+static bool ibhal_adc_init(gpio_num_t pin) {
+  adc_unit_t unit;
+  adc_channel_t channel;
+  if(adc_oneshot_io_to_channel(pin, &unit, &channel) != ESP_OK) return false;
+  adc_oneshot_unit_handle_t &handle = s_adcUnits[unit];
+  if(handle == nullptr) {
+    adc_oneshot_unit_init_cfg_t unitConfig = {};
+      unitConfig.unit_id = unit;
+    if(adc_oneshot_new_unit(&unitConfig, &handle) != ESP_OK) return false;
+  }
+  adc_oneshot_chan_cfg_t channelConfig = {};
+    channelConfig.atten = IBHAL_ADC_ATTEN;
+    channelConfig.bitwidth = ADC_BITWIDTH_12;
+  return adc_oneshot_config_channel(handle, channel, &channelConfig) == ESP_OK;
+}
+
+static int ibhal_adc_read(gpio_num_t pin) {              // Raw reading, 0 - 4095, or -1 if the pin isn't set up
+  adc_unit_t unit;
+  adc_channel_t channel;
+  int raw;
+  if(adc_oneshot_io_to_channel(pin, &unit, &channel) != ESP_OK || s_adcUnits[unit] == nullptr) return -1;
+  if(adc_oneshot_read(s_adcUnits[unit], channel, &raw) != ESP_OK) return -1;
+  return raw;
+}
+#elif defined(ESP_PLATFORM)
+static bool ibhal_adc_init(gpio_num_t /*pin*/) {         // The one-shot ADC driver came with ESP-IDF 5
+  ESP_LOGE(TAG, "AnalogButtons needs ESP-IDF 5 or later (esp_adc)");
+  return false;
+}
+
+static int ibhal_adc_read(gpio_num_t /*pin*/) {
+  return -1;
+}
+#endif
+
+
+// Constructor ------------------------------------------------------------------
+AnalogButtons::AnalogButtons(uint8_t pin, std::initializer_list<uint16_t> levels, uint16_t idleLevel, uint32_t debounceUS,
+                             uint16_t hysteresis) :
+                             m_pin(static_cast<gpio_num_t>(pin)),
+                             m_hysteresis(hysteresis) {
+  uint32_t intervalUS = debounceUS / TARGET_POLLS;          // Each sample is one debounce sample for every active button
+  m_sampleIntervalUS = (intervalUS > 65535) ? 65535 : (intervalUS == 0) ? 1 : intervalUS;
+
+  bool valid = GPIO_IS_VALID_GPIO(pin) && levels.size() > 0 && levels.size() <= ANALOG_MAX_BUTTONS;
+  if(!valid) ESP_LOGE(TAG, "A resistor ladder needs a valid gpio and 1 to %d button levels!", ANALOG_MAX_BUTTONS);
+
+  uint16_t sortedLevels[ANALOG_MAX_BUTTONS + 1];           // Every level, the idle one included, sorted by insertion
+  int8_t   sortedButtons[ANALOG_MAX_BUTTONS + 1];
+  uint8_t  count = 0;
+  int8_t   button = -1;
+  uint16_t level = idleLevel;
+  while(valid) {
+    uint8_t pos = count++;
+    while(pos > 0 && sortedLevels[pos - 1] > level) {
+      sortedLevels[pos] = sortedLevels[pos - 1];
+      sortedButtons[pos] = sortedButtons[pos - 1];
+      pos--;
+    }
+    sortedLevels[pos] = level;
+    sortedButtons[pos] = button;
+    if(++button == static_cast<int8_t>(levels.size())) break;
+    level = levels.begin()[button];
+  }
+  for(uint8_t idx = 1; valid && idx < count; idx++) {
+    if(sortedLevels[idx] - sortedLevels[idx - 1] <= 2 * hysteresis) {
+      ESP_LOGE(TAG, "Ladder levels %d and %d are too close to tell apart with a hysteresis of %d!",
+               sortedLevels[idx - 1], sortedLevels[idx], hysteresis);
+      valid = false;
+    }
+  }
+  if(valid) {
+    for(uint8_t idx = 0; idx < count; idx++) {             // Band edges half way between neighbouring levels
+      m_bands[idx].button = sortedButtons[idx];
+      m_bands[idx].low = (idx == 0) ? 0 : (sortedLevels[idx - 1] + sortedLevels[idx] + 1) / 2;
+      m_bands[idx].high = (idx == count - 1) ? 65535 : (sortedLevels[idx] + sortedLevels[idx + 1] + 1) / 2;
+      if(m_bands[idx].button < 0) m_band = idx;             // Start out idle
+    }
+    m_numBands = count;
+    m_count = levels.size();
+  } else {
+    m_bands[0] = { 0, 65535, -1 };                          // begin() will refuse, button() still returns a (never fed) button
+    m_numBands = 1;
+  }
+  for(uint8_t idx = 0; idx < m_count || idx == 0; idx++) m_buttons[idx] = new InterruptButton(Debounce_External, debounceUS);
+}
+
+// Destructor --------------------------------------------------------------------
+AnalogButtons::~AnalogButtons() {
+  if(m_sampleTimer) {
+    esp_timer_stop(m_sampleTimer);
+    esp_timer_delete(m_sampleTimer);
+  }
+  for(uint8_t idx = 0; idx < ANALOG_MAX_BUTTONS; idx++) delete m_buttons[idx];
+}
+
+// Initialiser -------------------------------------------------------------------
+bool AnalogButtons::begin(void) {
+  if(m_begun) return true;
+  if(m_count == 0) {
+    ESP_LOGE(TAG, "Resistor ladder was not constructed with a valid pin and levels!");
+    return false;
+  }
+  if(!ibhal_adc_init(m_pin)) {
+    ESP_LOGE(TAG, "gpio %d has no ADC channel that can be read!", m_pin);
+    return false;
+  }
+  esp_timer_create_args_t tmrConfig = {};
+    tmrConfig.arg = reinterpret_cast<void*>(this);
+    tmrConfig.callback = &sample;
+    tmrConfig.dispatch_method = ESP_TIMER_TASK;
+    tmrConfig.name = "IB_adcSample";
+  if(esp_timer_create(&tmrConfig, &m_sampleTimer) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create resistor ladder sample timer!");
+    m_sampleTimer = nullptr;
+    return false;
+  }
+  m_begun = true;
+  esp_timer_start_periodic(m_sampleTimer, ANALOG_IDLE_SAMPLE_MS * 1000UL);
+  return true;
+}
+
+
+//-- SAMPLING --------------------------------------------------------------------------------------------
+
+//-- Band of a reading, a reading stays in the current band until it is m_hysteresis beyond either edge -----
+uint8_t AnalogButtons::classify(int reading) {
+  const band_t &current = m_bands[m_band];
+  if(reading + m_hysteresis >= current.low && reading < current.high + m_hysteresis) return m_band;
+  uint8_t band = 0;
+  while(band < m_numBands - 1 && reading >= m_bands[band].high) band++;
+  return band;
+}
+
+void AnalogButtons::setFastSampling(bool fast) {
+  if(fast == m_fast) return;
+  m_fast = fast;
+  esp_timer_stop(m_sampleTimer);
+  esp_timer_start_periodic(m_sampleTimer, fast ? m_sampleIntervalUS : ANALOG_IDLE_SAMPLE_MS * 1000UL);
+}
+
+//-- Sample timer callback, one reading decides which (if any) button is closed and advances the buttons that need it
+void AnalogButtons::sample(void* arg) {
+  AnalogButtons* ladder = reinterpret_cast<AnalogButtons*>(arg);
+  int reading = ibhal_adc_read(ladder->m_pin);
+  if(reading < 0) return;                                   // Conversion failed, wait for the next sample
+  ladder->m_lastReading = reading;
+  ladder->m_band = ladder->classify(reading);
+
+  int8_t button = ladder->m_bands[ladder->m_band].button;
+  uint64_t closed = (button >= 0) ? BIT64(button) : 0;
+  if(closed == 0 && ladder->m_activeKeys == 0 && ladder->m_pressedKeys == 0) {
+    ladder->setFastSampling(false);                         // All released and settled
+    return;
+  }
+  ladder->setFastSampling(true);                            // First sample outside the idle band is the edge
+  InterruptButton::feedKeys(ladder->m_buttons, closed, ladder->m_activeKeys, ladder->m_pressedKeys);
+}
+
+
+//-- BUTTON ACCESS ---------------------------------------------------------------------------------------
+InterruptButton& AnalogButtons::button(uint8_t index) {
+  if(m_count == 0) return *m_buttons[0];
+  if(index >= m_count) {
+    ESP_LOGE(TAG, "Button %d is outside the %d button ladder!", index, m_count);
+    index = 0;
+  }
+  return *m_buttons[index];
+}
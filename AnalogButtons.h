@@ -0,0 +1,73 @@
+#ifndef ANALOGBUTTONS_H_
+#define ANALOGBUTTONS_H_
+
+#include "InterruptButton.h"
+#include <initializer_list>
+
+#define ANALOG_MAX_BUTTONS        8     // Most buttons on one resistor ladder
+#define ANALOG_FULL_SCALE         4095  // Raw reading at the top of the (12 bit) ADC range
+#define ANALOG_HYSTERESIS         40    // Default counts a reading must pass the edge of its band by before it changes band
+#ifndef ANALOG_IDLE_SAMPLE_MS
+#define ANALOG_IDLE_SAMPLE_MS     10    // Sample period while every button is released and settled (can be overridden by build flag)
+#endif
+
+
+// -- Analog (resistor ladder) Buttons -------------------------------------------------------------------------------------
+// Several buttons sharing one ADC pin through a resistor ladder, each pulling the pin to its own voltage.  Give the raw
+// reading (0 - ANALOG_FULL_SCALE) each button produces and the reading with none pressed; readings are sorted into bands
+// split half way between neighbouring levels, and a reading only leaves its current band once it is 'hysteresis' counts
+// past the edge, so noise near an edge can't flicker between two buttons.  An ADC raises no interrupt, so one periodic
+// timer samples the pin every ANALOG_IDLE_SAMPLE_MS while idle, and every debounceUS / TARGET_POLLS from the first reading
+// outside the idle band until every button is released and settled again.  One reading serves every button on the pin.
+//
+// Each button is an InterruptButton fed from those samples instead of its own gpio and ISR, so it has the same debounce,
+// longPress, autoRepeat, double-click, menu level and queue behaviour as any other button and is bound the same way, eg
+// ladder.button(2).bind(Event_KeyPress, action).  A ladder can only report one button at a time (the one nearest the
+// pin, electrically), and a press can take up to ANALOG_IDLE_SAMPLE_MS longer to be seen than on a gpio.  In
+// InterruptButton's low power mode the idle sampling still wakes the chip every ANALOG_IDLE_SAMPLE_MS.
+// -- ----------------------------------------------------------------------------------------------------------------------
+class AnalogButtons {
+  private:
+    struct band_t {                                                   // Readings in [low, high) belong to this band
+      uint16_t            low;
+      uint16_t            high;
+      int8_t              button;                                     // Button index, -1 for the idle (none pressed) band
+    };
+
+    static void sample(void* arg);                                    // Sample timer callback, classifies a reading and feeds the buttons
+    void        setFastSampling(bool fast);                           // Debounce rate while any button is active, idle rate otherwise
+    uint8_t     classify(int reading);                                // Band of a reading, with hysteresis around the current band
+
+    gpio_num_t          m_pin;
+    band_t              m_bands[ANALOG_MAX_BUTTONS + 1];              // Sorted by level, covering 0 to 65535 between them
+    uint8_t             m_numBands = 0;
+    uint8_t             m_band = 0;                                   // Band of the last reading
+    uint16_t            m_hysteresis;
+    InterruptButton*    m_buttons[ANALOG_MAX_BUTTONS] = { nullptr };
+    uint8_t             m_count = 0;
+    uint64_t            m_activeKeys = 0;                             // Bit per button being debounced (confirming press or release)
+    uint64_t            m_pressedKeys = 0;                            // Bit per button whose debounced state is pressed
+    esp_timer_handle_t  m_sampleTimer = nullptr;
+    uint16_t            m_sampleIntervalUS;                           // Sample period while a button is active
+    volatile int16_t    m_lastReading = -1;
+    volatile bool       m_fast = false;
+    bool                m_begun = false;
+
+  public:
+    AnalogButtons(uint8_t pin,                                        // ADC capable pin
+                  std::initializer_list<uint16_t> levels,             // Raw reading while each button is pressed, eg { 0, 820, 1640, 2460 }
+                  uint16_t idleLevel = ANALOG_FULL_SCALE,             // Raw reading with no button pressed
+                  uint32_t debounceUS = 8000,                         // Sampled every debounceUS / TARGET_POLLS while a button is active
+                  uint16_t hysteresis = ANALOG_HYSTERESIS);
+    ~AnalogButtons();
+
+    bool              begin(void);                                    // Configure the ADC channel and start sampling
+    InterruptButton&  button(uint8_t index);                          // Button in the order its level was given, bind its events like any button
+    uint8_t           buttonCount(void)     { return m_count;                }
+    int8_t            getBand(void)         { return m_bands[m_band].button; }  // Button the last reading belongs to, -1 for none
+    int16_t           getLastReading(void)  { return m_lastReading;          }  // Raw reading, -1 before the first sample
+    uint64_t          getPressedMask(void)  { return m_pressedKeys;          }  // Bit per button currently pressed
+    bool              isSamplingFast(void)  { return m_fast;                 }  // A button is active, sampling at the debounce rate
+};
+
+#endif // ANALOGBUTTONS_H_
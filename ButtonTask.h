@@ -0,0 +1,36 @@
+#ifndef BUTTONTASK_H_
+#define BUTTONTASK_H_
+
+#include "InterruptButton.h"
+
+#ifndef __cpp_impl_coroutine
+#error "ButtonTask.h needs C++20 coroutines, eg build with -std=gnu++20"
+#endif
+#include <coroutine>
+#include <exception>
+
+// -- Button Task ----------------------------------------------------------------------------------------------------------
+// Fire-and-forget coroutine type for button handling code written as one sequential routine instead of scattered
+// actions, eg:
+//   ButtonTask volumeControl(InterruptButton &up, InterruptButton &down) {
+//     while(true) {
+//       buttonEvent_t evt = co_await InterruptButton::nextOf(Event_KeyPress, &up, &down);
+//       volume += (evt.btn == &up) ? 1 : -1;
+//     }
+//   }
+// Calling it runs the body up to its first co_await and returns; from then on each awaited event resumes it in the
+// context that dispatches the event (a lane task, or processSyncEvents() in the main loop), so it must not block there
+// any more than a bound action would.  The frame is allocated (operator new) when it is called and freed when it
+// returns.  Any coroutine type can await next() and nextOf(), this one just needs nothing else.
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct ButtonTask {
+  struct promise_type {
+    ButtonTask          get_return_object(void) { return {}; }
+    std::suspend_never  initial_suspend(void) noexcept { return {}; }   // Runs straight away, up to the first co_await
+    std::suspend_never  final_suspend(void) noexcept { return {}; }     // Frame freed as soon as the body returns
+    void                return_void(void) {}
+    void                unhandled_exception(void) { std::terminate(); }
+  };
+};
+
+#endif // BUTTONTASK_H_
@@ -1,434 +1,1756 @@
-#include "InterruptButton.h"
-
-// Include reference req'd for debugging and warnings across serial port.
-#ifdef ARDUINO
-#include "esp32-hal-log.h"
-#else
-#include "esp_log.h"
-#endif
-
-
-#define ESP_INTR_FLAG_DEFAULT   0
-#define EVENT_TASK_PRIORITY     2             // One level higher than arduino's loop() which is priority level 1
-#define EVENT_TASK_STACK        4096          // Stack size associated with the queue servicer 
-#define EVENT_TASK_NAME         "BTN_ACTN"
-#define EVENT_TASK_CORE         1             // Same core as setup() and loop()
-
-static const char* TAG = "IBTN";              // IDF log tag
-
-
-
-/* ToDo
-  1. Need to confirm if any ISR's need to blocked/disabled from other ISR entry, ie portMUX highlevel/lowlevel, etc.
-  2. Consider Adding button eventTypes such as momentary, latching, etc.
-  3. Consider adding chord combinations (2 or more buttons pressed concurently) as a event.  Added to static class member, when any one button is pushed.
-  corresponding buttons are checked to see if they are in waiting for release state (will be a factorial type check to minimise redundant checks)
-
-  4. Consider allowing a single button to follow it's own menu level and depart from the global menulevel.
-  This would be usefull when you have a powerbutton that doesn't change function and menu buttons that do
-  change their function based on what the current gui menu level is (like a soft key)
-*/
-
-//-- STATIC CLASS MEMBERS AND METHODS (COMMON ACROSS ALL INSTANCES TO SAVE MEMORY) -----------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-
-//-- Initialise Static Member Variables ------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-uint32_t      InterruptButton::m_RTOSservicerStackDepth                     { 2048 };
-uint8_t       InterruptButton::m_numMenus                                   { 0 };  // 0 Means not initialised, can be set by user; once set it can't be changed.
-uint8_t       InterruptButton::m_menuLevel                                  { 0 };
-modes         InterruptButton::m_mode                                       { Mode_Asynchronous };
-bool          InterruptButton::m_classInitialised                           { false };
-func_ptr_t    InterruptButton::m_asyncEventQueue[ASYNC_EVENT_QUEUE_DEPTH] = { nullptr };
-func_ptr_t    InterruptButton::m_syncEventQueue[SYNC_EVENT_QUEUE_DEPTH] =   { nullptr };
-TaskHandle_t  InterruptButton::m_asyncQueueServicerHandle                   { nullptr };
-bool          InterruptButton::m_deleteInProgress                           { false };
-
-// This is used to initialise the queue(s) and also switch between them.
-bool InterruptButton::setMode(modes mode){
-  // Flush both queues
-  for(uint8_t i = 0; i < ASYNC_EVENT_QUEUE_DEPTH; i++) m_asyncEventQueue[i] = nullptr;
-  for(uint8_t i = 0; i < SYNC_EVENT_QUEUE_DEPTH;  i++) m_syncEventQueue[i]  = nullptr;
-  
-  if(mode == Mode_Asynchronous || mode == Mode_Hybrid) {
-    m_mode = mode;
-
-    // Start the RTOS queue action service/task
-    bool retVal;
-    if(m_asyncQueueServicerHandle != nullptr) {
-      vTaskResume(m_asyncQueueServicerHandle);   // Assuming it may have been paused earlier.
-      retVal = true;
-    } else {
-      retVal = xTaskCreatePinnedToCore(asyncQueueServicer, EVENT_TASK_NAME, m_RTOSservicerStackDepth, NULL, 
-                                       EVENT_TASK_PRIORITY, &m_asyncQueueServicerHandle, EVENT_TASK_CORE) == pdPASS;
-    }
-    if(!retVal) ESP_LOGE(TAG, "setMode(): Failed to create RTOS queue servicing task!");
-    return retVal;
-
-  } else if(mode == Mode_Synchronous) {
-    m_mode = mode;
-    if(m_asyncQueueServicerHandle != nullptr)  vTaskSuspend(m_asyncQueueServicerHandle);
-    return true;
-
-  } else {
-    ESP_LOGE(TAG, "setMode(): Invalid mode specified!");
-    return false;
-  }
-}
-
-modes InterruptButton::getMode(){
-  return m_mode;
-}
-
-void InterruptButton::asyncQueueServicer(void* pvParams){
-  while(1){
-    if(m_asyncEventQueue[0] != nullptr) {
-      m_asyncEventQueue[0]();                                   // Action the first entry
-
-      for(uint8_t i = 1; i < ASYNC_EVENT_QUEUE_DEPTH; i++) {    // Shift the rest down or clear this entry.
-        m_asyncEventQueue[i - 1] = m_asyncEventQueue[i];
-        if(m_asyncEventQueue[i] == nullptr) break;
-        if(i == ASYNC_EVENT_QUEUE_DEPTH - 1) m_asyncEventQueue[i] = nullptr;
-      }
-    }
-    vTaskDelay(10 / ((TickType_t)1000 / configTICK_RATE_HZ));    // Required to yield to RTOS scheduler during idle times
-  }
-  vTaskDelete(NULL);    // Only reached if we put a condition in the primary while loop based on mode
-}
-
-void InterruptButton::processSyncEvents() {
-  while(m_syncEventQueue[0] != nullptr) {
-    m_syncEventQueue[0]();                                   // Action the first entry
-
-    for(uint8_t i = 1; i < SYNC_EVENT_QUEUE_DEPTH; i++) {    // Shift the rest down or clear this entry.
-        m_syncEventQueue[i - 1] = m_syncEventQueue[i];
-        if(m_syncEventQueue[i] == nullptr) break;
-        if(i == SYNC_EVENT_QUEUE_DEPTH - 1) m_syncEventQueue[i] = nullptr;
-    }
-  }
-}
-
-
-//-- Method to monitor button, called by button change and various timer interrupts ----------------------
-void IRAM_ATTR InterruptButton::readButton(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-
-  switch(btn->m_state){
-    case Released:                                              // Was sitting released but just detected a signal from the button
-      gpio_intr_disable(btn->m_pin);                            // Ignore change inputs while we poll for a valid press
-      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // Was released, just detected a change, must be a valid press so count it.
-      btn->m_blockKeyPress = false;
-      startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "DB_begin_");  // Begin debouncing the button input
-      btn->m_state = ConfirmingPress;
-
-      break;
-
-    case ConfirmingPress:                                       // we get here each time the debounce timer expires (onchange interrupt disabled remember)
-      btn->m_totalPolls++;                                      // Count the number of total reads
-      if(gpio_get_level(btn->m_pin) == btn->m_pressedState) btn->m_validPolls++; // Count the number of valid 'PRESSED' reads
-      if(btn->m_totalPolls >= TARGET_POLLS){                   // If we have checked the button enough times, then make a decision on key state
-        if(btn->m_validPolls * 2 <= btn->m_totalPolls) {        // Then it was a false alarm
-          btn->m_state = Released;                                        
-          gpio_intr_enable(btn->m_pin);
-          return;
-        }                                                       // Otherwise, spill over to "Pressing"
-      } else {                                                  // Not yet enough polls to confirm state
-        startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "CP2_");  // Keep sampling pin state
-        return;
-      }
-      [[fallthrough]];                                           // Planned spill through here (no break) if logic requires, ie keyDown confirmed.
-    case Pressing:                                              // VALID KEYDOWN, assumed pressed if it had valid polls more than half the time
-      btn->action(btn, Event_KeyDown);                          // Add the keyDown action to the relevant queue
-      if(btn->eventEnabled(Event_LongKeyPress) && btn->eventActions[m_menuLevel][Event_LongKeyPress] != nullptr){
-        startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_longKeyPressMS * 1000), &longPressEvent, btn, "CP1_");
-      } else if (btn->eventEnabled(Event_AutoRepeatPress)) {
-        startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000), &autoRepeatPressEvent, btn, "CP1_");
-      }
-
-      btn->m_state = Pressed;
-      gpio_intr_enable(btn->m_pin);                             // Begin monitoring pin again
-      break;
-
-    case Pressed:                                               // Currently pressed until now, but there was a change on the pin
-      gpio_intr_disable(btn->m_pin);                            // Turn off this interrupt to ignore inputs while we wait to check if valid release
-      startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "PR_");  // Start timer and start polling the button to debounce it
-      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // This is first poll and it was just released by definition of state
-      btn->m_state = WaitingForRelease;
-      break;
-
-    case WaitingForRelease: // we get here when debounce timer or doubleclick timeout timer alarms (onchange interrupt disabled remember)
-                            // stay in this state until released, because button could remain locked down if release missed.
-      btn->m_totalPolls++;
-      if(gpio_get_level(btn->m_pin) != btn->m_pressedState){
-        btn->m_validPolls++;
-        if(btn->m_totalPolls < TARGET_POLLS || btn->m_validPolls * 2 <= btn->m_totalPolls) {           // If we haven't polled enough or not high enough success rate
-          startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "W4R_polling_");  // Then keep sampling pin state until release is confirmed
-          return;
-        }                                                       // Otherwise, spill through to "Releasing"
-      } else {
-        if(btn->m_validPolls > 0) {
-          btn->m_validPolls--;
-        } else {
-          btn->m_totalPolls = 0;                                // Key is being held down, don't let total polls get too far ahead.
-        }
-        startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, &readButton, btn, "W4R_invalidPoll"); // Keep sampling pin state until released
-      }
-      [[fallthrough]];                                           // Intended spill through here (no break) to "Releasing" once keyUp confirmed.
-
-    case Releasing:
-      killTimer(btn->m_buttonLPandRepeatTimer);
-      btn->action(btn, Event_KeyUp);                            // Add the keyUp action to the relevant queue
-
-      if(btn->eventEnabled(Event_DoubleClick) && btn->eventEnabled(Event_All) &&     // If double-clicks are enabled and defined
-         btn->eventActions[m_menuLevel][Event_DoubleClick] != nullptr) {
-
-        if(btn->m_wtgForDblClick) {                             // VALID DOUBLE-CLICK (second keyup without a timeout, would normally check 
-          killTimer(btn->m_buttonDoubleClickTimer);             // esp_timer_is_active, but function not available in esp32 arduino core.
-          btn->m_wtgForDblClick = false;
-          btn->action(btn, Event_DoubleClick);                  // Add the double-click action to the relevant queue
-
-        } else if (!btn->m_blockKeyPress) {                     // Commence double-click detection process               
-          btn->m_wtgForDblClick = true;
-          btn->m_doubleClickMenuLevel = m_menuLevel;            // Save menuLevel in case this is converted to a keyPress later
-          startTimer(btn->m_buttonDoubleClickTimer, uint64_t(btn->m_doubleClickMS * 1000), &doubleClickTimeout, btn, "W4R_DCsetup_");
-        }
-      } else if(!btn->m_blockKeyPress) {                        // Otherwise, treat as a basic keyPress
-        btn->action(btn, Event_KeyPress);                       // Then treat as a normal keyPress
-      } 
-      btn->m_state = Released;
-      gpio_intr_enable(btn->m_pin);
-      break;
-  } // End of SWITCH statement
-
-  return;
-} // End of readButton function
-
-
-//-- Method to handle longKeyPresses (called by timer)----------------------------------------------------
-void InterruptButton::longPressEvent(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-
-  btn->action(btn, Event_LongKeyPress);                                     // Add the long keypress action to the relevant queue
-  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
-  
-  //Initiate the autorepeat function
-  if(btn->eventEnabled(Event_AutoRepeatPress) && gpio_get_level(btn->m_pin) == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
-    startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000), &autoRepeatPressEvent, btn, "LPD_");
-  }
-}
-
-//-- Method to handle autoRepeatPresses (called by timer)-------------------------------------------------
-void InterruptButton::autoRepeatPressEvent(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
-
-  if(btn->eventActions[m_menuLevel][Event_AutoRepeatPress] != nullptr) {
-    btn->action(btn, Event_AutoRepeatPress);                                // Action the Async Auto Repeat KeyPress Event if defined
-  } else {
-    btn->action(btn, Event_KeyPress);                                       // Action the Async KeyPress Event otherwise
-  }
-  if(btn->eventEnabled(Event_AutoRepeatPress) && gpio_get_level(btn->m_pin) == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
-    startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000), &autoRepeatPressEvent, btn, "LPD_");
-  }
-}
-
-//-- Method to return to interpret previous keyUp as a keyPress instead of a doubleClick if it times out.
-void InterruptButton::doubleClickTimeout(void *arg){
-  if(m_deleteInProgress) return;
-  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
-  btn->m_wtgForDblClick = false;
-  if(gpio_get_level(btn->m_pin) != btn->m_pressedState)
-    btn->action(btn, Event_KeyPress, btn->m_doubleClickMenuLevel);                    // Then treat as a normal keyPress at the menuLevel when first click occurred
-                                                                                      // Note, this timer is never started if previous press was a longpress
-}
-
-//-- Helper method to simplify starting a timer ----------------------------------------------------------
-void IRAM_ATTR InterruptButton::startTimer(esp_timer_handle_t &timer, uint32_t duration_US, void (*callBack)(void* arg), InterruptButton* btn, const char *msg){
-  if(m_deleteInProgress) return;
-  esp_timer_create_args_t tmrConfig;
-    tmrConfig.arg = reinterpret_cast<void*>(btn);
-    tmrConfig.callback = callBack;
-    tmrConfig.dispatch_method = ESP_TIMER_TASK;
-    tmrConfig.name = msg;
-    // this line crashes the esp if button was created dynamically.
-  killTimer(timer);
-  esp_timer_create(&tmrConfig, &timer);
-  esp_timer_start_once(timer, duration_US);
-}
-
-//-- Helper method to kill a timer -----------------------------------------------------------------------
-void IRAM_ATTR InterruptButton::killTimer(esp_timer_handle_t &timer){
-  if(timer){
-    esp_timer_stop(timer);
-    esp_timer_delete(timer);
-    timer = nullptr;
-  }
-}
-
-void IRAM_ATTR InterruptButton::action(InterruptButton* btn, events event, uint8_t menuLevel){  
-  if(m_deleteInProgress)                                                      return;
-  if(menuLevel >= m_numMenus)                                                 return;   // Invalid menu level
-  if(!btn->eventEnabled(event) || !btn->eventEnabled(Event_All))              return;   // Specific event is or all events are disabled
-  if(btn->eventActions[menuLevel][event] == nullptr)                          return;   // Event is not defined
-
-  if(m_mode == Mode_Asynchronous || (m_mode == Mode_Hybrid && (event == Event_KeyDown || event == Event_KeyUp))) {
-    for(uint8_t i = 0; i < ASYNC_EVENT_QUEUE_DEPTH; i++){            // Action immediatley using RTOS asynchronous Queue
-      //ESP_LOGD(TAG,"Searching for free spot to add action: %d", i);
-      if(m_asyncEventQueue[i] == nullptr){
-        //ESP_LOGD(TAG,"\tAdding entry at position: %d", i);
-        m_asyncEventQueue[i] = btn->eventActions[menuLevel][event];
-        break;
-      }
-    }
-  } else {                                                           // Action when called in main loop hook using synchronous Queue
-    for(uint8_t i = 0; i < SYNC_EVENT_QUEUE_DEPTH; i++){
-      if(m_syncEventQueue[i] == nullptr){
-        m_syncEventQueue[i] = btn->eventActions[menuLevel][event];
-        break;
-      }
-    }
-  }  
-}
-
-
-
-//-- CLASS MEMBERS AND METHODS SPECIFIC TO A SINGLE INSTANCE (BUTTON) ------------------------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------------
-
-// Class object control and setup functions -------------------------------------
-// ------------------------------------------------------------------------------
-
-// Constructor ------------------------------------------------------------------
-InterruptButton::InterruptButton(uint8_t pin, uint8_t pressedState, gpio_mode_t pinMode,
-                                 uint16_t longKeyPressMS, uint16_t autoRepeatMS, 
-                                 uint16_t doubleClickMS,  uint32_t debounceUS) :
-                                 m_pressedState(pressedState),
-                                 m_pinMode(pinMode),
-                                 m_longKeyPressMS(longKeyPressMS),
-                                 m_autoRepeatMS(autoRepeatMS),
-                                 m_doubleClickMS(doubleClickMS) {
-
-  if (GPIO_IS_VALID_GPIO(pin))                  // Check for a valid pin first
-    m_pin = static_cast<gpio_num_t>(pin);
-  else {
-    ESP_LOGW(TAG, "%d is not valid gpio on this platform", pin);
-    m_pin = static_cast<gpio_num_t>(-1);        //GPIO_NUM_NC (enum not showing up as defined);
-  }
-  m_pollIntervalUS = (debounceUS / TARGET_POLLS > 65535) ? 65535 : debounceUS / TARGET_POLLS;
-}
-
-// Destructor --------------------------------------------------------------------
-InterruptButton::~InterruptButton() {
-  m_deleteInProgress = true;
-  gpio_isr_handler_remove(m_pin);
-  killTimer(m_buttonPollTimer); killTimer(m_buttonLPandRepeatTimer); killTimer(m_buttonDoubleClickTimer);
-  gpio_reset_pin(m_pin);
-
-  for(int menu = 0; menu < m_numMenus; menu++) delete [] eventActions[menu];
-  delete [] eventActions;
-  m_deleteInProgress = false;
-}
-
-// Initialiser -------------------------------------------------------------------
-void InterruptButton::initialiseInstance(void){
-    if(m_thisButtonInitialised) return;
-
-    if(!m_classInitialised){                    // We must be initialising the first button
-      if(m_numMenus == 0) m_numMenus = 1;       // Default to a single menu level if not set prior to initialising first button
-      esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
-      if(err != ESP_OK) ESP_LOGD(TAG, "GPIO ISR service installed with exit status: %d", err);
-      m_classInitialised = setMode(m_mode) && (err == ESP_OK || err == ESP_ERR_INVALID_STATE);
-    }
-
-    eventActions = new func_ptr_t*[m_numMenus];             // Define the array of actions associated with each button
-    for(int menu = 0; menu < m_numMenus; menu++){
-      eventActions[menu] = new func_ptr_t[NumEventTypes];
-      for(int evt = 0; evt < NumEventTypes; evt++){
-        eventActions[menu][evt] = nullptr;
-      }
-    }
-    gpio_config_t gpio_conf = {};                           // Configure the interrupt associated with the pin
-      gpio_conf.mode = m_pinMode;
-      gpio_conf.pin_bit_mask = BIT64(static_cast<uint8_t>(m_pin));
-      gpio_conf.pull_down_en = (m_pressedState) ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
-      gpio_conf.pull_up_en =   (m_pressedState) ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE;
-      gpio_conf.intr_type = GPIO_INTR_ANYEDGE;
-    gpio_config(&gpio_conf);
-    gpio_isr_handler_add(m_pin, InterruptButton::readButton, reinterpret_cast<void*>(this));
-    m_state = (gpio_get_level(m_pin) == m_pressedState) ? Pressed : Released;     // Set to current state when initialising
-    m_thisButtonInitialised = true;
-}
-
-
-//-- TIMING INTERVAL GETTERS AND SETTERS -----------------------------------------------------------------
-void      InterruptButton::setLongPressInterval(uint16_t intervalMS)    { m_longKeyPressMS = intervalMS; }
-uint16_t  InterruptButton::getLongPressInterval(void)                   { return m_longKeyPressMS;       }
-void      InterruptButton::setAutoRepeatInterval(uint16_t intervalMS)   { m_autoRepeatMS = intervalMS;   }
-uint16_t  InterruptButton::getAutoRepeatInterval(void)                  { return m_autoRepeatMS;         }
-void      InterruptButton::setDoubleClickInterval(uint16_t intervalMS)  { m_doubleClickMS = intervalMS;  }
-uint16_t  InterruptButton::getDoubleClickInterval(void)                 { return m_doubleClickMS;        }
-
-
-// -- FUNCTIONS RELATED TO EXTERNAL ACTIONS --------------------------------------------------------------
-// -------------------------------------------------------------------------------------------------------
-void InterruptButton::bind(events event, uint8_t menuLevel, func_ptr_t action){
-  if(!m_thisButtonInitialised) initialiseInstance();    // Auto initialisation (typical begin() function)
-
-  if(menuLevel >= m_numMenus) {
-    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
-  } else if(event >= NumEventTypes) {
-    ESP_LOGE(TAG, "Specified event is invalid!");
-  } else {
-    eventActions[menuLevel][event] = action;            // Bind external action to button
-    if(!eventEnabled(event)) enableEvent(event);        // Assume if we are binding it, we want it enabled.
-  }
-}
-
-void InterruptButton::unbind(events event, uint8_t menuLevel){
-  if(m_numMenus == 0){
-    ESP_LOGE(TAG, "You must have bound at least one function prior to unbinding it from a button!");
-  } else if(menuLevel >= m_numMenus) {
-    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
-  } else if(event >= NumEventTypes) {
-    ESP_LOGE(TAG, "Specified event is invalid!");
-  } else {
-    eventActions[menuLevel][event] = nullptr;
-  }
-  return;
-}
-
-void InterruptButton::enableEvent(events event){
-  if(event <= Event_All && event != NumEventTypes) eventMask |= (1UL << (event));    // Set the relevant bit
-}
-void InterruptButton::disableEvent(events event){
-  if(event <= Event_All && event != NumEventTypes) eventMask &= ~(1UL << (event));   // Clear the relevant bit
-}
-bool InterruptButton::eventEnabled(events event) {
-  return ((eventMask >> event) & 0x01) == 0x01;
-}
-
-void InterruptButton::setMenuCount(uint8_t numberOfMenus){           // This can only be set before initialising first button
-  if(!m_classInitialised && numberOfMenus >= 1) m_numMenus = numberOfMenus;
-}
-uint8_t InterruptButton::getMenuCount(void) {
-  return m_numMenus;
-}
-
-void InterruptButton::setMenuLevel(uint8_t level) {
-  if(level < m_numMenus) {
-    m_menuLevel = level;
-  } else {
-    ESP_LOGE(TAG, "Menu level '%d' must be >= 0 AND < number of menus (zero origin): ", level);
-  }
-}
-
-uint8_t InterruptButton::getMenuLevel(){
-  return m_menuLevel;
-}
+#include "InterruptButton.h"
+#include "RotaryEncoder.h"
+#include <cstdio>
+#include <cstring>
+
+
+#define ESP_INTR_FLAG_DEFAULT   0
+#define EVENT_TASK_PRIORITY     2             // One level higher than arduino's loop() which is priority level 1 (lane 0, lane n is n higher)
+#define EVENT_TASK_STACK        4096          // Stack size associated with the queue servicer 
+#define EVENT_TASK_NAME         "BTN_ACTN"
+#define EVENT_TASK_CORE         1             // Same core as setup() and loop()
+#define PATTERN_NO_STATE        0xFF          // Press sequence left every registered pattern
+
+static const char* TAG = "IBTN";              // IDF log tag
+
+
+
+/* ToDo
+  1. Need to confirm if any ISR's need to blocked/disabled from other ISR entry, ie portMUX highlevel/lowlevel, etc.
+  2. Consider Adding button eventTypes such as momentary, latching, etc.
+  3. Consider allowing a single button to follow it's own menu level and depart from the global menulevel.
+  This would be usefull when you have a powerbutton that doesn't change function and menu buttons that do
+  change their function based on what the current gui menu level is (like a soft key)
+*/
+
+//-- STATIC CLASS MEMBERS AND METHODS (COMMON ACROSS ALL INSTANCES TO SAVE MEMORY) -----------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+
+//-- Initialise Static Member Variables ------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+uint32_t      InterruptButton::m_RTOSservicerStackDepth                     { 2048 };
+uint8_t       InterruptButton::m_numMenus                                   { 0 };  // 0 Means not initialised, can be set by user; once set it can't be changed.
+std::atomic<uint8_t> InterruptButton::m_menuLevel                           { 0 };
+modes         InterruptButton::m_mode                                       { Mode_Asynchronous };
+bool          InterruptButton::m_classInitialised                           { false };
+InterruptButton::dispatchLane_t InterruptButton::m_lanes[DISPATCH_LANES];
+EventRingBuffer<buttonEvent_t, SYNC_EVENT_QUEUE_DEPTH>   InterruptButton::m_syncEventQueue;
+overflowPolicies InterruptButton::m_overflowPolicy                          { Overflow_DropNewest };
+uint16_t      InterruptButton::m_coalescedEvents                            { 0 };
+buttonEvent_t InterruptButton::m_syncCurrentEvent                           = {};
+bool          InterruptButton::m_deleteInProgress                           { false };
+bool          InterruptButton::m_lowPowerMode                               { false };
+esp_timer_handle_t InterruptButton::m_scanTimer                             { nullptr };
+InterruptButton*   InterruptButton::m_pinButtons[MAX_BUTTON_PINS]           { nullptr };
+volatile uint64_t  InterruptButton::m_scanActiveMask                        { 0 };
+uint64_t           InterruptButton::m_scanPressedLevels                     { 0 };
+uint16_t           InterruptButton::m_scanIntervalUS                        { 800 };  // TARGET_POLLS x 800us matches default 8ms debounce
+portMUX_TYPE       InterruptButton::m_scanMux                               = portMUX_INITIALIZER_UNLOCKED;
+InterruptButton::chord_t InterruptButton::m_chords[MAX_CHORDS]              = {};
+uint8_t            InterruptButton::m_numChords                             { 0 };
+volatile uint64_t  InterruptButton::m_pressedMask                           { 0 };
+volatile uint16_t  InterruptButton::m_chordsLatched                         { 0 };
+portMUX_TYPE       InterruptButton::m_chordMux                              = portMUX_INITIALIZER_UNLOCKED;
+std::atomic<uint32_t> InterruptButton::m_readers[IB_READER_SLOTS]           = {};
+storm_func_t       InterruptButton::m_stormHandler                          = nullptr;
+RotaryEncoder*     InterruptButton::m_encoders[MAX_ENCODERS]                = { nullptr };
+eventWaiter_t*     InterruptButton::m_waiters                               = nullptr;
+portMUX_TYPE       InterruptButton::m_waitMux                               = portMUX_INITIALIZER_UNLOCKED;
+InterruptButton::patternState_t InterruptButton::m_patternStates[MAX_PATTERN_STATES] = { { {0, 0}, -1 } };
+uint8_t            InterruptButton::m_numPatternStates                      { 1 };
+uint8_t            InterruptButton::m_numPatterns                           { 0 };
+func_ptr_t*        InterruptButton::m_actionPool                            = nullptr;
+bool*              InterruptButton::m_poolClaimed                           = nullptr;
+uint16_t           InterruptButton::m_poolButtons                           { 0 };
+uint16_t           InterruptButton::m_liveButtons                           { 0 };
+uint32_t           InterruptButton::m_heapActionBytes                       { 0 };
+#if IB_TRACE_COMPILED
+traceEntry_t       InterruptButton::m_trace[TRACE_DEPTH];
+std::atomic<uint32_t> InterruptButton::m_traceHead                          { 0 };
+bool               InterruptButton::m_tracing                               { true };
+uint8_t            InterruptButton::m_nextTraceId                           { MAX_BUTTON_PINS };
+static_assert((TRACE_DEPTH & (TRACE_DEPTH - 1)) == 0, "TRACE_DEPTH must be a power of 2");
+#endif
+#if IB_STATS_COMPILED
+classStats_t       InterruptButton::m_classStats                            = {};
+portMUX_TYPE       InterruptButton::m_statsMux                              = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+// This is used to initialise the queue(s) and also switch between them.
+bool InterruptButton::setMode(modes mode){
+  // Flush all queues
+  for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++) m_lanes[lane].queue.clear();
+  m_syncEventQueue.clear();
+  
+  if(mode == Mode_Asynchronous || mode == Mode_Hybrid) {
+    m_mode = mode;
+
+    // Start the RTOS queue action service/task of every lane in use (lane 0 always)
+    m_lanes[0].used = true;
+    bool retVal = true;
+    for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++)
+      if(m_lanes[lane].used) retVal = startLane(lane) && retVal;
+    return retVal;
+
+  } else if(mode == Mode_Synchronous) {
+    m_mode = mode;
+    for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++)
+      if(m_lanes[lane].task != nullptr) vTaskSuspend(m_lanes[lane].task);
+    return true;
+
+  } else {
+    ESP_LOGE(TAG, "setMode(): Invalid mode specified!");
+    return false;
+  }
+}
+
+modes InterruptButton::getMode(){
+  return m_mode;
+}
+
+void InterruptButton::setOverflowPolicy(overflowPolicies policy){
+  m_overflowPolicy = policy;
+}
+
+overflowPolicies InterruptButton::getOverflowPolicy(){
+  return m_overflowPolicy;
+}
+
+// A repeat of the newest waiting record (same button or chord, event and menu level) only increments its 'count', so a
+// slow consumer sees eg one autoRepeatPress with count 7 instead of seven records, and the queue doesn't overflow.
+void InterruptButton::setCoalescedEvents(uint16_t eventMask){
+  m_coalescedEvents = eventMask;
+}
+
+uint16_t InterruptButton::getCoalescedEvents(void){
+  return m_coalescedEvents;
+}
+
+//-- DISPATCH LANES --------------------------------------------------------------------------------------
+// Each lane has its own async queue and RTOS task, so a slow action only delays later events on its own lane.  Buttons
+// use lane 0 unless moved with setLane(); by default a higher lane's task runs at a higher priority on the same core, so
+// eg an emergency stop on lane 1 preempts a long running menu action on lane 0.  A lane's task is only created once a
+// button is assigned to it.
+bool InterruptButton::configureLane(uint8_t lane, UBaseType_t priority, BaseType_t core, uint32_t stackDepth){
+  if(lane >= DISPATCH_LANES) {
+    ESP_LOGE(TAG, "configureLane(): Lane %d does not exist, DISPATCH_LANES is %d", lane, DISPATCH_LANES);
+    return false;
+  }
+  if(m_lanes[lane].task != nullptr) {
+    ESP_LOGE(TAG, "configureLane(): Lane %d task is already running, configure it before assigning buttons", lane);
+    return false;
+  }
+  m_lanes[lane].priority = priority;
+  m_lanes[lane].core = core;
+  m_lanes[lane].stackDepth = stackDepth;
+  m_lanes[lane].configured = true;
+  return true;
+}
+
+bool InterruptButton::startLane(uint8_t lane){
+  dispatchLane_t &ln = m_lanes[lane];
+  if(ln.task != nullptr) {
+    vTaskResume(ln.task);                                       // Assuming it may have been paused earlier.
+    return true;
+  }
+  char name[16];
+  if(lane == 0) snprintf(name, sizeof(name), "%s", EVENT_TASK_NAME);
+  else          snprintf(name, sizeof(name), "%s%d", EVENT_TASK_NAME, lane);
+  bool retVal = xTaskCreatePinnedToCore(asyncQueueServicer, name,
+                                        ln.configured ? ln.stackDepth : m_RTOSservicerStackDepth,
+                                        reinterpret_cast<void*>(static_cast<uintptr_t>(lane)),
+                                        ln.configured ? ln.priority : EVENT_TASK_PRIORITY + lane,
+                                        &ln.task,
+                                        ln.configured ? ln.core : EVENT_TASK_CORE) == pdPASS;
+  if(!retVal) {
+    ln.task = nullptr;
+    ESP_LOGE(TAG, "Failed to create RTOS queue servicing task for lane %d!", lane);
+  }
+  return retVal;
+}
+
+void InterruptButton::asyncQueueServicer(void* pvParams){
+  dispatchLane_t &ln = m_lanes[reinterpret_cast<uintptr_t>(pvParams)];
+  buttonEvent_t evt;
+  while(1){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                    // Block (no polling) until action() signals there is work
+    while(ln.queue.pop(evt)) {                                  // Drain everything queued, notifications may have been merged
+      IB_STATS_ONLY(portENTER_CRITICAL(&m_statsMux);
+                    m_classStats.asyncQueues[&ln - m_lanes].latencyUS.add(esp_timer_get_time() - evt.timeUS);
+                    portEXIT_CRITICAL(&m_statsMux));
+      dispatch(evt, ln.current, &ln - m_lanes);
+    }
+  }
+  vTaskDelete(NULL);    // Only reached if we put a condition in the primary while loop based on mode
+}
+
+void InterruptButton::processSyncEvents() {
+  processSyncEvents(0, 0);
+}
+
+// Budgeted variant, keeps the main loop's frame time bounded.  At least one waiting record is actioned per call so the
+// queue always makes progress; an action running past maxMicros still completes.
+uint16_t InterruptButton::processSyncEvents(uint16_t maxEvents, uint32_t maxMicros) {
+  int64_t startUS = esp_timer_get_time();
+  buttonEvent_t evt;
+  for(uint16_t done = 0; (maxEvents == 0 || done < maxEvents) && m_syncEventQueue.pop(evt); done++) {
+    IB_STATS_ONLY(portENTER_CRITICAL(&m_statsMux);
+                  m_classStats.syncQueue.latencyUS.add(esp_timer_get_time() - evt.timeUS);
+                  portEXIT_CRITICAL(&m_statsMux));
+    dispatch(evt, m_syncCurrentEvent, Reader_Sync);          // Action the oldest entry
+    if(maxMicros != 0 && esp_timer_get_time() - startUS >= maxMicros) break;
+  }
+  return m_syncEventQueue.count();
+}
+
+void InterruptButton::dispatch(const buttonEvent_t &evt, buttonEvent_t &current, uint8_t readerSlot){
+  if(m_deleteInProgress) return;
+  readerGuard reading(readerSlot);
+  if(evt.source == Source_Chord) {
+    ButtonActions* table = (evt.id < m_numChords) ? m_chords[evt.id].actions.load(std::memory_order_acquire) : nullptr;
+    if(table == nullptr || !table->has(evt.menuLevel, IB_SINGLE_COLUMN)) return;   // Unbound since the chord fired
+    current = evt;
+    table->at(evt.menuLevel, IB_SINGLE_COLUMN)();
+    return;
+  }
+  if(evt.source == Source_Encoder) {
+    RotaryEncoder* encoder = (evt.id < MAX_ENCODERS) ? m_encoders[evt.id] : nullptr;
+    ButtonActions* table = (encoder != nullptr) ? encoder->m_actions.load(std::memory_order_acquire) : nullptr;
+    if(table == nullptr || !table->has(evt.menuLevel, ENCODER_STEP_COLUMN)) return;   // Encoder deleted, or unbound since the step
+    current = evt;
+    table->at(evt.menuLevel, ENCODER_STEP_COLUMN)();
+    return;
+  }
+  if(evt.btn == nullptr) return;                              // Button was deleted after this event was queued
+  ButtonActions* table = evt.btn->m_actions.load(std::memory_order_acquire);
+  bool bound = table->has(evt.menuLevel, evt.event);
+  bool awaited = evt.btn->m_awaitedEvents & IB_EVENT_BIT(evt.event);
+  if(!bound && !awaited) return;                              // Unbound (and no longer awaited) since the event was raised
+  current = evt;
+  if(bound) table->at(evt.menuLevel, evt.event)();
+  if(awaited) resumeWaiters(evt);
+}
+
+
+//-- COROUTINE WAITERS -----------------------------------------------------------------------------------
+// Waiters are linked from await_suspend() (any task) and taken off by the dispatcher of a matching event.  The list is
+// only walked under m_waitMux, coroutines are resumed after it is released, so a resumed coroutine can wait again.
+ButtonAwaiter::ButtonAwaiter(events event, InterruptButton* const* buttons, uint8_t count) {
+  if(count > AWAIT_MAX_BUTTONS) ESP_LOGE(TAG, "Only the first %d buttons can be awaited at once!", AWAIT_MAX_BUTTONS);
+  for(uint8_t idx = 0; idx < count && m_waiter.numButtons < AWAIT_MAX_BUTTONS; idx++)
+    if(buttons[idx] != nullptr) m_waiter.buttons[m_waiter.numButtons++] = buttons[idx];
+  if(event == Event_All)                                   m_waiter.eventMask = IB_EVENT_BIT(NumEventTypes) - 1;
+  else if(event < NumEventTypes)                           m_waiter.eventMask = IB_EVENT_BIT(event);
+  else ESP_LOGE(TAG, "Specified event is invalid!");
+}
+
+void InterruptButton::addWaiter(eventWaiter_t &waiter){
+  for(uint8_t idx = 0; idx < waiter.numButtons; idx++) {
+    InterruptButton* btn = waiter.buttons[idx];
+    if(!btn->m_thisButtonInitialised) btn->initialiseInstance();
+    for(uint8_t evt = 0; evt < NumEventTypes; evt++)      // Assume if we are waiting on it, we want it enabled (as bind())
+      if((waiter.eventMask & IB_EVENT_BIT(evt)) && !btn->eventEnabled(static_cast<events>(evt))) btn->enableEvent(static_cast<events>(evt));
+  }
+  portENTER_CRITICAL(&m_waitMux);
+  waiter.next = m_waiters;
+  waiter.waiting = true;
+  m_waiters = &waiter;
+  for(uint8_t idx = 0; idx < waiter.numButtons; idx++) {
+    InterruptButton* btn = waiter.buttons[idx];
+    btn->m_awaitedEvents = btn->m_awaitedEvents | waiter.eventMask;
+  }
+  portEXIT_CRITICAL(&m_waitMux);
+}
+
+void InterruptButton::removeWaiter(eventWaiter_t &waiter){
+  portENTER_CRITICAL(&m_waitMux);
+  for(eventWaiter_t** link = &m_waiters; waiter.waiting && *link != nullptr; link = &(*link)->next) {
+    if(*link != &waiter) continue;
+    *link = waiter.next;
+    waiter.waiting = false;
+    for(uint8_t idx = 0; idx < waiter.numButtons; idx++) if(waiter.buttons[idx]) refreshAwaited(waiter.buttons[idx]);
+    break;
+  }
+  portEXIT_CRITICAL(&m_waitMux);
+}
+
+void InterruptButton::refreshAwaited(InterruptButton* btn){
+  uint16_t mask = 0;
+  for(eventWaiter_t* waiter = m_waiters; waiter != nullptr; waiter = waiter->next)
+    for(uint8_t idx = 0; idx < waiter->numButtons; idx++) if(waiter->buttons[idx] == btn) mask |= waiter->eventMask;
+  btn->m_awaitedEvents = mask;
+}
+
+void InterruptButton::resumeWaiters(const buttonEvent_t &evt){
+  eventWaiter_t* ready = nullptr;                             // Taken off the list, oldest waiter first
+  portENTER_CRITICAL(&m_waitMux);
+  for(eventWaiter_t** link = &m_waiters; *link != nullptr;) {
+    eventWaiter_t* waiter = *link;
+    bool matches = false;
+    for(uint8_t idx = 0; idx < waiter->numButtons; idx++) matches |= waiter->buttons[idx] == evt.btn;
+    if(!matches || !(waiter->eventMask & IB_EVENT_BIT(evt.event))) {
+      link = &waiter->next;
+      continue;
+    }
+    *link = waiter->next;
+    waiter->next = ready;
+    waiter->waiting = false;
+    waiter->event = evt;
+    ready = waiter;
+  }
+  for(eventWaiter_t* waiter = ready; waiter != nullptr; waiter = waiter->next)
+    for(uint8_t idx = 0; idx < waiter->numButtons; idx++) if(waiter->buttons[idx]) refreshAwaited(waiter->buttons[idx]);
+  portEXIT_CRITICAL(&m_waitMux);
+  while(ready != nullptr) {
+    eventWaiter_t* waiter = ready;
+    ready = waiter->next;                                     // Read first, the coroutine may reuse the waiter's storage
+    waiter->resume(waiter->frame);
+  }
+}
+
+//-- LOW POWER MODE --------------------------------------------------------------------------------------
+// Light sleep can only be woken by level type gpio interrupts, so in low power mode a released button waits on its
+// pressed level instead of on any edge.  The first press wakes the chip and enters readButton() as usual, which masks
+// the interrupt and switches the pin back to edges until the button is released again (so keyDown is never missed).
+// The RTOS servicer blocks until notified and all button timers are stopped while every button is released (apart from
+// a double-click timer still waiting out doubleClickMS after a click), so nothing keeps the chip awake.
+void InterruptButton::setLowPowerMode(bool enable){
+  if(enable == m_lowPowerMode) return;
+  m_lowPowerMode = enable;
+  if(enable) esp_sleep_enable_gpio_wakeup();
+  else       esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+  for(uint8_t pin = 0; pin < MAX_BUTTON_PINS; pin++) {       // Re-arm buttons that are waiting on their pin
+    InterruptButton* btn = m_pinButtons[pin];
+    if(btn == nullptr) continue;
+    gpio_intr_disable(btn->m_pin);
+    if(btn->m_state == Released || btn->m_state == Pressed || btn->m_debounceEngine == Debounce_EdgeTimestamp)
+      btn->edgeInterrupt(true);                               // Polling engines keep it masked while debouncing
+  }
+}
+
+bool InterruptButton::getLowPowerMode(void){
+  return m_lowPowerMode;
+}
+
+void IRAM_ATTR InterruptButton::edgeInterrupt(bool enable){
+  if(m_debounceEngine == Debounce_External) return;
+  if(!enable) {
+    if(m_debounceEngine != Debounce_EdgeTimestamp) gpio_intr_disable(m_pin);   // Edge engine stays armed while settling
+    return;
+  }
+  if(m_storming) return;                                      // Storm timer stands in for the interrupt until the pin is quiet
+  bool wakeup = m_lowPowerMode && m_state == Released;
+  if(wakeup != m_wakeupArmed) {
+    if(wakeup) {
+      gpio_wakeup_enable(m_pin, m_pressedState ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    } else {
+      gpio_wakeup_disable(m_pin);
+      gpio_set_intr_type(m_pin, GPIO_INTR_ANYEDGE);
+    }
+    m_wakeupArmed = wakeup;
+  }
+  gpio_intr_enable(m_pin);
+}
+
+
+const buttonEvent_t& InterruptButton::currentEvent(void){
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++)
+    if(m_lanes[lane].task != nullptr && m_lanes[lane].task == self) return m_lanes[lane].current;
+  return m_syncCurrentEvent;
+}
+
+
+//-- Method to monitor button, called by button change and the poll timer (periodic while debouncing) ----
+void IRAM_ATTR InterruptButton::readButton(void *arg){
+  if(m_deleteInProgress) return;
+  IB_STATS_ONLY(callbackTimer timing);
+  readerGuard reading;
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  IB_TRACE_ONLY(stateTracer tracing(btn));
+  uint8_t level;                                              // Debounce sample, read once so the trace records what was used
+  if(btn->m_debounceEngine == Debounce_EdgeTimestamp && !btn->edgeSettle()) return;   // Bounce edge, or settled unchanged
+
+  switch(btn->m_state){
+    case Released:                                              // Was sitting released but just detected a signal from the button
+      btn->edgeInterrupt(false);                                // Ignore change inputs while we poll for a valid press
+      IB_TRACE_ONLY(btn->trace(Trace_Edge, btn->pinLevel()));
+      btn->countEdge();
+      btn->m_pressEdgeUS = esp_timer_get_time();
+      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // Was released, just detected a change, must be a valid press so count it.
+      btn->m_settleUS = 0;
+      IB_STATS_ONLY(btn->m_pressPolls = 1);
+      btn->m_blockKeyPress = false;
+      btn->m_inChord = false;
+      startPolling(btn);                                        // Begin debouncing the button input (periodic sampling)
+      btn->m_state = ConfirmingPress;
+      if(btn->m_debounceEngine == Debounce_EdgeTimestamp && btn->m_wakeupArmed)
+        btn->edgeInterrupt(true);                               // Stays armed, but on any edge rather than the wakeup level
+
+      break;
+
+    case ConfirmingPress:                                       // we get here each time the debounce timer expires (onchange interrupt disabled remember)
+      btn->m_totalPolls++;                                      // Count the number of total reads
+      IB_STATS_ONLY(btn->m_pressPolls++);
+      level = btn->sampleLevel();
+      if(level == btn->m_pressedState) btn->m_validPolls++;    // Count the number of valid 'PRESSED' reads
+      else if(btn->m_adaptive) btn->m_settleUS = esp_timer_get_time() - btn->m_pressEdgeUS;  // Still bouncing at this sample
+      IB_TRACE_ONLY(btn->trace(Trace_Sample, level, btn->m_validPolls));
+      if(btn->m_totalPolls >= btn->m_targetPolls || btn->settled(btn->m_pressEdgeUS)){   // If we have checked the button enough times, then make a decision on key state
+        if(btn->m_validPolls * 2 <= btn->m_totalPolls) {        // Then it was a false alarm
+          IB_STATS_ONLY(btn->m_stats.falseAlarms++);
+          stopPolling(btn);
+          btn->m_state = Released;                                        
+          btn->edgeInterrupt(true);
+          btn->glitchReleased();
+          return;
+        }                                                       // Otherwise, spill over to "Pressing"
+      } else {                                                  // Not yet enough polls to confirm state
+        return;                                                 // Periodic poll timer keeps sampling pin state
+      }
+      [[fallthrough]];                                           // Planned spill through here (no break) if logic requires, ie keyDown confirmed.
+    case Pressing:                                              // VALID KEYDOWN, assumed pressed if it had valid polls more than half the time
+      stopPolling(btn);
+      if(btn->m_adaptive) btn->adaptDebounce();
+      btn->action(btn, Event_KeyDown);                          // Add the keyDown action to the relevant queue
+      if(m_numChords) updateChords(btn, true);                  // May complete a chord (blocks this button's keyPress and longPress)
+      if(btn->m_inChord) {
+        // This press completed a chord: no member long presses or repeats while it is held
+      } else if(IB_LONGPRESS_COMPILED && btn->eventEnabled(Event_LongKeyPress) && btn->hasAction(m_menuLevel, Event_LongKeyPress)){
+        btn->m_autoRepeating = false;
+        startTimer(btn->m_buttonLPandRepeatTimer, btn->heldTimeoutUS(btn->m_longKeyPressMS));
+      } else if (IB_AUTOREPEAT_COMPILED && btn->eventEnabled(Event_AutoRepeatPress)) {
+        btn->m_autoRepeating = true;
+        startTimer(btn->m_buttonLPandRepeatTimer, btn->heldTimeoutUS(btn->m_autoRepeatMS));
+      }
+
+      btn->m_state = Pressed;
+      btn->edgeInterrupt(true);                                 // Begin monitoring pin again
+      break;
+
+    case Pressed:                                               // Currently pressed until now, but there was a change on the pin
+      btn->edgeInterrupt(false);                                // Turn off this interrupt to ignore inputs while we wait to check if valid release
+      IB_TRACE_ONLY(btn->trace(Trace_Edge, btn->pinLevel()));
+      btn->countEdge();
+      startPolling(btn);                                        // Start polling the button periodically to debounce it
+      btn->m_releaseEdgeUS = esp_timer_get_time();
+      btn->m_validPolls = 1; btn->m_totalPolls = 1;             // This is first poll and it was just released by definition of state
+      btn->m_settleUS = 0;
+      IB_STATS_ONLY(btn->m_pressPolls++);
+      btn->m_state = WaitingForRelease;
+      break;
+
+    case WaitingForRelease: // we get here when debounce timer or doubleclick timeout timer alarms (onchange interrupt disabled remember)
+                            // stay in this state until released, because button could remain locked down if release missed.
+      btn->m_totalPolls++;
+      IB_STATS_ONLY(btn->m_pressPolls++);
+      level = btn->sampleLevel();
+      if(level != btn->m_pressedState){
+        btn->m_validPolls++;
+        IB_TRACE_ONLY(btn->trace(Trace_Sample, level, btn->m_validPolls));
+        if((btn->m_totalPolls < btn->m_targetPolls && !btn->settled(btn->m_releaseEdgeUS)) || btn->m_validPolls * 2 <= btn->m_totalPolls) {  // If we haven't polled enough or not high enough success rate
+          return;                                               // Then keep sampling pin state until release is confirmed
+        }                                                       // Otherwise, spill through to "Releasing"
+      } else {
+        if(btn->m_adaptive) btn->m_settleUS = esp_timer_get_time() - btn->m_releaseEdgeUS;
+        if(btn->m_validPolls > 0) {
+          btn->m_validPolls--;
+        } else {
+          btn->m_totalPolls = 0;                                // Key is being held down, don't let total polls get too far ahead.
+        }
+        IB_TRACE_ONLY(btn->trace(Trace_Sample, level, btn->m_validPolls));
+        return;                                                 // Keep sampling pin state until released
+      }
+      [[fallthrough]];                                           // Intended spill through here (no break) to "Releasing" once keyUp confirmed.
+
+    case Releasing:
+      stopPolling(btn);
+      if(btn->m_adaptive) btn->adaptDebounce();
+      stopTimer(btn->m_buttonLPandRepeatTimer);
+      btn->action(btn, Event_KeyUp);                            // Add the keyUp action to the relevant queue
+      if(m_numChords) updateChords(btn, false);
+      IB_STATS_ONLY(btn->m_stats.presses++; btn->m_stats.polls += btn->m_pressPolls;
+                    if(btn->m_pressPolls > btn->m_stats.maxPolls) btn->m_stats.maxPolls = btn->m_pressPolls);
+
+      if(IB_PATTERN_COMPILED && btn->eventEnabled(Event_Pattern) && btn->eventEnabled(Event_All) &&      // If patterns are enabled and
+         (btn->m_clicks || btn->hasAction(m_menuLevel, Event_Pattern))) {                                  // defined (or one is under way)
+        btn->recordClick();                                     // Replaces double-click detection, Event_Pattern counts the clicks
+
+      } else if(IB_DOUBLECLICK_COMPILED && btn->eventEnabled(Event_DoubleClick) && btn->eventEnabled(Event_All) &&  // If double-clicks are enabled
+         btn->hasAction(m_menuLevel, Event_DoubleClick)) {                                                     // and defined
+
+        if(btn->m_wtgForDblClick) {                             // VALID DOUBLE-CLICK (second keyup without a timeout, would normally check 
+          stopTimer(btn->m_buttonDoubleClickTimer);             // esp_timer_is_active, but function not available in esp32 arduino core.
+          btn->m_wtgForDblClick = false;
+          btn->action(btn, Event_DoubleClick);                  // Add the double-click action to the relevant queue
+
+        } else if (!btn->m_blockKeyPress) {                     // Commence double-click detection process               
+          btn->m_wtgForDblClick = true;
+          btn->m_doubleClickMenuLevel = m_menuLevel;            // Save menuLevel in case this is converted to a keyPress later
+          startTimer(btn->m_buttonDoubleClickTimer, uint64_t(btn->m_doubleClickMS * 1000));
+        }
+      } else if(!btn->m_blockKeyPress) {                        // Otherwise, treat as a basic keyPress
+        btn->action(btn, Event_KeyPress);                       // Then treat as a normal keyPress
+      } 
+      btn->m_state = Released;
+      btn->edgeInterrupt(true);
+      break;
+  } // End of SWITCH statement
+
+  if(btn->m_handingOff) btn->edgeHandedOff();                 // Every claimed edge engine transition ends here
+  return;
+} // End of readButton function
+
+
+//-- Callback for the longPress/autoRepeat timer, which is shared by both events (called by timer) ------
+void InterruptButton::longPressAndRepeatTimeout(void *arg){
+  IB_STATS_ONLY(callbackTimer timing);
+  readerGuard reading;
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  IB_TRACE_ONLY(btn->trace(Trace_Timer, 0));
+  if(btn->m_autoRepeating) autoRepeatPressEvent(arg);
+  else                     longPressEvent(arg);
+}
+
+//-- Method to handle longKeyPresses (called by timer)----------------------------------------------------
+void InterruptButton::longPressEvent(void *arg){
+  if(m_deleteInProgress) return;
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+
+  btn->action(btn, Event_LongKeyPress);                                     // Add the long keypress action to the relevant queue
+  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
+  
+  //Initiate the autorepeat function
+  if(btn->eventEnabled(Event_AutoRepeatPress) && btn->pinLevel() == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
+    btn->m_autoRepeating = true;
+    startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000));
+  }
+}
+
+//-- Method to handle autoRepeatPresses (called by timer)-------------------------------------------------
+void InterruptButton::autoRepeatPressEvent(void *arg){
+  if(m_deleteInProgress) return;
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  btn->m_blockKeyPress = true;                                              // Used to prevent regular keypress or doubleclick later on in procedure.
+
+  if(btn->hasAction(m_menuLevel, Event_AutoRepeatPress)) {
+    btn->action(btn, Event_AutoRepeatPress);                                // Action the Async Auto Repeat KeyPress Event if defined
+  } else {
+    btn->action(btn, Event_KeyPress);                                       // Action the Async KeyPress Event otherwise
+  }
+  if(btn->eventEnabled(Event_AutoRepeatPress) && btn->pinLevel() == btn->m_pressedState) { // Sanity check to stop autorepeats in case we somehow missed button release
+    startTimer(btn->m_buttonLPandRepeatTimer, uint64_t(btn->m_autoRepeatMS * 1000));
+  }
+}
+
+//-- Method to return to interpret previous keyUp as a keyPress instead of a doubleClick if it times out.
+void InterruptButton::doubleClickTimeout(void *arg){
+  if(m_deleteInProgress) return;
+  IB_STATS_ONLY(callbackTimer timing);
+  readerGuard reading;
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  IB_TRACE_ONLY(btn->trace(Trace_Timer, 1));
+  btn->m_wtgForDblClick = false;
+  if(IB_PATTERN_COMPILED && btn->m_clicks) {
+    if(btn->m_state == Released) btn->finishPattern();        // Otherwise the next press is under way and its release continues the sequence
+    return;
+  }
+  if(btn->pinLevel() != btn->m_pressedState)
+    btn->action(btn, Event_KeyPress, btn->m_doubleClickMenuLevel);                    // Then treat as a normal keyPress at the menuLevel when first click occurred
+                                                                                      // Note, this timer is never started if previous press was a longpress
+}
+
+//-- Helper method to create a button's timer once, when initialising the button --------------------------
+void InterruptButton::createTimer(esp_timer_handle_t &timer, void (*callBack)(void* arg), InterruptButton* btn, const char *name){
+  esp_timer_create_args_t tmrConfig = {};
+    tmrConfig.arg = reinterpret_cast<void*>(btn);
+    tmrConfig.callback = callBack;
+    tmrConfig.dispatch_method = ESP_TIMER_TASK;
+    tmrConfig.name = name;
+  if(esp_timer_create(&tmrConfig, &timer) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create %s timer for gpio %d", name, btn->m_pin);
+    timer = nullptr;
+  }
+}
+
+//-- Helper method to (re)arm an existing timer, no allocation so safe to call on every poll/edge ----------
+void IRAM_ATTR InterruptButton::startTimer(esp_timer_handle_t timer, uint32_t duration_US, bool periodic){
+  if(m_deleteInProgress || timer == nullptr) return;
+  esp_timer_stop(timer);                                      // Returns an error if not running, which is fine
+  if(periodic) esp_timer_start_periodic(timer, duration_US);
+  else         esp_timer_start_once(timer, duration_US);
+}
+
+//-- Helper method to stop a timer without deleting it ---------------------------------------------------
+void IRAM_ATTR InterruptButton::stopTimer(esp_timer_handle_t timer){
+  if(timer) esp_timer_stop(timer);
+}
+
+//-- Helper method to kill a timer (only used when destroying a button) ----------------------------------
+void InterruptButton::killTimer(esp_timer_handle_t &timer){
+  if(timer){
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+    timer = nullptr;
+  }
+}
+
+//-- PRESS PATTERNS (multi-clicks and short/long sequences) ---------------------------------------------
+// Registered patterns share one small DFA (a trie of short/long presses).  Each release moves the button one node along
+// and restarts its double-click timer, so no timer is added; once doubleClickMS passes with the button released the
+// sequence is over and one Event_Pattern is raised with the click count, the long presses and the pattern matched.
+// A lone press that matches no pattern stays a plain keyPress (unless its longPress or autoRepeat fired).
+
+void InterruptButton::recordClick(void){
+  if(m_inChord) {                                             // A chord press ends the sequence without an event
+    stopTimer(m_buttonDoubleClickTimer);
+    m_wtgForDblClick = false;
+    m_clicks = 0;
+    return;
+  }
+  bool isLong = (m_releaseEdgeUS - m_pressEdgeUS) >= m_longKeyPressMS * 1000LL;
+  if(m_clicks == 0) {
+    m_doubleClickMenuLevel = m_menuLevel;                     // Raised at the menu level of the first press
+    m_patternState = 0;
+    m_longMask = 0;
+  }
+  if(m_clicks < PATTERN_MAX_PRESSES) {
+    if(isLong) m_longMask |= 1 << m_clicks;
+    m_clicks++;
+    if(m_patternState != PATTERN_NO_STATE) {
+      uint8_t next = m_patternStates[m_patternState].next[isLong];
+      m_patternState = next ? next : PATTERN_NO_STATE;
+    }
+  } else {
+    m_patternState = PATTERN_NO_STATE;                        // Longer than any pattern, still counted as PATTERN_MAX_PRESSES clicks
+  }
+  m_wtgForDblClick = true;
+  startTimer(m_buttonDoubleClickTimer, uint64_t(m_doubleClickMS * 1000));
+}
+
+void InterruptButton::finishPattern(void){
+  int8_t match = (m_patternState != PATTERN_NO_STATE) ? m_patternStates[m_patternState].pattern : -1;
+  if(match >= 0 || m_clicks >= 2) {
+    m_patternMatch = (match >= 0) ? match : 0xFF;
+    action(this, Event_Pattern, m_doubleClickMenuLevel);
+  } else if(!m_blockKeyPress) {
+    action(this, Event_KeyPress, m_doubleClickMenuLevel);     // Single click, as the double-click timeout would
+  }
+  m_clicks = 0;
+}
+
+// A press that proved a glitch left the button Released again.  If the double-click timeout fired while it was being
+// confirmed, that timeout left the sequence to this press's release, which never comes, so it is finished here.
+void InterruptButton::glitchReleased(void){
+  if(IB_PATTERN_COMPILED && m_clicks && !m_wtgForDblClick) finishPattern();
+}
+
+int8_t InterruptButton::addPattern(const char* presses){
+  size_t length = presses ? strlen(presses) : 0;
+  if(length == 0 || length > PATTERN_MAX_PRESSES || strspn(presses, "SLsl") != length) {
+    ESP_LOGE(TAG, "addPattern(): A pattern is 1 to %d presses, each 'S' (short) or 'L' (long)!", PATTERN_MAX_PRESSES);
+    return -1;
+  }
+  uint8_t state = 0;
+  for(size_t idx = 0; idx < length; idx++) {
+    uint8_t &next = m_patternStates[state].next[presses[idx] == 'L' || presses[idx] == 'l'];
+    if(next == 0) {
+      if(m_numPatternStates >= MAX_PATTERN_STATES) {
+        ESP_LOGE(TAG, "addPattern(): No room for another pattern, MAX_PATTERN_STATES is %d", MAX_PATTERN_STATES);
+        return -1;
+      }
+      m_patternStates[m_numPatternStates] = { {0, 0}, -1 };
+      next = m_numPatternStates++;                            // Linked only once the new node is complete
+    }
+    state = next;
+  }
+  if(m_patternStates[state].pattern < 0) {
+    if(m_numPatterns >= INT8_MAX) return -1;
+    m_patternStates[state].pattern = m_numPatterns++;
+  }
+  return m_patternStates[state].pattern;
+}
+
+
+//-- EDGE STORM PROTECTION -------------------------------------------------------------------------------
+// A noisy or floating line can raise edges as fast as each debounce cycle re-arms the interrupt.  Past a button's limit
+// its interrupt stays disabled and a slow periodic timer samples the pin instead, a sampled change standing in for the
+// edge, so the button keeps working at a bounded CPU cost.  Once the sampled level has been steady for STORM_QUIET_MS
+// the interrupt is re-armed (and trips again after another maxEdges if the noise is still there).
+
+void IRAM_ATTR InterruptButton::countEdge(void){
+  if(m_stormMaxEdges == 0 || m_storming || m_buttonStormTimer == nullptr) return;
+  int64_t nowUS = esp_timer_get_time();
+  if(nowUS - m_stormWindowUS >= m_stormWindowMS * 1000LL) {
+    m_stormWindowUS = nowUS;
+    m_stormEdges = 0;
+  }
+  if(++m_stormEdges <= m_stormMaxEdges) return;
+  m_storming = true;                                          // Interrupt stays masked from here (see edgeInterrupt())
+  gpio_intr_disable(m_pin);                                   // Already masked, unless the edge engine is settling
+  m_stormReported = false;
+  m_storms++;
+  m_stormQuietUS = nowUS;
+  startTimer(m_buttonStormTimer, STORM_POLL_MS * 1000, true);
+}
+
+void InterruptButton::stormPoll(void *arg){
+  if(m_deleteInProgress) return;
+  IB_STATS_ONLY(callbackTimer timing);
+  InterruptButton* btn = reinterpret_cast<InterruptButton*>(arg);
+  if(!btn->m_stormReported) {                                 // Entered from the ISR, report from task context
+    btn->m_stormReported = true;
+    if(m_stormHandler) m_stormHandler(btn, true);
+  }
+  if(btn->m_state != Released && btn->m_state != Pressed) return;   // Being debounced, its poll timer is sampling
+  int64_t nowUS = esp_timer_get_time();
+  bool pressed = btn->pinLevel() == btn->m_pressedState;
+  if(pressed != (btn->m_state == Pressed)) {
+    btn->m_stormQuietUS = nowUS;
+    readButton(btn);                                          // Sampled change stands in for the masked edge
+  } else if(nowUS - btn->m_stormQuietUS >= STORM_QUIET_MS * 1000LL) {
+    stopTimer(btn->m_buttonStormTimer);
+    btn->m_storming = false;
+    btn->m_stormWindowUS = nowUS;
+    btn->m_stormEdges = 0;
+    btn->edgeInterrupt(true);
+    if(m_stormHandler) m_stormHandler(btn, false);
+  }
+}
+
+void InterruptButton::setStormHandler(storm_func_t handler){
+  m_stormHandler = handler;
+}
+
+void InterruptButton::setStormLimit(uint16_t maxEdges, uint16_t windowMS){
+  m_stormMaxEdges = maxEdges;
+  m_stormWindowMS = windowMS ? windowMS : 1;
+  if(maxEdges && m_thisButtonInitialised && m_debounceEngine != Debounce_External && m_buttonStormTimer == nullptr)
+    createTimer(m_buttonStormTimer, &stormPoll, this, "IB_storm");
+}
+
+bool InterruptButton::isStorming(void){
+  return m_storming;
+}
+
+uint32_t InterruptButton::getStormCount(void){
+  return m_storms;
+}
+
+
+//-- EDGE TIMESTAMP ENGINE -------------------------------------------------------------------------------
+// The pin interrupt stays armed while a press or release settles and each edge just restarts the button's poll timer
+// as a one-shot of the full debounce time (pollInterval x targetPolls), so the timer only fires once the line has been
+// quiet that long, and the level it then reads decides the transition: one timer wakeup per press and per release
+// whatever the bounce, instead of targetPolls samples each.  Edges are told apart from the timer by their ISR context.
+// Bounce edges only count towards the storm limit once a transition outlasts its debounce time (noise, not bounce).
+//
+// As the interrupt stays armed, the ISR (on either core) and the timer task can both be in readButton().  Each decision
+// is taken under the button's m_settleMux, and one that carries on into the state machine claims the transition until
+// readButton() has stored the next state; an edge arriving meanwhile is left to the owner, which restarts the quiet timer
+// for it.  The lock only covers the decision, the timer and gpio calls it leads to are made once it is released.
+// During an edge storm the interrupt is masked and the periodic poll samples the press or release instead, like the
+// polling engines, as a single late sample of a noisy line proves nothing.
+
+bool IRAM_ATTR InterruptButton::edgeSettle(void){
+  bool isr = xPortInIsrContext();
+  bool carryOn = false;
+  bool bounce = false;
+  bool noise = false;
+  bool rearm = false;
+  portENTER_CRITICAL_SAFE(&m_settleMux);
+  if(m_handingOff) {                                          // The other context is mid transition, it catches up after
+    m_edgeMissed = true;
+  } else if(m_storming) {
+    carryOn = !isr;                                           // Storm and poll timers drive the state machine, edges are noise
+  } else if(!isr) {                                           // Quiet timer
+    carryOn = settleLevel(rearm);
+  } else if(m_state == Released || m_state == Pressed) {      // First edge of a press or release
+    carryOn = true;
+  } else {                                                    // Bounce edge while settling
+    IB_TRACE_ONLY(trace(Trace_Edge, pinLevel()));
+    int64_t sinceUS = esp_timer_get_time() - ((m_state == ConfirmingPress) ? m_pressEdgeUS : m_releaseEdgeUS);
+    uint32_t debounceUS = static_cast<uint32_t>(m_pollIntervalUS) * m_targetPolls;
+    m_settleUS = sinceUS;                                     // Bounce lasts at least until this edge
+    bounce = true;
+    noise = sinceUS >= debounceUS;
+  }
+  if(carryOn && !m_storming) m_handingOff = true;
+  portEXIT_CRITICAL_SAFE(&m_settleMux);
+  if(bounce) {
+    if(noise) countEdge();
+    startPolling(this);                                       // Restarts the one-shot, or polls if that edge began a storm
+  }
+  if(rearm) {
+    edgeInterrupt(true);
+    if(m_state == Released) glitchReleased();
+  }
+  return carryOn;
+}
+
+// Quiet timer expiry (caller holds m_settleMux): the level now decides the transition
+bool IRAM_ATTR InterruptButton::settleLevel(bool &rearm){
+  uint8_t level = pinLevel();
+  bool pressed = (level == m_pressedState);
+  if(m_state == Released || m_state == Pressed)               // Late expiry after an edge was decided, unless it was missed
+    return pressed != (m_state == Pressed);
+  if(m_state != ConfirmingPress && m_state != WaitingForRelease) return false;
+  IB_STATS_ONLY(m_pressPolls++);
+  IB_TRACE_ONLY(trace(Trace_Sample, level, pressed));
+  if(pressed == (m_state == ConfirmingPress)) {               // Settled at the new level: spill into Pressing or Releasing
+    m_state = pressed ? Pressing : Releasing;
+    return true;
+  }
+  IB_STATS_ONLY(if(m_state == ConfirmingPress) m_stats.falseAlarms++);
+  m_state = pressed ? Pressed : Released;                     // Settled back where it started, a glitch
+  rearm = true;
+  return false;
+}
+
+void IRAM_ATTR InterruptButton::edgeHandedOff(void){
+  portENTER_CRITICAL_SAFE(&m_settleMux);
+  m_handingOff = false;
+  bool missed = m_edgeMissed;
+  m_edgeMissed = false;
+  portEXIT_CRITICAL_SAFE(&m_settleMux);
+  if(missed && !m_storming) startPolling(this);               // Its quiet timer reads where the line ended up
+}
+
+
+//-- SHARED SCAN ENGINE -----------------------------------------------------------------------------------
+// While any Debounce_SharedScan button is confirming a press or release, one periodic timer reads the whole GPIO
+// input register and feeds every active button its sample, instead of each button running its own poll timer.
+
+//-- Helper method to begin periodic sampling of a button with the engine it is configured for ------------
+void IRAM_ATTR InterruptButton::startPolling(InterruptButton* btn){
+  if(btn->m_debounceEngine == Debounce_External) return;      // Owner samples its keys while they are being debounced
+  if(btn->m_debounceEngine == Debounce_EdgeTimestamp && !btn->m_storming) {   // One-shot, restarted by every edge until
+    startTimer(btn->m_buttonPollTimer, static_cast<uint32_t>(btn->m_pollIntervalUS) * btn->m_targetPolls);   // the line is quiet
+    return;
+  }
+  if(btn->m_debounceEngine != Debounce_SharedScan) {
+    startTimer(btn->m_buttonPollTimer, btn->m_pollIntervalUS, true);
+    return;
+  }
+  portENTER_CRITICAL_SAFE(&m_scanMux);
+  bool wasIdle = (m_scanActiveMask == 0);
+  m_scanActiveMask |= BIT64(btn->m_pin);
+  portEXIT_CRITICAL_SAFE(&m_scanMux);
+  if(wasIdle) startTimer(m_scanTimer, m_scanIntervalUS, true);
+}
+
+//-- Helper method to end periodic sampling of a button --------------------------------------------------
+void IRAM_ATTR InterruptButton::stopPolling(InterruptButton* btn){
+  if(btn->m_debounceEngine == Debounce_External) return;
+  if(btn->m_debounceEngine != Debounce_SharedScan) {
+    stopTimer(btn->m_buttonPollTimer);
+    return;
+  }
+  portENTER_CRITICAL_SAFE(&m_scanMux);
+  m_scanActiveMask &= ~BIT64(btn->m_pin);
+  bool nowIdle = (m_scanActiveMask == 0);
+  portEXIT_CRITICAL_SAFE(&m_scanMux);
+  if(nowIdle) stopTimer(m_scanTimer);                         // Nothing left to debounce, let the core idle
+}
+
+//-- Callback of the shared scan timer, advances all actively polled buttons from one register sample ---
+void InterruptButton::scanButtons(void* /*arg*/){            // One timer for all buttons, no argument
+  if(m_deleteInProgress) return;
+  uint64_t active = m_scanActiveMask;
+  if(active == 0) return;
+  uint64_t pressed = ~(ibhal_read_inputs() ^ m_scanPressedLevels) & active;   // Bit set where the pin is at its pressed level
+
+  while(active) {
+    uint8_t pin = __builtin_ctzll(active);                    // Lowest active pin, cost depends only on buttons being polled
+    active &= active - 1;
+    InterruptButton* btn = m_pinButtons[pin];
+    if(btn == nullptr) continue;
+    btn->m_scannedLevel = ((pressed >> pin) & 0x01) ? btn->m_pressedState : !btn->m_pressedState;
+    readButton(btn);
+  }
+}
+
+void InterruptButton::setScanInterval(uint16_t intervalUS){
+  if(intervalUS > 0) m_scanIntervalUS = intervalUS;
+}
+
+uint16_t InterruptButton::getScanInterval(void){
+  return m_scanIntervalUS;
+}
+
+//-- Helper method for owners of Debounce_External keys (MatrixKeypad, AnalogButtons), one scan of up to 64 keys -------
+// Keys whose contact disagrees with their debounced state get an edge, keys being debounced get a sample, exactly as
+// the gpio ISR and poll timer would drive a stand-alone button.  Keys that are settled and unchanged cost nothing.
+void InterruptButton::feedKeys(InterruptButton* const* keys, uint64_t closed, uint64_t &activeKeys, uint64_t &pressedKeys){
+  uint64_t work = (closed ^ pressedKeys) | activeKeys;
+  while(work) {
+    uint8_t idx = __builtin_ctzll(work);
+    work &= work - 1;
+    InterruptButton* key = keys[idx];
+    key->m_scannedLevel = (closed >> idx) & 0x01;
+    readButton(key);
+
+    uint64_t bit = BIT64(idx);
+    if(key->m_state == ConfirmingPress || key->m_state == WaitingForRelease) activeKeys |= bit;
+    else                                                                      activeKeys &= ~bit;
+    if(key->m_state == Pressed || key->m_state == WaitingForRelease)          pressedKeys |= bit;
+    else                                                                      pressedKeys &= ~bit;
+  }
+}
+
+
+//-- Helper method to wake a lane's RTOS queue servicer, action() is called from both ISR and esp_timer task context
+void IRAM_ATTR InterruptButton::notifyServicer(uint8_t lane){
+  TaskHandle_t task = m_lanes[lane].task;
+  if(task == nullptr) return;
+  if(xPortInIsrContext()) {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &higherPriorityTaskWoken);
+    if(higherPriorityTaskWoken) portYIELD_FROM_ISR();
+  } else {
+    xTaskNotifyGive(task);
+  }
+}
+
+void IRAM_ATTR InterruptButton::action(InterruptButton* btn, events event, uint8_t menuLevel){  
+  if(m_deleteInProgress)                                                      return;
+  if(!btn->eventEnabled(event) || !btn->eventEnabled(Event_All))              return;   // Specific event is or all events are disabled
+  if(!btn->hasAction(menuLevel, event))                                       return;   // Invalid menu level or event is not defined
+  IB_STATS_ONLY(portENTER_CRITICAL_SAFE(&m_statsMux); btn->m_stats.events[event]++; portEXIT_CRITICAL_SAFE(&m_statsMux));
+  IB_TRACE_ONLY(btn->trace(Trace_Event, event, menuLevel));
+
+  buttonEvent_t evt;                                                 // Only a handful of stores, the action is resolved when dispatched
+    evt.btn = btn;
+    evt.timeUS = esp_timer_get_time();
+    evt.durationUS = static_cast<uint32_t>(((btn->m_state == ConfirmingPress || btn->m_state == Pressing || btn->m_state == Pressed) ? evt.timeUS : btn->m_releaseEdgeUS)
+                                           - btn->m_pressEdgeUS);
+    evt.event = event;
+    evt.menuLevel = menuLevel;
+    evt.source = Source_Button;
+    evt.id = (event == Event_Pattern) ? btn->m_patternMatch : 0;
+    evt.clicks = (event == Event_Pattern) ? btn->m_clicks : 0;
+    evt.longMask = (event == Event_Pattern) ? btn->m_longMask : 0;
+    evt.count = 1;
+    evt.delta = 0;
+
+  enqueue(evt, m_mode == Mode_Asynchronous || (m_mode == Mode_Hybrid && (event == Event_KeyDown || event == Event_KeyUp)));
+}
+
+pushResults IRAM_ATTR InterruptButton::enqueue(const buttonEvent_t &evt, bool async){
+  pushResults result;
+  bool merge = (m_coalescedEvents & IB_EVENT_BIT(evt.event)) || evt.source == Source_Encoder;   // Steps always sum
+  if(async) {
+    uint8_t lane = (evt.btn != nullptr) ? evt.btn->m_lane : 0;    // Chords use the lane of the button that completed them
+    if(evt.source == Source_Encoder) lane = m_encoders[evt.id]->m_lane;
+    result = m_lanes[lane].queue.push(evt, m_overflowPolicy, merge);  // Action immediatley using RTOS asynchronous Queue
+    IB_STATS_ONLY(countPush(m_classStats.asyncQueues[lane], result, m_lanes[lane].queue.count()));
+    notifyServicer(lane);
+  } else {                                                         // Action when called in main loop hook using synchronous Queue
+    result = m_syncEventQueue.push(evt, m_overflowPolicy, merge);
+    IB_STATS_ONLY(countPush(m_classStats.syncQueue, result, m_syncEventQueue.count()));
+  }
+  return result;
+}
+
+
+#if IB_STATS_COMPILED
+//-- STATISTICS (INTERRUPTBUTTON_STATS builds only) ------------------------------------------------------
+// Counters are updated inline by the ISR, timer callbacks and queue servicer, snapshots are copied out under the same
+// short spinlock so a telemetry task can export them without stopping the buttons.
+
+void IRAM_ATTR InterruptButton::countPush(queueStats_t &stats, pushResults result, uint16_t pending){
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  if(result == Push_Stored || result == Push_DroppedOldest) stats.queued++;
+  if(result == Push_DroppedOldest || result == Push_DroppedNewest) stats.dropped++;
+  if(result == Push_Coalesced) stats.coalesced++;
+  if(pending > stats.highWater) stats.highWater = pending;
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+
+IRAM_ATTR InterruptButton::callbackTimer::~callbackTimer(){
+  uint32_t elapsedUS = static_cast<uint32_t>(esp_timer_get_time() - m_startUS);
+  portENTER_CRITICAL_SAFE(&m_statsMux);
+  if(m_isr) m_classStats.isrUS.add(elapsedUS);
+  else      m_classStats.timerUS.add(elapsedUS);
+  portEXIT_CRITICAL_SAFE(&m_statsMux);
+}
+
+void InterruptButton::getClassStats(classStats_t &stats){
+  portENTER_CRITICAL(&m_statsMux);
+  stats = m_classStats;
+  portEXIT_CRITICAL(&m_statsMux);
+  for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++) {
+    stats.asyncQueues[lane].depth = m_lanes[lane].queue.depth();
+    stats.asyncQueues[lane].pending = m_lanes[lane].queue.count();
+  }
+  stats.syncQueue.depth = m_syncEventQueue.depth();
+  stats.syncQueue.pending = m_syncEventQueue.count();
+}
+
+void InterruptButton::resetClassStats(void){
+  portENTER_CRITICAL(&m_statsMux);
+  m_classStats = {};
+  portEXIT_CRITICAL(&m_statsMux);
+}
+
+void InterruptButton::getStats(buttonStats_t &stats){
+  portENTER_CRITICAL(&m_statsMux);
+  stats = m_stats;
+  portEXIT_CRITICAL(&m_statsMux);
+}
+
+void InterruptButton::resetStats(void){
+  portENTER_CRITICAL(&m_statsMux);
+  m_stats = {};
+  portEXIT_CRITICAL(&m_statsMux);
+}
+#endif
+
+
+#if IB_TRACE_COMPILED
+//-- TRACE (INTERRUPTBUTTON_TRACE builds only) -----------------------------------------------------------
+// Every edge, debounce sample, state transition, event and timer of every button goes into one ring buffer, a slot
+// claimed with a single atomic add and filled with one 8 byte store, so recording costs the ISR a few cycles.  A dump
+// (printTrace()) holds the settings of each gpio button too, enough for host/ibreplay to feed the same pin levels at the
+// same times through this code on a PC and report any event that comes out differently.
+
+static const char* const s_traceKinds[] = { "edge", "sample", "state", "event", "timer" };
+
+void InterruptButton::setTracing(bool enable){
+  m_tracing = enable;
+}
+
+void InterruptButton::clearTrace(void){
+  m_traceHead = 0;
+}
+
+uint16_t InterruptButton::getTrace(traceEntry_t* entries, uint16_t maxEntries){
+  uint32_t head = m_traceHead.load();
+  uint32_t count = (head < TRACE_DEPTH) ? head : TRACE_DEPTH;
+  if(count > maxEntries) count = maxEntries;
+  for(uint32_t idx = 0; idx < count; idx++) entries[idx] = m_trace[(head - count + idx) % TRACE_DEPTH];
+  return count;
+}
+
+// '# ...' comments, 'B <id> <pin> <pressedState> <engine> <adaptive> <pollUS> <targetPolls> <longMS> <repeatMS>
+// <doubleMS> <eventMask> <boundMask>' per gpio button (pollUS and targetPolls the button's own, as configured before
+// adaptive debounce retuned them; boundMask the events with an action at the current menu level), then
+// 'T <timeUS> <id> <kind> <a> <b>' per entry, oldest first.
+void InterruptButton::printTrace(void){
+  bool tracing = m_tracing;
+  m_tracing = false;                                          // Hold the buffer still while it is printed
+  uint32_t head = m_traceHead.load();
+  printf("# InterruptButton trace, %u entries, %u overwritten\n", static_cast<unsigned>((head < TRACE_DEPTH) ? head : TRACE_DEPTH),
+         static_cast<unsigned>((head > TRACE_DEPTH) ? head - TRACE_DEPTH : 0));
+  for(uint8_t pin = 0; pin < MAX_BUTTON_PINS; pin++) {
+    InterruptButton* btn = m_pinButtons[pin];
+    if(btn == nullptr) continue;
+    uint16_t bound = 0;
+    {
+      readerGuard reading(Reader_Sync);
+      for(uint8_t evt = 0; evt < NumEventTypes; evt++) if(btn->hasAction(m_menuLevel, static_cast<events>(evt))) bound |= IB_EVENT_BIT(evt);
+    }
+    printf("B %u %u %u %u %u %u %u %u %u %u 0x%04x 0x%04x\n", btn->m_traceId, pin, btn->m_pressedState, btn->m_debounceEngine,
+           btn->m_adaptive, btn->m_adaptive ? btn->m_basePollIntervalUS : btn->m_pollIntervalUS,
+           btn->m_adaptive ? btn->m_baseTargetPolls : btn->m_targetPolls,
+           btn->m_longKeyPressMS, btn->m_autoRepeatMS, btn->m_doubleClickMS, btn->eventMask.load(), bound);
+  }
+  uint32_t count = (head < TRACE_DEPTH) ? head : TRACE_DEPTH;
+  for(uint32_t idx = 0; idx < count; idx++) {
+    const traceEntry_t &entry = m_trace[(head - count + idx) % TRACE_DEPTH];
+    printf("T %u %u %s %u %u\n", static_cast<unsigned>(entry.timeUS), entry.button,
+           (entry.kind <= Trace_Timer) ? s_traceKinds[entry.kind] : "?", entry.a, entry.b);
+  }
+  m_tracing = tracing;
+}
+#endif
+
+
+//-- CHORDS (two or more buttons held together) ----------------------------------------------------------
+// Each debounced press/release updates a bitmask of held buttons, so matching a chord is a single mask compare.  A chord
+// fires once when its last member is pressed within the chord's window of its first, and suppresses the members'
+// keyPress, double-click and longPress/autoRepeat events for that press (their keyDown/keyUp events still occur).
+
+void IRAM_ATTR InterruptButton::updateChords(InterruptButton* btn, bool pressed){
+  if(static_cast<uint8_t>(btn->m_pin) >= MAX_BUTTON_PINS) return;
+  uint64_t pinBit = BIT64(btn->m_pin);
+  int8_t fired = -1;
+  int64_t firstEdgeUS = btn->m_pressEdgeUS;
+
+  portENTER_CRITICAL_SAFE(&m_chordMux);
+  if(pressed) {
+    m_pressedMask |= pinBit;
+    for(uint8_t c = 0; c < m_numChords && fired < 0; c++) {
+      const chord_t &chord = m_chords[c];
+      if(!(chord.mask & pinBit) || (m_pressedMask & chord.mask) != chord.mask || (m_chordsLatched & (1 << c))) continue;
+      firstEdgeUS = btn->m_pressEdgeUS;                         // This press completed the chord, check all were pressed together
+      for(uint64_t members = chord.mask; members; members &= members - 1) {
+        InterruptButton* member = m_pinButtons[__builtin_ctzll(members)];
+        if(member && member->m_pressEdgeUS < firstEdgeUS) firstEdgeUS = member->m_pressEdgeUS;
+      }
+      if(btn->m_pressEdgeUS - firstEdgeUS > chord.windowMS * 1000LL) continue;
+      m_chordsLatched |= (1 << c);
+      fired = c;
+    }
+  } else {
+    m_pressedMask &= ~pinBit;
+    for(uint8_t c = 0; c < m_numChords; c++) if(m_chords[c].mask & pinBit) m_chordsLatched &= ~(1 << c);
+  }
+  portEXIT_CRITICAL_SAFE(&m_chordMux);
+  if(fired < 0) return;
+
+  for(uint64_t members = m_chords[fired].mask; members; members &= members - 1) {
+    InterruptButton* member = m_pinButtons[__builtin_ctzll(members)];
+    if(member == nullptr) continue;
+    member->m_blockKeyPress = true;                             // Members don't also report their own keyPress/double-click
+    member->m_inChord = true;                                   // or press pattern
+    stopTimer(member->m_buttonLPandRepeatTimer);                // nor start long presses while the chord is held
+  }
+
+  buttonEvent_t evt;
+    evt.btn = btn;
+    evt.timeUS = esp_timer_get_time();
+    evt.durationUS = static_cast<uint32_t>(evt.timeUS - firstEdgeUS);
+    evt.event = Event_KeyDown;
+    evt.menuLevel = m_menuLevel;
+    evt.source = Source_Chord;
+    evt.id = fired;
+    evt.clicks = 0;
+    evt.longMask = 0;
+    evt.count = 1;
+    evt.delta = 0;
+  ButtonActions* table = m_chords[fired].actions.load(std::memory_order_acquire);
+  if(table == nullptr || !table->has(evt.menuLevel, IB_SINGLE_COLUMN)) return;
+  enqueue(evt, m_mode == Mode_Asynchronous);                    // Treated like keyPress, so synchronous in hybrid mode
+}
+
+int8_t InterruptButton::addChord(std::initializer_list<InterruptButton*> buttons, uint16_t windowMS){
+  if(m_numChords >= MAX_CHORDS) {
+    ESP_LOGE(TAG, "No room for another chord, increase MAX_CHORDS!");
+    return -1;
+  }
+  uint64_t mask = 0;
+  for(InterruptButton* btn : buttons) {
+    if(btn == nullptr || static_cast<uint8_t>(btn->m_pin) >= MAX_BUTTON_PINS) {
+      ESP_LOGE(TAG, "Chord members must be buttons on valid gpio's!");
+      return -1;
+    }
+    btn->initialiseInstance();                                  // Also fixes the number of menus
+    mask |= BIT64(btn->m_pin);
+  }
+  if(__builtin_popcountll(mask) < 2) {
+    ESP_LOGE(TAG, "A chord needs at least two different buttons!");
+    return -1;
+  }
+  chord_t &chord = m_chords[m_numChords];
+    chord.mask = mask;
+    chord.windowMS = windowMS;
+    chord.actions = nullptr;                                    // Until its first action is bound
+    chord.retired = nullptr;
+  return m_numChords++;                                         // Published last, so ISRs never see a half built chord
+}
+
+void InterruptButton::bindChord(uint8_t chord, uint8_t menuLevel, func_ptr_t action){
+  if(chord >= m_numChords) {
+    ESP_LOGE(TAG, "Specified chord does not exist!");
+  } else if(menuLevel >= m_numMenus) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+  } else {
+    ButtonActions::publishColumn(m_chords[chord].actions, m_chords[chord].retired, m_numMenus, menuLevel, action);
+  }
+}
+
+void InterruptButton::unbindChord(uint8_t chord, uint8_t menuLevel){
+  if(chord < m_numChords && menuLevel < m_numMenus && m_chords[chord].actions.load() != nullptr)
+    ButtonActions::publishColumn(m_chords[chord].actions, m_chords[chord].retired, m_numMenus, menuLevel, nullptr);
+}
+
+uint64_t InterruptButton::getPressedMask(void){
+  return m_pressedMask;
+}
+
+
+
+//-- CLASS MEMBERS AND METHODS SPECIFIC TO A SINGLE INSTANCE (BUTTON) ------------------------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+
+// Class object control and setup functions -------------------------------------
+// ------------------------------------------------------------------------------
+
+// Constructor ------------------------------------------------------------------
+InterruptButton::InterruptButton(uint8_t pin, uint8_t pressedState, gpio_mode_t pinMode,
+                                 uint16_t longKeyPressMS, uint16_t autoRepeatMS, 
+                                 uint16_t doubleClickMS,  uint32_t debounceUS) :
+                                 m_pressedState(pressedState),
+                                 m_pinMode(pinMode),
+                                 m_longKeyPressMS(longKeyPressMS),
+                                 m_autoRepeatMS(autoRepeatMS),
+                                 m_doubleClickMS(doubleClickMS) {
+
+  if (GPIO_IS_VALID_GPIO(pin))                  // Check for a valid pin first
+    m_pin = static_cast<gpio_num_t>(pin);
+  else {
+    ESP_LOGW(TAG, "%d is not valid gpio on this platform", pin);
+    m_pin = static_cast<gpio_num_t>(-1);        //GPIO_NUM_NC (enum not showing up as defined);
+  }
+  m_pollIntervalUS = (debounceUS / TARGET_POLLS > 65535) ? 65535 : debounceUS / TARGET_POLLS;
+  m_ownActions.m_published = 1;                 // Published from the start (m_actions)
+  m_ownActions.m_embedded = true;
+  IB_TRACE_ONLY(m_traceId = static_cast<uint8_t>(m_pin));
+}
+
+// Constructor for keys without a gpio of their own ------------------------------
+InterruptButton::InterruptButton(debounceEngines engine, uint32_t debounceUS) :
+                                 m_pin(static_cast<gpio_num_t>(-1)),
+                                 m_pressedState(1),                    // Owner feeds 1 while the key is closed
+                                 m_pinMode(GPIO_MODE_DISABLE),
+                                 m_debounceEngine(Debounce_External),
+                                 m_longKeyPressMS(750),
+                                 m_autoRepeatMS(250),
+                                 m_doubleClickMS(333) {
+  if(engine != Debounce_External) ESP_LOGW(TAG, "Keys without a gpio are always fed externally.");
+  m_pollIntervalUS = (debounceUS / TARGET_POLLS > 65535) ? 65535 : debounceUS / TARGET_POLLS;
+  m_ownActions.m_published = 1;
+  m_ownActions.m_embedded = true;
+  IB_TRACE_ONLY(m_traceId = m_nextTraceId; m_nextTraceId = (m_nextTraceId == 0xFF) ? MAX_BUTTON_PINS : m_nextTraceId + 1);
+}
+
+// Destructor --------------------------------------------------------------------
+InterruptButton::~InterruptButton() {
+  teardown();
+}
+
+// Detaches the button from its gpio, timers, queues and waiters, then frees its action tables once no reader is left in
+// them.  InterruptButtonT runs it first, before its table storage is destroyed; this destructor then finds it done.
+void InterruptButton::teardown(void) {
+  if(m_own == nullptr) return;
+  m_deleteInProgress = true;
+  if(m_debounceEngine != Debounce_External) gpio_isr_handler_remove(m_pin);
+  if(m_debounceEngine == Debounce_SharedScan) stopPolling(this);
+  if(m_thisButtonInitialised && static_cast<uint8_t>(m_pin) < MAX_BUTTON_PINS) {
+    m_pinButtons[m_pin] = nullptr;
+    m_pressedMask &= ~BIT64(m_pin);
+  }
+  auto forget = [this](buttonEvent_t &evt) { if(evt.btn == this) evt.btn = nullptr; };
+  for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++)      // Any events still queued for this button are skipped
+    m_lanes[lane].queue.forEach(forget);
+  m_syncEventQueue.forEach(forget);
+  portENTER_CRITICAL(&m_waitMux);                           // Waiters on this button alone are never resumed
+  for(eventWaiter_t* waiter = m_waiters; waiter != nullptr; waiter = waiter->next)
+    for(uint8_t idx = 0; idx < waiter->numButtons; idx++) if(waiter->buttons[idx] == this) waiter->buttons[idx] = nullptr;
+  portEXIT_CRITICAL(&m_waitMux);
+  killTimer(m_buttonPollTimer); killTimer(m_buttonLPandRepeatTimer); killTimer(m_buttonDoubleClickTimer);
+  killTimer(m_buttonStormTimer);
+  if(m_wakeupArmed) gpio_wakeup_disable(m_pin);
+  if(m_debounceEngine != Debounce_External) gpio_reset_pin(m_pin);
+
+  retireActions(m_actions.load());                          // Nothing resolves through it any more, an action from it may
+  m_own->m_next = m_idleTables;                             // still be running though, so the own tables are only freed
+  m_idleTables = m_own;                                     // (or emptied) once that has finished
+  m_own = nullptr;                                          // Torn down
+  awaitReaders();                                           // A dispatcher may have taken an event before it was forgotten
+  ButtonActions::freeRetired(m_idleTables, true);
+  if(m_poolSlot >= 0) {                                     // Pooled table goes back to the pool, emptied
+    for(uint16_t idx = 0; idx < m_numMenus * NumEventTypes; idx++) m_ownActions.m_actions[idx] = nullptr;
+    m_poolClaimed[m_poolSlot] = false;
+  }
+  if(m_thisButtonInitialised) m_liveButtons--;
+  m_deleteInProgress = false;
+}
+
+// Class initialiser, run by the first button (or RotaryEncoder) to initialise ----
+void InterruptButton::initialiseClass(void){
+  if(m_classInitialised) return;
+  if(m_numMenus == 0) m_numMenus = 1;         // Default to a single menu level if not set prior to initialising first button
+  esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);
+  if(err != ESP_OK) ESP_LOGD(TAG, "GPIO ISR service installed with exit status: %d", err);
+  m_classInitialised = setMode(m_mode) && (err == ESP_OK || err == ESP_ERR_INVALID_STATE);
+  if(m_poolButtons && m_actionPool == nullptr) {
+    m_actionPool = new func_ptr_t[m_poolButtons * m_numMenus * NumEventTypes];   // Value initialised, ie all unbound
+    m_poolClaimed = new bool[m_poolButtons]();
+  }
+}
+
+// Initialiser -------------------------------------------------------------------
+void InterruptButton::initialiseInstance(void){
+    if(m_thisButtonInitialised) return;
+
+    initialiseClass();
+
+    if(m_ownActions.m_actions == nullptr) {                 // Unless static storage was supplied (InterruptButtonT), take
+      for(uint16_t slot = 0; slot < m_poolButtons && m_poolSlot < 0; slot++) {    // a slot of the shared pool, or else
+        if(m_poolClaimed[slot]) continue;                                         // a table of its own
+        m_poolClaimed[slot] = true;
+        m_poolSlot = slot;
+        m_ownActions.attach(&m_actionPool[slot * m_numMenus * NumEventTypes], m_numMenus);
+      }
+      if(m_poolSlot < 0) m_ownActions.allocate(m_numMenus);
+    }
+    m_liveButtons++;
+    if(m_debounceEngine != Debounce_External)                                        // Timers are created once and re-armed
+      createTimer(m_buttonPollTimer, &readButton, this, "IB_poll");                   // from then on, so no heap use per edge.
+    if(m_supportedEvents & ((1 << Event_LongKeyPress) | (1 << Event_AutoRepeatPress)))  // Timers for unsupported events (or
+      createTimer(m_buttonLPandRepeatTimer, &longPressAndRepeatTimeout, this, "IB_lpRpt");  // polling of external keys) are
+    if(m_supportedEvents & ((1 << Event_DoubleClick) | (1 << Event_Pattern)))             // never made.
+      createTimer(m_buttonDoubleClickTimer, &doubleClickTimeout, this, "IB_dblClk");
+    if(m_debounceEngine != Debounce_External && m_stormMaxEdges)
+      createTimer(m_buttonStormTimer, &stormPoll, this, "IB_storm");
+
+    if(m_debounceEngine == Debounce_External) {             // No gpio, the owner feeds samples from its own scan
+      m_state = Released;
+      m_thisButtonInitialised = true;
+      return;
+    }
+
+    gpio_config_t gpio_conf = {};                           // Configure the interrupt associated with the pin
+      gpio_conf.mode = m_pinMode;
+      gpio_conf.pin_bit_mask = BIT64(static_cast<uint8_t>(m_pin));
+      gpio_conf.pull_down_en = (m_pressedState) ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
+      gpio_conf.pull_up_en =   (m_pressedState) ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE;
+      gpio_conf.intr_type = GPIO_INTR_ANYEDGE;
+    gpio_config(&gpio_conf);
+    if(static_cast<uint8_t>(m_pin) < MAX_BUTTON_PINS) {
+      portENTER_CRITICAL(&m_scanMux);
+      m_pinButtons[m_pin] = this;
+      if(m_pressedState) m_scanPressedLevels |= BIT64(m_pin);
+      else               m_scanPressedLevels &= ~BIT64(m_pin);
+      portEXIT_CRITICAL(&m_scanMux);
+    }
+    gpio_isr_handler_add(m_pin, InterruptButton::readButton, reinterpret_cast<void*>(this));
+    m_state = (gpio_get_level(m_pin) == m_pressedState) ? Pressed : Released;     // Set to current state when initialising
+    if(m_lowPowerMode) edgeInterrupt(true);                 // Released buttons wait on a wakeup interrupt
+    m_thisButtonInitialised = true;
+}
+
+
+//-- DEBOUNCE ENGINE SELECTION ---------------------------------------------------------------------------
+void InterruptButton::setDebounceEngine(debounceEngines engine){
+  if(engine == Debounce_External || m_debounceEngine == Debounce_External) {
+    ESP_LOGE(TAG, "Only keys without a gpio (eg MatrixKeypad keys) use Debounce_External, and they can't change engine!");
+    return;
+  }
+  if(m_state == ConfirmingPress || m_state == WaitingForRelease) {
+    ESP_LOGW(TAG, "Can't change debounce engine of gpio %d while it is being debounced!", m_pin);
+    return;
+  }
+  if(engine == Debounce_SharedScan) {
+    if(static_cast<uint8_t>(m_pin) >= MAX_BUTTON_PINS) {
+      ESP_LOGE(TAG, "gpio %d can't be read by the shared scan engine!", m_pin);
+      return;
+    }
+    if(m_scanTimer == nullptr) {
+      esp_timer_create_args_t tmrConfig = {};
+        tmrConfig.callback = &scanButtons;
+        tmrConfig.dispatch_method = ESP_TIMER_TASK;
+        tmrConfig.name = "IB_scan";
+      if(esp_timer_create(&tmrConfig, &m_scanTimer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create shared scan timer, keeping per-button polling.");
+        m_scanTimer = nullptr;
+        return;
+      }
+    }
+  }
+  m_debounceEngine = engine;                                // Takes effect from the next press or release
+}
+
+debounceEngines InterruptButton::getDebounceEngine(void) {
+  return m_debounceEngine;
+}
+
+void InterruptButton::setLane(uint8_t lane) {
+  if(lane >= DISPATCH_LANES) {
+    ESP_LOGE(TAG, "setLane(): Lane %d does not exist, DISPATCH_LANES is %d", lane, DISPATCH_LANES);
+    return;
+  }
+  useLane(lane);
+  m_lane = lane;
+}
+
+void InterruptButton::useLane(uint8_t lane) {
+  m_lanes[lane].used = true;
+  if(m_classInitialised && m_mode != Mode_Synchronous) startLane(lane);   // Otherwise started by setMode()
+}
+
+uint8_t InterruptButton::getLane(void) {
+  return m_lane;
+}
+
+
+//-- ADAPTIVE DEBOUNCE -----------------------------------------------------------------------------------
+// Instead of always taking m_targetPolls samples, a transition is decided as soon as the samples at the new level lead
+// the others by ADAPTIVE_DECISION_MARGIN and the button's learned bounce time has passed since the edge (a clean contact
+// confirms in about ADAPTIVE_MIN_BOUNCE_US).  The time from the edge to the last sample still at the old level is learned
+// per button (growing at once, shrinking slowly) and the poll interval and sample cap are retuned so a few samples
+// always span the bounce.  Shared scan buttons keep the class scan interval,
+// so only their sample cap adapts.  Noise lasting longer than the decision margin may be taken as a press, which is
+// the price of the lower latency; leave it disabled for buttons on noisy lines.
+
+void InterruptButton::setAdaptiveDebounce(bool enable){
+  if(m_state == ConfirmingPress || m_state == WaitingForRelease) {
+    ESP_LOGW(TAG, "Can't change debounce of gpio %d while it is being debounced!", m_pin);
+    return;
+  }
+  if(enable == m_adaptive) return;
+  if(enable) {
+    m_basePollIntervalUS = m_pollIntervalUS;
+    m_baseTargetPolls = m_targetPolls;
+    m_bounceUS = m_pollIntervalUS * m_targetPolls / 2;     // Start conservatively, from half the configured window
+  } else {
+    m_pollIntervalUS = m_basePollIntervalUS;
+    m_targetPolls = m_baseTargetPolls;
+  }
+  m_adaptive = enable;
+}
+
+bool InterruptButton::getAdaptiveDebounce(void) {
+  return m_adaptive;
+}
+
+uint32_t InterruptButton::getLearnedBounce(void) {
+  return m_bounceUS;
+}
+
+void IRAM_ATTR InterruptButton::adaptDebounce(void){
+  uint32_t windowUS = static_cast<uint32_t>(m_basePollIntervalUS) * m_baseTargetPolls;
+  if(m_settleUS > windowUS) return;                         // Noise while held rather than bounce, the configured window stays the limit
+  if(m_settleUS > m_bounceUS) m_bounceUS = m_settleUS;                         // Longer bounce, adapt at once to stay safe
+  else                        m_bounceUS = (7 * m_bounceUS + m_settleUS) / 8;  // Cleaner contact, trust it gradually
+  if(m_bounceUS < ADAPTIVE_MIN_BOUNCE_US) m_bounceUS = ADAPTIVE_MIN_BOUNCE_US;
+
+  uint32_t intervalUS = m_bounceUS / 4;                     // Four samples across the bounce, within limits
+  if(intervalUS < ADAPTIVE_MIN_POLL_US)              intervalUS = ADAPTIVE_MIN_POLL_US;
+  if(intervalUS > 4UL * m_basePollIntervalUS)        intervalUS = 4UL * m_basePollIntervalUS;
+  if(intervalUS > 65535)                             intervalUS = 65535;
+  uint32_t polls = (2 * m_bounceUS) / intervalUS + ADAPTIVE_DECISION_MARGIN;  // Cap covers twice the bounce if undecided
+  if(polls < 2 * ADAPTIVE_DECISION_MARGIN) polls = 2 * ADAPTIVE_DECISION_MARGIN;
+  if(polls > 255)                          polls = 255;
+  m_pollIntervalUS = intervalUS;
+  m_targetPolls = polls;
+}
+
+
+// Static storage and compile-time settings from InterruptButtonT --------------
+void InterruptButton::useStaticStorage(func_ptr_t* actions, ButtonActions* spare, uint8_t menus, uint8_t targetPolls,
+                                       uint16_t pollIntervalUS, uint16_t supportedEvents){
+  m_ownActions.attach(actions, menus);
+  spare->m_embedded = true;                                 // Always idle, so bind() never needs a heap copy of its own
+  m_idleTables = spare;
+  setPolling(targetPolls, pollIntervalUS);
+  m_supportedEvents = supportedEvents | (1 << Event_All);
+  eventMask &= m_supportedEvents;
+}
+
+
+void InterruptButton::setPolling(uint8_t targetPolls, uint16_t pollIntervalUS){
+  m_targetPolls = targetPolls ? targetPolls : 1;
+  m_pollIntervalUS = pollIntervalUS;
+}
+
+
+//-- TIMING INTERVAL GETTERS AND SETTERS -----------------------------------------------------------------
+void      InterruptButton::setLongPressInterval(uint16_t intervalMS)    { m_longKeyPressMS = intervalMS; }
+uint16_t  InterruptButton::getLongPressInterval(void)                   { return m_longKeyPressMS;       }
+void      InterruptButton::setAutoRepeatInterval(uint16_t intervalMS)   { m_autoRepeatMS = intervalMS;   }
+uint16_t  InterruptButton::getAutoRepeatInterval(void)                  { return m_autoRepeatMS;         }
+void      InterruptButton::setDoubleClickInterval(uint16_t intervalMS)  { m_doubleClickMS = intervalMS;  }
+uint16_t  InterruptButton::getDoubleClickInterval(void)                 { return m_doubleClickMS;        }
+
+
+// -- FUNCTIONS RELATED TO EXTERNAL ACTIONS --------------------------------------------------------------
+// -------------------------------------------------------------------------------------------------------
+void InterruptButton::bind(events event, uint8_t menuLevel, func_ptr_t action){
+  if(!m_thisButtonInitialised) initialiseInstance();    // Auto initialisation (typical begin() function)
+
+  if(menuLevel >= m_own->m_menus) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+  } else if(event >= NumEventTypes || !(m_supportedEvents & (1 << event))) {
+    ESP_LOGE(TAG, "Specified event is invalid!");
+  } else {
+    ButtonActions* table = editableActions();
+    table->at(menuLevel, event) = action;               // Bind external action to button
+    adoptActions(table);
+    if(!eventEnabled(event)) enableEvent(event);        // Assume if we are binding it, we want it enabled.
+    if(getActions() != nullptr) ESP_LOGW(TAG, "bind(): A ButtonActions table is published, this takes effect once it is withdrawn");
+  }
+}
+
+void InterruptButton::unbind(events event, uint8_t menuLevel){
+  if(m_own->m_menus == 0){
+    ESP_LOGE(TAG, "You must have bound at least one function prior to unbinding it from a button!");
+  } else if(menuLevel >= m_own->m_menus) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+  } else if(event >= NumEventTypes) {
+    ESP_LOGE(TAG, "Specified event is invalid!");
+  } else if(m_own->at(menuLevel, event) != nullptr) {
+    ButtonActions* table = editableActions();
+    table->at(menuLevel, event) = nullptr;
+    adoptActions(table);
+  }
+  return;
+}
+
+// The own table is read-only while published or while an action from it may still be running, just like any other
+// table.  A change is then made in an idle copy instead: an earlier own table no reader is left in (InterruptButtonT
+// always has one), or else a new heap table.
+ButtonActions* InterruptButton::editableActions(void){
+  if(!m_own->inUse()) return m_own;
+  ButtonActions* table = takeIdleTable(false);
+  if(table == nullptr) {
+    table = new ButtonActions();
+    table->allocate(m_own->m_menus);
+  }
+  table->copyFrom(m_own);
+  return table;
+}
+
+ButtonActions* InterruptButton::takeIdleTable(bool embeddedOnly){
+  for(ButtonActions** link = &m_idleTables; *link != nullptr; link = &(*link)->m_next) {
+    ButtonActions* table = *link;
+    if(table->inUse() || (embeddedOnly && !table->m_embedded)) continue;
+    *link = table->m_next;
+    table->m_next = nullptr;
+    return table;
+  }
+  return nullptr;
+}
+
+// The copy replaces the own table in one atomic swap, and the old one waits in the idle list until no reader can be
+// in it.  Heap copies left idle are freed, the embedded tables are kept for the next change.  A heap copy moves back
+// into an embedded table as soon as one is idle (at once unless an action is running), so a button in the shared pool
+// or an InterruptButtonT keeps no heap table.
+void InterruptButton::adoptActions(ButtonActions* table){
+  ButtonActions* previous = m_own;
+  if(table == previous) return;
+  m_own = table;
+  if(m_actions.load() == previous) {
+    table->m_published++;
+    m_actions.exchange(table, std::memory_order_acq_rel);
+    retireActions(previous);
+  }
+  previous->m_next = m_idleTables;
+  m_idleTables = previous;
+  for(ButtonActions** link = &m_idleTables; *link != nullptr;) {
+    ButtonActions* idle = *link;
+    if(idle->m_embedded || idle->inUse()) {
+      link = &idle->m_next;
+    } else {
+      *link = idle->m_next;
+      delete idle;
+    }
+  }
+  ButtonActions* home = table->m_embedded ? nullptr : takeIdleTable(true);
+  if(home != nullptr) {
+    home->copyFrom(table);
+    adoptActions(home);
+  }
+}
+
+// Publish a prebuilt table in one atomic swap.  Events with an action in the new table are enabled, as bind() would.
+ButtonActions* InterruptButton::setActions(ButtonActions* table){
+  if(!m_thisButtonInitialised) initialiseInstance();
+  if(table != nullptr) {
+    for(uint8_t menu = 0; menu < table->m_menus; menu++)
+      for(uint8_t evt = 0; evt < NumEventTypes; evt++)
+        if(table->has(menu, static_cast<events>(evt))) enableEvent(static_cast<events>(evt));
+  } else {
+    table = m_own;                                      // Back to the own table
+  }
+  table->m_published++;
+  ButtonActions* previous = m_actions.exchange(table);
+  retireActions(previous);
+  return (previous == m_own) ? nullptr : previous;
+}
+
+ButtonActions* InterruptButton::getActions(void){
+  ButtonActions* table = m_actions.load();
+  return (table == m_own) ? nullptr : table;
+}
+
+// Once no button publishes a table, note each reader context so inUse() can tell when every reader that might have
+// loaded the old pointer has finished (RCU grace period).
+void InterruptButton::retireActions(ButtonActions* table){
+  if(--table->m_published != 0) return;
+  for(uint8_t slot = 0; slot < IB_READER_SLOTS; slot++) table->m_retiredAt[slot] = m_readers[slot].load();
+}
+
+// Grace period for an owner about to free something readers reach other than through a table (a deleted encoder or
+// button), with the same slot test as ButtonActions::inUse() and the same limit as ButtonActions::awaitIdle().
+bool InterruptButton::awaitReaders(void){
+  uint32_t then[IB_READER_SLOTS];
+  for(uint8_t slot = 0; slot < IB_READER_SLOTS; slot++) then[slot] = m_readers[slot].load();
+  for(uint16_t tries = 0; ; tries++) {
+    bool reading = false;
+    for(uint8_t slot = 0; slot < IB_READER_SLOTS; slot++)
+      reading |= (then[slot] & 0xFF) != 0 && (m_readers[slot].load() >> 8) == (then[slot] >> 8);
+    if(!reading) return true;
+    if(tries >= 1000) break;
+    vTaskDelay(1);
+  }
+  ESP_LOGE(TAG, "Deleted while a reader may still hold it (from inside one of its own actions?)");
+  return false;
+}
+
+void InterruptButton::enableEvent(events event){
+  if(event <= Event_All && event != NumEventTypes) eventMask |= (1UL << (event)) & m_supportedEvents;  // Set the relevant bit
+}
+void InterruptButton::disableEvent(events event){
+  if(event <= Event_All && event != NumEventTypes) eventMask &= ~(1UL << (event));   // Clear the relevant bit
+}
+bool InterruptButton::eventEnabled(events event) {
+  return ((eventMask >> event) & 0x01) == 0x01;
+}
+
+void InterruptButton::setMenuCount(uint8_t numberOfMenus){           // This can only be set before initialising first button
+  if(!m_classInitialised && numberOfMenus >= 1) m_numMenus = numberOfMenus;
+}
+uint8_t InterruptButton::getMenuCount(void) {
+  return m_numMenus;
+}
+
+// One allocation holds the actions of the first 'buttons' buttons to initialise, contiguous by [button][menu][event],
+// instead of a heap block per button.  Slots of deleted buttons are reused; buttons beyond the pool get their own table.
+bool InterruptButton::setActionPool(uint16_t buttons){
+  if(m_classInitialised) {
+    ESP_LOGE(TAG, "setActionPool(): The action pool must be sized before the first button is initialised!");
+    return false;
+  }
+  m_poolButtons = buttons;
+  return true;
+}
+
+void InterruptButton::getMemoryFootprint(memoryFootprint_t &footprint){
+  footprint = {};
+  footprint.buttons = m_liveButtons;
+  footprint.callbackBytes = sizeof(func_ptr_t);
+  footprint.buttonBytes = m_liveButtons * sizeof(InterruptButton);
+  if(m_actionPool) {
+    footprint.poolBytes = m_poolButtons * (m_numMenus * NumEventTypes * sizeof(func_ptr_t) + sizeof(bool));
+    footprint.poolCapacity = m_poolButtons;
+    for(uint16_t slot = 0; slot < m_poolButtons; slot++) footprint.pooledButtons += m_poolClaimed[slot];
+  }
+  footprint.heapActionBytes = m_heapActionBytes;
+  footprint.chordBytes = m_numChords * m_numMenus * sizeof(func_ptr_t);
+  footprint.staticBytes = sizeof(m_lanes) + sizeof(m_syncEventQueue) + sizeof(m_chords) + sizeof(m_patternStates) +
+                          sizeof(m_pinButtons) + sizeof(m_readers) + sizeof(m_encoders);
+}
+
+void InterruptButton::setMenuLevel(uint8_t level) {
+  if(level < m_numMenus) {
+    m_menuLevel = level;
+  } else {
+    ESP_LOGE(TAG, "Menu level '%d' must be >= 0 AND < number of menus (zero origin): ", level);
+  }
+}
+
+uint8_t InterruptButton::getMenuLevel(){
+  return m_menuLevel;
+}
+
+
+//-- BUTTON ACTION TABLES --------------------------------------------------------------------------------
+ButtonActions::ButtonActions(uint8_t menus) {
+  allocate(menus ? menus : 1);
+}
+
+ButtonActions::~ButtonActions() {
+  if(inUse()) ESP_LOGE(TAG, "A ButtonActions table was deleted while still published or in use!");
+  if(m_ownsActions) {
+    delete [] m_actions;
+    InterruptButton::m_heapActionBytes -= m_menus * m_columns * sizeof(func_ptr_t);
+  }
+}
+
+void ButtonActions::allocate(uint8_t menus, uint8_t columns) {
+  m_actions = new func_ptr_t[menus * columns];            // One block for every menu level, value initialised (all unbound)
+  m_menus = menus;
+  m_columns = columns;
+  m_ownsActions = true;
+  InterruptButton::m_heapActionBytes += menus * columns * sizeof(func_ptr_t);
+}
+
+void ButtonActions::attach(func_ptr_t* actions, uint8_t menus) {
+  m_actions = actions;
+  m_menus = menus;
+  m_ownsActions = false;
+}
+
+void ButtonActions::copyFrom(const ButtonActions* other) {
+  for(uint16_t idx = 0; idx < m_menus * m_columns; idx++) m_actions[idx] = other->m_actions[idx];
+}
+
+// An owner freeing its tables (a deleted button or encoder) cannot leave it to a later change, so it gives the readers
+// up to a thousand ticks.  A reader that never finishes is usually the caller itself, deleting from inside an action.
+bool ButtonActions::awaitIdle(void) {
+  for(uint16_t tries = 0; inUse(); tries++) {
+    if(tries >= 1000) return false;
+    vTaskDelay(1);
+  }
+  return true;
+}
+
+// The published table is read-only (the ISRs and the dispatchers may be reading it), so the change is made in a copy and
+// swapped in, and the old table is kept until every reader that might have loaded it has finished.
+void ButtonActions::publishColumn(std::atomic<ButtonActions*> &published, ButtonActions* &retired, uint8_t menus,
+                                  uint8_t menuLevel, func_ptr_t action) {
+  ButtonActions* table = new ButtonActions();
+  table->allocate(menus, 1);
+  ButtonActions* previous = published.load(std::memory_order_acquire);
+  if(previous != nullptr) table->copyFrom(previous);
+  table->at(menuLevel, IB_SINGLE_COLUMN) = action;
+  table->m_published = 1;
+  previous = published.exchange(table, std::memory_order_acq_rel);
+  if(previous != nullptr) {
+    InterruptButton::retireActions(previous);
+    previous->m_next = retired;
+    retired = previous;
+  }
+  freeRetired(retired, false);
+}
+
+void ButtonActions::freeRetired(ButtonActions* &retired, bool wait) {
+  ButtonActions** link = &retired;
+  while(*link != nullptr) {
+    ButtonActions* table = *link;
+    if((wait && !table->awaitIdle()) || table->inUse()) {
+      if(wait) ESP_LOGE(TAG, "An action table is still in use, it is leaked instead of freed!");
+      link = &table->m_next;                                // An action from it may still be running
+      continue;
+    }
+    *link = table->m_next;
+    table->m_next = nullptr;
+    if(!table->m_embedded) delete table;
+  }
+}
+
+bool ButtonActions::bind(events event, uint8_t menuLevel, func_ptr_t action) {
+  if(m_published != 0) {
+    ESP_LOGE(TAG, "A published ButtonActions table is read-only, build the change in another table and publish that!");
+  } else if(menuLevel >= m_menus) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+  } else if(event >= NumEventTypes) {
+    ESP_LOGE(TAG, "Specified event is invalid!");
+  } else {
+    at(menuLevel, event) = action;
+    return true;
+  }
+  return false;
+}
+
+bool ButtonActions::unbind(events event, uint8_t menuLevel) {
+  return bind(event, menuLevel, nullptr);
+}
+
+// A reader slot holds the context's nesting depth in its low byte and a generation above it, bumped whenever the depth
+// returns to zero.  A reader active when the table was withdrawn has finished once its slot's generation has moved on.
+bool ButtonActions::inUse(void) {
+  if(m_published != 0) return true;
+  for(uint8_t slot = 0; slot < IB_READER_SLOTS; slot++) {
+    uint32_t then = m_retiredAt[slot];
+    if((then & 0xFF) != 0 && (InterruptButton::m_readers[slot].load() >> 8) == (then >> 8)) return true;
+  }
+  return false;
+}
@@ -1,155 +1,800 @@
-// New in version 2.0.1
-// Moved RTOS task servicer to Core 1
-// Blocked doubleclicks and key presses in the event of an autokeypress event.
-
-#ifndef INTERRUPTBUTTON_H_
-#define INTERRUPTBUTTON_H_
-
-
-#include "driver/gpio.h"
-#include "esp_timer.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/queue.h"
-#include <functional>
-
-#define ASYNC_EVENT_QUEUE_DEPTH   5     // This queue is serviced very quickly so can be short
-#define SYNC_EVENT_QUEUE_DEPTH    10    // This queue is limited to mainloop frequency so actions can backup
-#define TARGET_POLLS              10    // Number of times to poll a button to determine it's state
-
-
-typedef std::function<void()> func_ptr_t; // Typedef to faciliate managing pointers to external action functions
-
-enum modes {
-  Mode_Asynchronous,                    // All actions performed via Asynchronous RTOS queue
-  Mode_Hybrid,                          // keyUp and keyDown performed by RTOS queue, remaining actions by Static Synchronous Queue.
-  Mode_Synchronous                      // All actions performed by Synchronous Queue (static class member array, FIFO).
-};
-
-enum events:uint8_t {
-  Event_KeyDown = 0,
-  Event_KeyUp,
-  Event_KeyPress,
-  Event_LongKeyPress,
-  Event_AutoRepeatPress,
-  Event_DoubleClick,
-  NumEventTypes,                        // Not an event, but this value used to size the number of columns in event/action array.
-  Event_All                             // Used to enable or disable all events
-};
-
-
-// -- Interrupt Button and Debouncer ---------------------------------------------------------------------------------------
-// -- ----------------------------------------------------------------------------------------------------------------------
-class InterruptButton {
-  private:
-    enum buttonStates {                 // Enumeration to assist with program flow at state machine for reading button
-      Released,
-      ConfirmingPress,
-      Pressing,
-      Pressed,
-      WaitingForRelease,
-      Releasing
-    };
-
-    // STATIC class members shared by all instances of this object (common across all instances of the class)
-    // ------------------------------------------------------------------------------------------------------
-    static void asyncQueueServicer(void* pvParams);                   // Function used as RTOS task to receive and process action from RTOS message queue.
-    static void readButton(void* arg);                                // function to read button state (must be static to bind to GPIO and timer ISR)
-    static void longPressEvent(void *arg);                            // Callback to excecute a longPress event, called by timer
-    static void autoRepeatPressEvent(void *arg);                      // Callback to excecute a autoRepeatPress event, called by timer
-    static void doubleClickTimeout(void *arg);                        // Callback used to separate double-clicks from regular keyPress's, called by timer
-    static void startTimer(esp_timer_handle_t &timer,                 // Helper func to start timer.
-                           uint32_t duration_US,
-                           void (*callBack)(void* arg),
-                           InterruptButton* btn,
-                           const char *msg);
-    static void killTimer(esp_timer_handle_t &timer);                 // Helper function to kill a timer
-
-    static void action(InterruptButton  *btn,                         // Helper function to simplify calling actions at specified menulevel
-                       events           event,
-                       uint8_t          menuLevel);
-    inline static void action(InterruptButton* btn, events event) { action(btn, event, m_menuLevel); };
-
-    static bool           m_classInitialised;                         // Boolean flag to control class initialisation
-    static bool           m_firstButtonInitialised;                   // Used to block any further changes to m_numMenus
-    static TaskHandle_t   m_asyncQueueServicerHandle;                 // Pointer/handle to the RTOS task that actions the RTOS Queue messages
-    static func_ptr_t     m_asyncEventQueue[];                        // Array used as the Static Synchronous Event Queue
-    static func_ptr_t     m_syncEventQueue[];                         // Array used as the Static Synchronous Event Queue
-
-    static uint8_t        m_numMenus;                                 // Total number of menu sets, can be set by user, but only before initialising first button
-    static uint8_t        m_menuLevel;                                // Current menulevel for all buttons (global in class so common across all buttons)
-    static modes          m_mode;
-    static bool           m_deleteInProgress;                         // Precautionary blocker to prevent asyc calls of object methods while they are being deleted
-
-    // Non-static instance specific member declarations
-    // ------------------------------------------------
-    void                  initialiseInstance(void);                   // Setup interrupts and event-action array
-    bool                  m_thisButtonInitialised = false;            // Allows us to intialise when binding functions (ie detect if already done)
-    gpio_num_t            m_pin;                                      // Button gpio
-    uint8_t               m_pressedState;                             // State of button when it is pressed (LOW or HIGH)
-    gpio_mode_t           m_pinMode;                                  // GPIO mode: IDF's input/output mode
-    volatile buttonStates m_state;                                    // Instance specific state machine variable (intialised when intialising button)
-    volatile bool         m_wtgForDblClick = false;
-    esp_timer_handle_t    m_buttonPollTimer = nullptr;                // Instance specific timer for button debouncing
-    esp_timer_handle_t    m_buttonLPandRepeatTimer = nullptr;         // Instance specific timer for button longPress and autoRepeat timing
-    esp_timer_handle_t    m_buttonDoubleClickTimer = nullptr;         // Instance specific timer for discerning double-clicks from regular keyPresses
-
-    volatile uint8_t      m_doubleClickMenuLevel;                     // Stores current menulevel while differentiating between regular keyPress or a double-click
-    uint16_t              m_pollIntervalUS;                           // Timing variables
-    uint16_t              m_longKeyPressMS;
-    uint16_t              m_autoRepeatMS;
-    uint16_t              m_doubleClickMS;
-
-    volatile bool         m_blockKeyPress;                            // Boolean flag to prevent firing a keypress if a longPress or AutoRepeatPress occurred (outside of polling fuction)
-    volatile uint16_t     m_validPolls = 0;                           // Variables to conduct debouncing algoritm
-    volatile uint16_t     m_totalPolls = 0;
-
-    func_ptr_t**          eventActions = nullptr;                     // Pointer to 2D array, event actions by row, menu levels by column.
-    uint16_t              eventMask = 0b0000010000111;                // Default to keyUp, keyDown, and keyPress enabled, and no blanket disable
-                                                                      // When binding functions, longKeyPress, autoKeyPresses, & double-clicks are automatically enabled.
-
-  public:
-    // Static class members shared by all instances of this object -----------------------
-    static bool     setMode(modes mode);                              // Toggle between Synchronous (Static Queue), Hybrid, or Asynchronous modes (RTOS Queue)
-    static modes    getMode(void);
-    static void     processSyncEvents(void);                          // Process Sync Events, called from main looop
-    static void     setMenuCount(uint8_t numberOfMenus);              // Sets number of menus/pages that each button has (can only be done before intialising first button)
-    static uint8_t  getMenuCount(void);                               // Retrieves total number of menus.
-    static void     setMenuLevel(uint8_t level);                      // Sets menu level across all buttons (ie buttons mean something different each page)
-    static uint8_t  getMenuLevel();                                   // Retrieves menu level
-    static uint32_t m_RTOSservicerStackDepth;                         // Allows the user to set the depth of RTOS servicer function (for bound functions)
-                                                                      // Must be set before initialsing/binding first button or calling setMode().
-
-    // Non-static instance specific member declarations ----------------------------------
-    InterruptButton(uint8_t pin,                                      // Class Constructor, pin to monitor
-                    uint8_t pressedState,                             // State of the pin when pressed (HIGH or LOW)
-                    gpio_mode_t pinMode = GPIO_MODE_INPUT,
-                    uint16_t longKeyPressMS = 750,
-                    uint16_t autoRepeatMS =   250,
-                    uint16_t doubleClickMS =  333,
-                    uint32_t debounceUS =     8000);
-    ~InterruptButton();                                               // Class Destructor
-
-    void            enableEvent(events event);                        // Enable the event passed as argument (updates bitmask)
-    void            disableEvent(events event);                       // Disable the event passed as argument (updates bitmask)
-    bool            eventEnabled(events event);                       // Read bitmask and determine if event is enabled
-    void            setLongPressInterval(uint16_t intervalMS);        // Updates LongPress Interval
-    uint16_t        getLongPressInterval(void);
-    void            setAutoRepeatInterval(uint16_t intervalMS);       // Updates autoRepeat Interval
-    uint16_t        getAutoRepeatInterval(void);
-    void            setDoubleClickInterval(uint16_t intervalMS);      // Updates autoRepeat Interval
-    uint16_t        getDoubleClickInterval(void);
-
-
-    // Routines to manage interface with external action functions associated with each event ---
-    void            bind(events     event,                                  // Used to bind an action to an event at a given menulevel
-                         uint8_t    menuLevel,
-                         func_ptr_t action);
-    inline void     bind(events event, func_ptr_t action) { bind(event, m_menuLevel, action); } // Above function defaulting to current menulevel
-
-    void            unbind(events   event,                                  // Used to unbind an action to an event at a given menulevel
-                           uint8_t  menuLevel);
-    inline void     unbind(events event) { unbind(event, m_menuLevel); };   // Above function defaulting to current menulevel
-};
-
-#endif // INTERRUPTBUTTON_H_
+// New in version 2.0.1
+// Moved RTOS task servicer to Core 1
+// Blocked doubleclicks and key presses in the event of an autokeypress event.
+
+#ifndef INTERRUPTBUTTON_H_
+#define INTERRUPTBUTTON_H_
+
+
+#include "InterruptButtonHAL.h"
+#include "InterruptButtonQueue.h"
+#include <functional>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+
+#ifndef ASYNC_EVENT_QUEUE_DEPTH
+#define ASYNC_EVENT_QUEUE_DEPTH   5     // This queue is serviced very quickly so can be short (can be overridden by build flag)
+#endif
+#ifndef SYNC_EVENT_QUEUE_DEPTH
+#define SYNC_EVENT_QUEUE_DEPTH    10    // This queue is limited to mainloop frequency so actions can backup (can be overridden by build flag)
+#endif
+#ifndef DISPATCH_LANES
+#define DISPATCH_LANES            2     // Async dispatch lanes, each with its own queue and RTOS task (can be overridden by build flag)
+#endif
+#define TARGET_POLLS              10    // Default number of times to poll a button to determine it's state
+#define ADAPTIVE_DECISION_MARGIN  3     // Adaptive debounce decides once samples at the new level outnumber the others by this
+#define ADAPTIVE_MIN_POLL_US      250   // Shortest poll interval adaptive debounce will tune a button down to
+#define ADAPTIVE_MIN_BOUNCE_US    1000  // Adaptive debounce never decides sooner than this after an edge
+#define MAX_BUTTON_PINS           64    // Number of gpio's covered by pin bitmasks (scan engine, chords), width of the input register
+#define MAX_CHORDS                8     // Maximum number of registered chords (buttons held together)
+#define MAX_ENCODERS              4     // Maximum number of begun rotary encoders (see RotaryEncoder.h)
+#define MAX_PATTERN_STATES        32    // Nodes of the shared press pattern table (one per distinct prefix of the registered patterns)
+#define PATTERN_MAX_PRESSES       8     // Longest press pattern (and most clicks counted by Event_Pattern)
+#ifndef STORM_MAX_EDGES
+#define STORM_MAX_EDGES           0     // Default edge limit per window before a button's interrupt is disabled, 0 = off (can be overridden by build flag)
+#endif
+#define STORM_WINDOW_MS           1000  // Default window the edges are counted over
+#define STORM_POLL_MS             20    // Sample period of a button whose interrupt was disabled by an edge storm
+#define STORM_QUIET_MS            500   // Storm ends (interrupt re-armed) once the sampled level has been steady this long
+#ifndef AWAIT_MAX_BUTTONS
+#define AWAIT_MAX_BUTTONS         4     // Most buttons one co_await can wait on at once (can be overridden by build flag)
+#endif
+#ifndef IB_CALLBACK_WORDS
+#define IB_CALLBACK_WORDS         2     // Pointer sized words a bound lambda may capture (can be overridden by build flag)
+#endif
+
+
+// -- Button Callback ------------------------------------------------------------------------------------------------------
+// Compact action type, opt in with the INTERRUPTBUTTON_COMPACT_CALLBACK build flag (actions are std::function otherwise):
+// a function pointer, or a lambda capturing at most IB_CALLBACK_WORDS pointers (eg [this] or [obj, id]), held inline with
+// no heap fallback.  Captures must be trivially copyable, so the whole callback is copied as plain bytes, anything bigger
+// (a std::function, a std::string or shared_ptr capture) is rejected at compile time.  A function taking a context
+// pointer binds through ButtonCallback(fn, ctx).
+// -- ----------------------------------------------------------------------------------------------------------------------
+template <class Signature> class CompactCallback;
+
+template <class... Args>
+class CompactCallback<void(Args...)> {
+  private:
+    typedef void (*invoker_t)(const void* store, Args... args);
+    invoker_t             m_invoke = nullptr;
+    alignas(void*) unsigned char m_store[IB_CALLBACK_WORDS * sizeof(void*)] = {};
+
+    template <class F>
+    static void invoke(const void* store, Args... args) { (*static_cast<const F*>(store))(args...); }
+
+  public:
+    CompactCallback() {}
+    CompactCallback(std::nullptr_t) {}
+    template <class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, CompactCallback>::value &&
+                                                       !std::is_same<typename std::decay<F>::type, std::nullptr_t>::value>::type>
+    CompactCallback(F action) {
+      static_assert(sizeof(F) <= sizeof(m_store), "Action captures too much, raise IB_CALLBACK_WORDS or capture a pointer");
+      static_assert(alignof(F) <= alignof(void*), "Action capture is over-aligned");
+      static_assert(std::is_trivially_copyable<F>::value && std::is_trivially_destructible<F>::value,
+                    "Action captures must be trivially copyable (pointers and numbers), capture a pointer instead");
+      new (m_store) F(action);
+      m_invoke = &invoke<F>;
+    }
+    CompactCallback(void (*fn)(void* ctx, Args... args), void* ctx) :  // Plain function with a context pointer
+      CompactCallback([fn, ctx](Args... args) { fn(ctx, args...); }) {}
+
+    inline void operator()(Args... args) const { m_invoke(m_store, args...); }
+    inline explicit operator bool(void) const { return m_invoke != nullptr; }
+    inline bool operator==(std::nullptr_t) const { return m_invoke == nullptr; }
+    inline bool operator!=(std::nullptr_t) const { return m_invoke != nullptr; }
+};
+typedef CompactCallback<void()> ButtonCallback;
+
+#ifdef INTERRUPTBUTTON_COMPACT_CALLBACK
+typedef ButtonCallback func_ptr_t;        // Typedef to faciliate managing pointers to external action functions
+#else
+typedef std::function<void()> func_ptr_t; // Typedef to faciliate managing pointers to external action functions
+#endif
+
+// Build flags to compile whole features out of the state machine (all buttons), eg -DINTERRUPTBUTTON_NO_DOUBLECLICK
+#ifdef INTERRUPTBUTTON_NO_LONGPRESS
+#define IB_LONGPRESS_COMPILED     0
+#else
+#define IB_LONGPRESS_COMPILED     1
+#endif
+#ifdef INTERRUPTBUTTON_NO_AUTOREPEAT
+#define IB_AUTOREPEAT_COMPILED    0
+#else
+#define IB_AUTOREPEAT_COMPILED    1
+#endif
+#ifdef INTERRUPTBUTTON_NO_DOUBLECLICK
+#define IB_DOUBLECLICK_COMPILED   0
+#else
+#define IB_DOUBLECLICK_COMPILED   1
+#endif
+#ifdef INTERRUPTBUTTON_NO_PATTERNS
+#define IB_PATTERN_COMPILED       0
+#else
+#define IB_PATTERN_COMPILED       1
+#endif
+
+// Build flag to compile in counters and timing histograms, -DINTERRUPTBUTTON_STATS (see getClassStats() and getStats())
+#ifdef INTERRUPTBUTTON_STATS
+#define IB_STATS_COMPILED         1
+#define IB_STATS_ONLY(...)        __VA_ARGS__
+#else
+#define IB_STATS_COMPILED         0
+#define IB_STATS_ONLY(...)
+#endif
+
+// Build flag to compile in the edge trace recorder, -DINTERRUPTBUTTON_TRACE (see getTrace() and printTrace())
+#ifdef INTERRUPTBUTTON_TRACE
+#define IB_TRACE_COMPILED         1
+#define IB_TRACE_ONLY(...)        __VA_ARGS__
+#else
+#define IB_TRACE_COMPILED         0
+#define IB_TRACE_ONLY(...)
+#endif
+#ifndef TRACE_DEPTH
+#define TRACE_DEPTH               512   // Entries in the trace ring buffer, a power of 2 (8 bytes each, can be overridden by build flag)
+#endif
+
+enum modes {
+  Mode_Asynchronous,                    // All actions performed via Asynchronous RTOS queue
+  Mode_Hybrid,                          // keyUp and keyDown performed by RTOS queue, remaining actions by Static Synchronous Queue.
+  Mode_Synchronous                      // All actions performed by Synchronous Queue (static class member array, FIFO).
+};
+
+enum debounceEngines {
+  Debounce_PerButtonTimer,              // Each button samples its own pin with its own poll timer (default)
+  Debounce_SharedScan,                  // One class-level timer samples all polling buttons from a single GPIO register read
+  Debounce_EdgeTimestamp,               // Interrupt stays armed and every edge restarts one quiet timer, decided once the line is quiet
+  Debounce_External                     // Key without a gpio of its own, edges and samples are fed by its owner (MatrixKeypad, AnalogButtons)
+};
+
+enum events:uint8_t {
+  Event_KeyDown = 0,
+  Event_KeyUp,
+  Event_KeyPress,
+  Event_LongKeyPress,
+  Event_AutoRepeatPress,
+  Event_DoubleClick,
+  Event_Pattern,                        // Multi-click or short/long press sequence, once doubleClickMS passes after its last release
+  NumEventTypes,                        // Not an event, but this value used to size the number of columns in event/action array.
+  Event_All,                            // Used to enable or disable all events
+  Event_Step                            // Not a button event: rotary encoder step(s), see RotaryEncoder (currentEvent().delta)
+};
+
+#define IB_EVENT_BIT(event)   (1U << (event))
+#define IB_COMPILED_EVENTS  (0b111 | (IB_LONGPRESS_COMPILED << Event_LongKeyPress) | (IB_AUTOREPEAT_COMPILED << Event_AutoRepeatPress) \
+                                   | (IB_DOUBLECLICK_COMPILED << Event_DoubleClick) | (IB_PATTERN_COMPILED << Event_Pattern) | (1 << Event_All))
+
+enum eventSources:uint8_t {
+  Source_Button,                        // Event of a single button, resolved through the button's own action table
+  Source_Chord,                         // Registered chord matched, resolved through the chord's action table ('id' is the chord)
+  Source_Encoder                        // Rotary encoder step(s), resolved through the encoder's action table ('id' is the encoder)
+};
+
+class InterruptButton;
+class MatrixKeypad;
+class AnalogButtons;
+class ButtonAwaiter;
+class RotaryEncoder;
+
+struct memoryFootprint_t {              // Bytes held by the library, see InterruptButton::getMemoryFootprint()
+  uint16_t          buttons;            // Initialised buttons (including keypad keys)
+  uint16_t          callbackBytes;      // sizeof(func_ptr_t), one per menu level and event of every button
+  uint32_t          buttonBytes;        // The button objects themselves, wherever they were allocated (sizeof(InterruptButton) each)
+  uint32_t          poolBytes;          // Shared action table (setActionPool()), whether claimed or not
+  uint16_t          pooledButtons;      // Buttons whose actions live in the shared table
+  uint16_t          poolCapacity;
+  uint32_t          heapActionBytes;    // Action tables allocated on their own (buttons outside the pool, ButtonActions)
+  uint32_t          chordBytes;         // Chord action tables
+  uint32_t          staticBytes;        // Statically allocated queues, lanes, chord and pattern tables and gpio map
+};
+
+#ifdef INTERRUPTBUTTON_COMPACT_CALLBACK                                         // Told when a button enters or leaves an edge storm
+typedef CompactCallback<void(InterruptButton* btn, bool storming)> storm_func_t;
+#else
+typedef std::function<void(InterruptButton* btn, bool storming)> storm_func_t;
+#endif
+
+struct buttonEvent_t {                  // Plain record held in the async and sync event queues (no std::function copies in the ISR)
+  InterruptButton*  btn;                // Button that raised the event (or completed the chord), resolved to its bound action when dispatched
+  int64_t           timeUS;             // esp_timer_get_time() when the event was raised
+  uint32_t          durationUS;         // How long the key had been down (from the first press edge) when the event was raised
+  events            event;
+  uint8_t           menuLevel;          // Menu level the event was raised at
+  eventSources      source;
+  uint8_t           id;                 // Chord number for Source_Chord, encoder for Source_Encoder, registered pattern for
+                                        // Event_Pattern (0xFF if none matched)
+  uint8_t           clicks;             // Event_Pattern: presses in the sequence
+  uint8_t           longMask;           // Event_Pattern: bit n set when press n (from bit 0, the first) was a long press
+  uint16_t          count;              // Events merged into this record while it waited (1 unless coalesced, see setCoalescedEvents())
+  int16_t           delta;              // Source_Encoder: signed steps (clockwise positive), summed when records merge
+  bool coalescesWith(const buttonEvent_t& other) const {
+    return source == other.source && id == other.id && btn == other.btn && event == other.event && menuLevel == other.menuLevel;
+  }
+  void mergeWith(const buttonEvent_t& other) {  // Keeps the first timeUS (latency is measured from the oldest merged event)
+    count = (count + other.count > UINT16_MAX) ? UINT16_MAX : count + other.count;
+    int32_t steps = delta + other.delta;
+    delta = (steps > INT16_MAX) ? INT16_MAX : (steps < INT16_MIN) ? INT16_MIN : steps;
+    durationUS = other.durationUS;
+  }
+};
+
+struct eventWaiter_t {                  // Suspended coroutine waiting on events, linked into the class wait list (see ButtonAwaiter)
+  eventWaiter_t*    next;
+  InterruptButton*  buttons[AWAIT_MAX_BUTTONS];   // Any of these buttons (nullptr once deleted)
+  uint8_t           numButtons;
+  uint16_t          eventMask;          // Bit per event waited for
+  bool              waiting;            // Linked, cleared by the dispatcher that takes it off the list to resume it
+  void            (*resume)(void* frame);
+  void*             frame;              // Coroutine frame, handle.address()
+  buttonEvent_t     event;              // Event that resumed it
+};
+
+#if IB_STATS_COMPILED
+#define IB_STATS_BINS             20    // bins[0] counts 0us, bins[n] counts [2^(n-1), 2^n) us, the last bin also counts anything longer
+
+struct ibHistogram_t {                  // Log2 histogram of durations in us
+  uint32_t          bins[IB_STATS_BINS];
+  uint32_t          count;
+  uint32_t          maxUS;
+  void add(uint32_t us) {
+    uint8_t bin = us ? 32 - __builtin_clz(us) : 0;
+    bins[(bin < IB_STATS_BINS) ? bin : IB_STATS_BINS - 1]++;
+    count++;
+    if(us > maxUS) maxUS = us;
+  }
+};
+
+struct queueStats_t {
+  uint16_t          depth;
+  uint16_t          pending;            // Entries waiting when the snapshot was taken
+  uint16_t          highWater;          // Most entries ever waiting at once
+  uint32_t          queued;             // Entries added
+  uint32_t          coalesced;          // Entries merged into an identical waiting entry (setCoalescedEvents() or Overflow_Coalesce)
+  uint32_t          dropped;            // Entries lost to a full queue (the new one, or the oldest with Overflow_DropOldest)
+  ibHistogram_t     latencyUS;          // From an event being raised (enqueued) to it being dispatched
+};
+
+struct classStats_t {
+  queueStats_t      asyncQueues[DISPATCH_LANES];  // One per dispatch lane
+  queueStats_t      syncQueue;
+  ibHistogram_t     isrUS;              // Execution time of the gpio interrupt handler
+  ibHistogram_t     timerUS;            // Execution time of timer callbacks (debounce samples, longPress, autoRepeat, double-click)
+};
+
+struct buttonStats_t {
+  uint32_t          falseAlarms;        // Edges rejected as noise while confirming a press
+  uint32_t          presses;            // Presses confirmed and then released
+  uint32_t          polls;              // Debounce samples over all those presses (make and break), polls / presses is the mean
+  uint16_t          maxPolls;           // Most debounce samples taken by a single press
+  uint32_t          events[NumEventTypes];  // Events raised, including any then lost to a full queue
+};
+#endif
+
+#if IB_TRACE_COMPILED
+enum traceKinds:uint8_t {
+  Trace_Edge,                           // Edge (or storm sample) woke a settled button: a = pin level read
+  Trace_Sample,                         // Debounce sample: a = level, b = valid polls so far
+  Trace_State,                          // State machine transition: a = new state, b = previous state
+  Trace_Event,                          // Event raised: a = event, b = menu level
+  Trace_Timer                           // longPress/autoRepeat (a = 0) or double-click (a = 1) timer fired
+};
+
+struct traceEntry_t {                   // One record of the trace ring buffer
+  uint32_t          timeUS;             // Low 32 bits of esp_timer_get_time()
+  uint8_t           button;             // Trace id: the button's gpio, or 64 and up for keys without one
+  traceKinds        kind;
+  uint8_t           a;
+  uint8_t           b;
+};
+#endif
+
+
+// -- Button Action Table --------------------------------------------------------------------------------------------------
+// The actions of one button for every menu level and event.  A button starts out with its own table, edited by its
+// bind() and unbind().  A ButtonActions table can instead be built off to the side (eg one per screen) and published on a
+// button with setActions(), a single atomic pointer swap that is safe while the button is live.  Events are resolved
+// through whichever table is published when they are raised and actioned.  A published table is read-only; once
+// withdrawn it must not be changed or deleted until inUse() is false, as an action from it may still be running (possibly
+// the very action that withdrew it).  The button's own table follows the same rule: while it is published, bind() makes
+// its change in an idle copy and publishes that.
+// -- ----------------------------------------------------------------------------------------------------------------------
+#define IB_READER_SLOTS   (DISPATCH_LANES + 3)    // Contexts that read action tables: each lane, processSyncEvents(), ISR, timer task
+#define IB_SINGLE_COLUMN  static_cast<events>(0)  // The only column of a one column table (chord actions, encoder steps)
+
+template <class Config> class InterruptButtonT;
+
+class ButtonActions {
+  friend class InterruptButton;
+  friend class RotaryEncoder;                                         // Publishes its step actions as one column tables
+  template <class Config> friend class InterruptButtonT;              // Supplies a second static table for bind() to edit
+
+  private:
+    ButtonActions() {}                                                // Empty, a button's own table is filled in when it initialises
+    ButtonActions(const ButtonActions&) = delete;
+    ButtonActions& operator=(const ButtonActions&) = delete;
+    void                  allocate(uint8_t menus,                     // Heap table owned by this table
+                                   uint8_t columns = NumEventTypes);
+    void                  attach(func_ptr_t* actions, uint8_t menus); // Storage owned elsewhere (InterruptButtonT, the shared pool)
+    void                  copyFrom(const ButtonActions* other);       // Every action of a table of the same size
+    bool                  awaitIdle(void);                            // Yields until inUse() is false (false if it gave up)
+    static void           publishColumn(std::atomic<ButtonActions*> &published,  // Publishes a copy of a one column table
+                                        ButtonActions* &retired,                 // with one action changed, the old one
+                                        uint8_t menus, uint8_t menuLevel,        // joins the withdrawn list
+                                        func_ptr_t action);
+    static void           freeRetired(ButtonActions* &retired,        // Frees withdrawn tables no reader can still be in, or
+                                      bool wait);                     // first waits for them (owner going away)
+    inline func_ptr_t&    at(uint8_t menuLevel, events event) const { return m_actions[menuLevel * m_columns + event]; }
+    inline bool           has(uint8_t menuLevel, events event) const {
+      return menuLevel < m_menus && at(menuLevel, event) != nullptr;
+    }
+
+    func_ptr_t*           m_actions = nullptr;                        // Flat [menu level][event] array, one contiguous block
+    uint8_t               m_menus = 0;
+    uint8_t               m_columns = NumEventTypes;                  // Actions per menu level
+    bool                  m_ownsActions = false;
+    bool                  m_embedded = false;                         // Member of a button, never deleted on its own
+    std::atomic<uint8_t>  m_published { 0 };                          // Buttons this table is published on
+    uint32_t              m_retiredAt[IB_READER_SLOTS] = {};          // Reader slots when last withdrawn (see inUse())
+    ButtonActions*        m_next = nullptr;                           // Links withdrawn tables until they are reused or freed
+
+  public:
+    explicit ButtonActions(uint8_t menus);                            // Empty table for this many menu levels, eg InterruptButton::getMenuCount()
+    ~ButtonActions();
+    bool            bind(events event, uint8_t menuLevel, func_ptr_t action);  // Refused (false) while the table is published
+    bool            unbind(events event, uint8_t menuLevel);
+    uint8_t         menuCount(void) { return m_menus; }
+    bool            inUse(void);                                      // Published, or an action from it may still be running
+};
+
+
+// -- Interrupt Button and Debouncer ---------------------------------------------------------------------------------------
+// -- ----------------------------------------------------------------------------------------------------------------------
+class InterruptButton {
+  friend class MatrixKeypad;                                          // Feeds its keys' samples into readButton()
+  friend class AnalogButtons;                                         // Likewise for the buttons of a resistor ladder
+  friend class ButtonActions;                                         // Reads the reader slots
+  friend class ButtonAwaiter;                                         // Links its waiter into the wait list
+  friend class RotaryEncoder;                                         // Shares the class initialisation, lanes and event queues
+
+  private:
+    enum buttonStates {                 // Enumeration to assist with program flow at state machine for reading button
+      Released,
+      ConfirmingPress,
+      Pressing,
+      Pressed,
+      WaitingForRelease,
+      Releasing
+    };
+
+    // STATIC class members shared by all instances of this object (common across all instances of the class)
+    // ------------------------------------------------------------------------------------------------------
+    static void asyncQueueServicer(void* pvParams);                   // Function used as RTOS task to receive and process action from RTOS message queue.
+    static void readButton(void* arg);                                // function to read button state (must be static to bind to GPIO and timer ISR)
+    static void longPressEvent(void *arg);                            // Callback to excecute a longPress event, called by timer
+    static void autoRepeatPressEvent(void *arg);                      // Callback to excecute a autoRepeatPress event, called by timer
+    static void doubleClickTimeout(void *arg);                        // Callback used to separate double-clicks from regular keyPress's, called by timer
+    static void longPressAndRepeatTimeout(void *arg);                 // Callback of the longPress/autoRepeat timer, calls one of the above
+    static void createTimer(esp_timer_handle_t &timer,                // Helper func to create a button's timer (once, when initialising)
+                            void (*callBack)(void* arg),
+                            InterruptButton* btn,
+                            const char *name);
+    static void startTimer(esp_timer_handle_t timer,                  // Helper func to (re)start an existing timer, one-shot or periodic
+                           uint32_t duration_US,
+                           bool periodic = false);
+    static void stopTimer(esp_timer_handle_t timer);                  // Helper function to stop a timer, leaving it ready for reuse
+    static void killTimer(esp_timer_handle_t &timer);                 // Helper function to delete a timer (destructor only)
+    static void notifyServicer(uint8_t lane);                         // Wakes a lane's RTOS queue servicer task (ISR or task context)
+    static bool startLane(uint8_t lane);                              // Creates (or resumes) a lane's RTOS queue servicer task
+    static void dispatch(const buttonEvent_t &evt,                   // Resolves a queued event record to its bound action and runs it
+                         buttonEvent_t &current,
+                         uint8_t readerSlot);
+    static pushResults enqueue(const buttonEvent_t &evt, bool async); // Adds a record to its button's lane (and wakes servicer) or sync queue
+    static void initialiseClass(void);                                // ISR service, menu count, queues and the action pool, once
+    static void useLane(uint8_t lane);                                // Marks a lane as used, starting its task in the async modes
+    static void updateChords(InterruptButton* btn, bool pressed);     // Tracks held buttons and fires any chord completed by this press
+    static void startPolling(InterruptButton* btn);                   // Begin periodic debounce sampling with the button's engine
+    static void stopPolling(InterruptButton* btn);                    // End periodic debounce sampling
+    static void scanButtons(void *arg);                               // Shared scan timer callback, samples all active buttons at once
+    static void feedKeys(InterruptButton* const* keys, uint64_t closed,   // One scan of Debounce_External keys (bit per key closed)
+                         uint64_t &activeKeys, uint64_t &pressedKeys);  // from their owner, updates its debouncing and pressed masks
+    static void stormPoll(void *arg);                                 // Storm timer callback, samples a pin whose interrupt is disabled
+    void        recordClick(void);                                    // Advances the press pattern on a release, (re)starts the double-click timer
+    void        finishPattern(void);                                  // Double-click timer expired, raises the pattern (or keyPress)
+    void        glitchReleased(void);                                 // Press was a glitch, finishes a sequence its timeout left open
+#if IB_STATS_COMPILED
+    static void countPush(queueStats_t &stats, pushResults result, uint16_t pending);
+    class callbackTimer {                                             // Adds the lifetime of a callback to the ISR or timer histogram
+      private:
+        int64_t           m_startUS;
+        bool              m_isr;
+      public:
+        callbackTimer() : m_startUS(esp_timer_get_time()), m_isr(xPortInIsrContext()) {}
+        ~callbackTimer();
+    };
+#endif
+#if IB_TRACE_COMPILED
+    static traceEntry_t       m_trace[TRACE_DEPTH];                   // Ring buffer, written lock free from the ISR and timer task
+    static std::atomic<uint32_t> m_traceHead;                         // Entries ever written, the next one goes in m_trace[head % TRACE_DEPTH]
+    static bool               m_tracing;
+    static uint8_t            m_nextTraceId;                          // Next id for a key without a gpio
+    inline void               trace(traceKinds kind, uint8_t a, uint8_t b = 0) {
+      if(!m_tracing) return;
+      uint32_t slot = m_traceHead.fetch_add(1, std::memory_order_relaxed) % TRACE_DEPTH;
+      m_trace[slot] = { static_cast<uint32_t>(esp_timer_get_time()), m_traceId, kind, a, b };
+    }
+    class stateTracer {                                               // Records the transition (if any) made by a call of readButton()
+      private:
+        InterruptButton*  m_btn;
+        uint8_t           m_state;
+      public:
+        stateTracer(InterruptButton* btn) : m_btn(btn), m_state(btn->m_state) {}
+        ~stateTracer() { if(m_btn->m_state != m_state) m_btn->trace(Trace_State, m_btn->m_state, m_state); }
+    };
+#endif
+
+    static void retireActions(ButtonActions* table);                  // A button stopped using a published table
+    static bool awaitReaders(void);                                   // Waits until every reader active now has finished
+
+    enum readerSlots {                  // Lanes take slots 0 to DISPATCH_LANES-1
+      Reader_Sync = DISPATCH_LANES,
+      Reader_Isr,
+      Reader_Timer
+    };
+    class readerGuard {                                               // Marks a context reading action tables (see ButtonActions::inUse())
+      private:                                                        // Slot is depth (low byte), and a generation bumped each time
+        std::atomic<uint32_t> &m_slot;                                // the depth returns to zero
+      public:
+        readerGuard(uint8_t slot) : m_slot(m_readers[slot]) { m_slot.fetch_add(1); }
+        readerGuard() : readerGuard(xPortInIsrContext() ? Reader_Isr : Reader_Timer) {}
+        ~readerGuard() {
+          uint32_t slot = m_slot.load();
+          while(!m_slot.compare_exchange_weak(slot, ((slot & 0xFF) == 1) ? slot - 1 + 0x100 : slot - 1)) {}
+        }
+    };
+
+    static void action(InterruptButton  *btn,                         // Helper function to simplify calling actions at specified menulevel
+                       events           event,
+                       uint8_t          menuLevel);
+    inline static void action(InterruptButton* btn, events event) { action(btn, event, m_menuLevel); };
+    static void addWaiter(eventWaiter_t &waiter);                     // Links a suspending coroutine's waiter into the wait list
+    static void removeWaiter(eventWaiter_t &waiter);                  // Unlinks it if no dispatcher has taken it (coroutine destroyed)
+    static void resumeWaiters(const buttonEvent_t &evt);              // Resumes the coroutines waiting on a dispatched event
+    static void refreshAwaited(InterruptButton* btn);                 // Recomputes a button's m_awaitedEvents (caller holds m_waitMux)
+
+    static bool           m_classInitialised;                         // Boolean flag to control class initialisation
+    static bool           m_firstButtonInitialised;                   // Used to block any further changes to m_numMenus
+    struct dispatchLane_t {                                           // Async queue and the RTOS task that actions it
+      EventRingBuffer<buttonEvent_t, ASYNC_EVENT_QUEUE_DEPTH> queue;
+      TaskHandle_t        task = nullptr;
+      buttonEvent_t       current = {};                               // Event being actioned by this lane's task (see currentEvent())
+      bool                used = false;                               // A button was assigned, task runs in the async modes
+      bool                configured = false;                         // configureLane() was called, otherwise the defaults apply
+      UBaseType_t         priority = 0;
+      BaseType_t          core = 0;
+      uint32_t            stackDepth = 0;
+    };
+    static dispatchLane_t m_lanes[DISPATCH_LANES];                    // Lane 0 is the default lane of every button
+    static EventRingBuffer<buttonEvent_t, SYNC_EVENT_QUEUE_DEPTH>  m_syncEventQueue;   // Queue serviced by processSyncEvents()
+    static overflowPolicies m_overflowPolicy;                         // What to do when an event arrives at a full queue
+    static uint16_t       m_coalescedEvents;                          // Bit per event merged into an identical newest waiting record
+    static buttonEvent_t  m_syncCurrentEvent;                         // Event being actioned by processSyncEvents()
+
+    static uint8_t        m_numMenus;                                 // Total number of menu sets, can be set by user, but only before initialising first button
+    static std::atomic<uint8_t> m_menuLevel;                          // Current menulevel for all buttons (global in class so common across all buttons)
+    static modes          m_mode;
+    static bool           m_deleteInProgress;                         // Precautionary blocker to prevent asyc calls of object methods while they are being deleted
+    static bool           m_lowPowerMode;                             // Released buttons wait on light sleep wakeup interrupts
+
+    static esp_timer_handle_t m_scanTimer;                            // Shared scan engine periodic timer (only runs while buttons are polling)
+    static InterruptButton*   m_pinButtons[MAX_BUTTON_PINS];          // Initialised buttons indexed by gpio
+    static volatile uint64_t  m_scanActiveMask;                       // Bit per gpio currently being debounced by the shared scan engine
+    static uint64_t           m_scanPressedLevels;                    // Bit per gpio set when that button reads HIGH when pressed
+    static uint16_t           m_scanIntervalUS;                       // Sample period of the shared scan engine
+    static portMUX_TYPE       m_scanMux;
+
+    static func_ptr_t*        m_actionPool;                           // Shared [button][menu level][event] table, see setActionPool()
+    static bool*              m_poolClaimed;                          // Slot per button in the pool
+    static uint16_t           m_poolButtons;
+    static uint16_t           m_liveButtons;                          // Initialised buttons, for getMemoryFootprint()
+    static uint32_t           m_heapActionBytes;                      // Action tables allocated on their own
+
+    struct chord_t {                                                  // Buttons that fire their own event when held together
+      uint64_t            mask;                                       // Bit per member gpio
+      uint16_t            windowMS;                                   // Max time between first and last member pressing
+      std::atomic<ButtonActions*> actions;                            // Published one column table, an action per menu level
+      ButtonActions*      retired;                                    // Withdrawn tables, freed once inUse() is false
+    };
+#if IB_STATS_COMPILED
+    static classStats_t       m_classStats;
+    static portMUX_TYPE       m_statsMux;
+#endif
+
+    static chord_t            m_chords[MAX_CHORDS];
+    static uint8_t            m_numChords;
+    static volatile uint64_t  m_pressedMask;                          // Bit per gpio of buttons currently held (debounced)
+    static volatile uint16_t  m_chordsLatched;                        // Bit per chord fired and not yet released
+    static portMUX_TYPE       m_chordMux;
+    static std::atomic<uint32_t> m_readers[IB_READER_SLOTS];          // Per context reading action tables, see readerGuard
+    static storm_func_t       m_stormHandler;
+    static RotaryEncoder*     m_encoders[MAX_ENCODERS];               // Begun encoders, indexed by the 'id' of their records
+    static eventWaiter_t*     m_waiters;                              // Coroutines suspended on a ButtonAwaiter, newest first
+    static portMUX_TYPE       m_waitMux;
+
+    struct patternState_t {                                           // Node of the press pattern DFA, shared by all buttons
+      uint8_t             next[2];                                    // Next node after a short [0] or long [1] press, 0 = no pattern continues
+      int8_t              pattern;                                    // Pattern completed at this node, -1 if none
+    };
+    static patternState_t     m_patternStates[MAX_PATTERN_STATES];    // Node 0 is the start of every sequence
+    static uint8_t            m_numPatternStates;
+    static uint8_t            m_numPatterns;
+
+    // Non-static instance specific member declarations
+    // ------------------------------------------------
+    InterruptButton(debounceEngines engine, uint32_t debounceUS);     // Key fed by its owner, no gpio (engine must be Debounce_External)
+    void                  initialiseInstance(void);                   // Setup interrupts and event-action array
+    ButtonActions*        editableActions(void);                      // Own table if no reader can be in it, else an idle copy of it
+    void                  adoptActions(ButtonActions* table);         // Makes an edited copy the own table (published if the own was)
+    ButtonActions*        takeIdleTable(bool embeddedOnly);           // Unlinks an earlier own table no reader is left in, or nullptr
+    void                  adaptDebounce(void);                        // Folds the last settle time into the learned bounce and retunes polling
+    void                  countEdge(void);                            // Edge rate limiter, disables the interrupt past the storm limit
+    bool                  edgeSettle(void);                           // Debounce_EdgeTimestamp step, true to carry on with the state machine
+    bool                  settleLevel(bool &rearm);                   // Edge engine quiet timer decision, true to carry on (rearm: glitch,
+                                                                      // re-arm the interrupt once out of the lock)
+    void                  edgeHandedOff(void);                        // Ends the handoff claimed by edgeSettle(), catching up on any edge it hid
+    bool                  m_thisButtonInitialised = false;            // Allows us to intialise when binding functions (ie detect if already done)
+    gpio_num_t            m_pin;                                      // Button gpio
+    uint8_t               m_pressedState;                             // State of button when it is pressed (LOW or HIGH)
+    gpio_mode_t           m_pinMode;                                  // GPIO mode: IDF's input/output mode
+    volatile buttonStates m_state = Released;                         // Instance specific state machine variable (intialised when intialising button)
+    volatile bool         m_wtgForDblClick = false;
+    volatile bool         m_autoRepeating = false;                    // Selects which event the longPress/autoRepeat timer fires next
+    esp_timer_handle_t    m_buttonPollTimer = nullptr;                // Instance specific timer for button debouncing (periodic while polling, one-shot for the edge engine)
+    esp_timer_handle_t    m_buttonLPandRepeatTimer = nullptr;         // Instance specific timer for button longPress and autoRepeat timing
+    esp_timer_handle_t    m_buttonDoubleClickTimer = nullptr;         // Instance specific timer for discerning double-clicks from regular keyPresses
+    esp_timer_handle_t    m_buttonStormTimer = nullptr;               // Instance specific timer sampling the pin during an edge storm
+
+    volatile uint8_t      m_doubleClickMenuLevel;                     // Stores current menulevel while differentiating between regular keyPress or a double-click
+    debounceEngines       m_debounceEngine = Debounce_PerButtonTimer;
+    uint8_t               m_lane = 0;                                 // Dispatch lane of this button's async events
+    volatile uint8_t      m_scannedLevel = 0;                         // Pin level handed over by the shared scan engine
+    inline uint8_t        sampleLevel(void) {
+      return (m_debounceEngine == Debounce_SharedScan || m_debounceEngine == Debounce_External) ? m_scannedLevel : gpio_get_level(m_pin);
+    }
+    inline uint8_t        pinLevel(void) { return (m_debounceEngine == Debounce_External) ? m_scannedLevel : gpio_get_level(m_pin); }
+    inline uint32_t       heldTimeoutUS(uint16_t ms) {                // Long press or first repeat delay from keyDown; the edge engine
+      uint32_t lateUS = (m_debounceEngine == Debounce_EdgeTimestamp) ? m_settleUS : 0;   // confirms after the bounce, not the first edge
+      return (ms * 1000UL > lateUS) ? ms * 1000UL - lateUS : 0;
+    }
+    void                  edgeInterrupt(bool enable);                 // Arm or mask the pin's change interrupt (owner handles external keys)
+    bool                  m_wakeupArmed = false;                      // Pin is waiting on a light sleep wakeup (level) interrupt
+
+    uint16_t              m_pollIntervalUS;                           // Timing variables
+    uint16_t              m_longKeyPressMS;
+    uint16_t              m_autoRepeatMS;
+    uint16_t              m_doubleClickMS;
+
+    volatile bool         m_blockKeyPress;                            // Boolean flag to prevent firing a keypress if a longPress or AutoRepeatPress occurred (outside of polling fuction)
+    volatile int64_t      m_pressEdgeUS = 0;                          // Time of the edge that started the current press
+    volatile int64_t      m_releaseEdgeUS = 0;                        // Time of the edge that started the current release
+    volatile uint16_t     m_validPolls = 0;                           // Variables to conduct debouncing algoritm
+    volatile uint16_t     m_totalPolls = 0;
+    bool                  m_adaptive = false;                         // Adaptive debounce (early decision and learned bounce) enabled
+    uint32_t              m_settleUS = 0;                             // Edge to last sample at the old level, for the current transition
+    uint32_t              m_bounceUS = 0;                             // Learned bounce duration
+    uint16_t              m_basePollIntervalUS;                       // Configured polling, restored when adaptive debounce is disabled
+    uint8_t               m_baseTargetPolls;
+    uint16_t              m_stormMaxEdges = STORM_MAX_EDGES;          // Edge storm limit (0 = never disable the interrupt)
+    uint16_t              m_stormWindowMS = STORM_WINDOW_MS;
+    uint16_t              m_stormEdges = 0;                           // Edges counted in the current window
+    int64_t               m_stormWindowUS = 0;                        // Start of the current window
+    int64_t               m_stormQuietUS = 0;                         // Last sampled change while storming
+    volatile bool         m_storming = false;                         // Interrupt disabled, pin sampled by the storm timer
+    volatile bool         m_stormReported = false;                    // Storm handler told about the current storm
+    portMUX_TYPE          m_settleMux = portMUX_INITIALIZER_UNLOCKED; // Edge engine: settle decisions and state handoffs (see edgeSettle())
+    volatile bool         m_handingOff = false;                       // Edge engine: one context owns the current state transition
+    volatile bool         m_edgeMissed = false;                       // An edge arrived during the handoff and was left to its owner
+    uint32_t              m_storms = 0;                               // Storms since the button was created
+    uint8_t               m_patternState = 0;                         // DFA node reached by the presses so far
+    uint8_t               m_clicks = 0;                               // Presses in the current sequence
+    uint8_t               m_longMask = 0;                             // Bit per long press in the current sequence
+    uint8_t               m_patternMatch = 0xFF;                      // Pattern being raised
+    volatile bool         m_inChord = false;                          // Current press completed a chord, so isn't part of a pattern
+    volatile uint16_t     m_awaitedEvents = 0;                        // Bit per event a suspended coroutine is waiting on
+#if IB_STATS_COMPILED
+    buttonStats_t         m_stats = {};
+    uint16_t              m_pressPolls = 0;                           // Debounce samples taken so far by the current press
+#endif
+#if IB_TRACE_COMPILED
+    uint8_t               m_traceId = 0;                              // Identifies the button's trace entries
+#endif
+
+    ButtonActions         m_ownActions;                               // First own table (shared pool slot, heap or InterruptButtonT storage)
+    int16_t               m_poolSlot = -1;                            // Slot of m_ownActions in the shared pool, -1 if not pooled
+    ButtonActions*        m_own = &m_ownActions;                      // Own table, published unless setActions() replaced it
+    ButtonActions*        m_idleTables = nullptr;                     // Earlier own tables, reused by bind() once inUse() is false
+    std::atomic<ButtonActions*> m_actions { &m_ownActions };          // Table events are resolved through
+    uint8_t               m_targetPolls = TARGET_POLLS;               // Number of polls to decide a press or release
+    uint16_t              m_supportedEvents = IB_COMPILED_EVENTS;     // Events this button may ever enable (narrowed by InterruptButtonT)
+    std::atomic<uint16_t> eventMask { IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyUp) |   // Default to keyUp, keyDown, and keyPress
+                                      IB_EVENT_BIT(Event_KeyPress) | IB_EVENT_BIT(Event_All) };   // enabled, and no blanket disable
+                                                                      // When binding functions, longKeyPress, autoKeyPresses, & double-clicks are automatically enabled.
+    inline bool           settled(int64_t edgeUS) {                   // Adaptive early decision: the sample majority is clear (sequential
+      if(!m_adaptive) return false;                                   // test) and the learned bounce has passed since the edge
+      int16_t lead = 2 * m_validPolls - m_totalPolls;
+      return (lead >= ADAPTIVE_DECISION_MARGIN || lead <= -ADAPTIVE_DECISION_MARGIN) && esp_timer_get_time() - edgeUS >= m_bounceUS;
+    }
+    inline bool           hasAction(uint8_t menuLevel, events event) {  // True if an action is bound to this event at this menu level,
+      return (m_awaitedEvents & IB_EVENT_BIT(event)) ||               // or a coroutine is waiting on it at any level
+             m_actions.load(std::memory_order_acquire)->has(menuLevel, event);    // (caller holds a readerGuard)
+    }
+
+  protected:
+    void                  teardown(void);                             // Detaches the button and frees its tables (destructor, run once)
+    void                  setPolling(uint8_t targetPolls,             // Debounce samples per decision and their interval, other than
+                                     uint16_t pollIntervalUS);        // the build's TARGET_POLLS (InterruptButtonT, trace replay)
+    void                  useStaticStorage(func_ptr_t* actions,       // Used by InterruptButtonT to supply its statically sized
+                                           ButtonActions* spare,      // action table, a spare for bind() to edit while the
+                                           uint8_t menus,             // other is published, and compile-time settings (no heap use)
+                                           uint8_t targetPolls,
+                                           uint16_t pollIntervalUS,
+                                           uint16_t supportedEvents);
+
+  public:
+    // Static class members shared by all instances of this object -----------------------
+    static bool     setMode(modes mode);                              // Toggle between Synchronous (Static Queue), Hybrid, or Asynchronous modes (RTOS Queue)
+    static modes    getMode(void);
+    static void     setOverflowPolicy(overflowPolicies policy);       // Behaviour of both event queues when they are full
+    static overflowPolicies getOverflowPolicy(void);
+    static void     processSyncEvents(void);                          // Process Sync Events, called from main looop
+    static uint16_t processSyncEvents(uint16_t maxEvents,             // Process at most maxEvents records and stop once maxMicros have
+                                      uint32_t maxMicros = 0);        // passed (0 = no limit).  Returns the number still waiting.
+    static void     setCoalescedEvents(uint16_t eventMask);           // Events merged with a waiting repeat, eg IB_EVENT_BIT(Event_AutoRepeatPress)
+    static uint16_t getCoalescedEvents(void);
+    static void     setLowPowerMode(bool enable);                     // Released buttons become gpio light sleep wakeup sources
+    static bool     getLowPowerMode(void);
+    static const buttonEvent_t& currentEvent(void);                   // Record of the event whose action is running (call from a bound action)
+    static void     setMenuCount(uint8_t numberOfMenus);              // Sets number of menus/pages that each button has (can only be done before intialising first button)
+    static uint8_t  getMenuCount(void);                               // Retrieves total number of menus.
+    static bool     setActionPool(uint16_t buttons);                  // One contiguous action table shared by this many buttons (only
+                                                                      // before initialising first button), later buttons get their own
+    static void     getMemoryFootprint(memoryFootprint_t &footprint);  // Bytes held by buttons, action tables, queues and statics
+    static void     setMenuLevel(uint8_t level);                      // Sets menu level across all buttons (ie buttons mean something different each page)
+    static uint8_t  getMenuLevel();                                   // Retrieves menu level
+    static int8_t   addChord(std::initializer_list<InterruptButton*> buttons,  // Registers buttons held together as a chord,
+                             uint16_t windowMS = 150);                // pressed within windowMS of each other.  Returns the chord number or -1.
+    static void     bindChord(uint8_t chord, uint8_t menuLevel, func_ptr_t action);  // Binds an action to a chord at a given menulevel
+    inline static void bindChord(uint8_t chord, func_ptr_t action) { bindChord(chord, m_menuLevel, action); }
+    static void     unbindChord(uint8_t chord, uint8_t menuLevel);
+    static uint64_t getPressedMask(void);                             // Bit per gpio of buttons currently held down
+    static int8_t   addPattern(const char* presses);                  // Registers a press pattern, eg "SSL" (short, short, long), for
+                                                                      // Event_Pattern.  Returns the pattern number (currentEvent().id) or -1.
+    static void     setStormHandler(storm_func_t handler);            // Called (timer task) when any button enters or leaves an edge storm
+    static void     setScanInterval(uint16_t intervalUS);             // Sample period used by all Debounce_SharedScan buttons
+    static uint16_t getScanInterval(void);
+#if IB_STATS_COMPILED
+    static void     getClassStats(classStats_t &stats);               // Snapshot of queue health and callback timing
+    static void     resetClassStats(void);
+#endif
+#if IB_TRACE_COMPILED
+    static void     setTracing(bool enable);                          // Pause (eg once a fault is seen) or resume recording, on by default
+    static uint16_t getTrace(traceEntry_t* entries, uint16_t maxEntries);  // Copies out the newest entries, oldest first, returns the count
+    static void     clearTrace(void);
+    static void     printTrace(void);                                 // Prints the button settings and the trace as text for host/ibreplay
+#endif
+    static bool     configureLane(uint8_t lane,                       // Priority, core and stack of a lane's RTOS task, must be called
+                                  UBaseType_t priority,               // before the lane's first button is assigned (or lane 0's first
+                                  BaseType_t core,                    // button initialised).  Defaults are EVENT_TASK_PRIORITY + lane,
+                                  uint32_t stackDepth);               // EVENT_TASK_CORE and m_RTOSservicerStackDepth.
+    static uint32_t m_RTOSservicerStackDepth;                         // Allows the user to set the depth of RTOS servicer function (for bound functions)
+                                                                      // Must be set before initialsing/binding first button or calling setMode().
+
+    // Non-static instance specific member declarations ----------------------------------
+    InterruptButton(uint8_t pin,                                      // Class Constructor, pin to monitor
+                    uint8_t pressedState,                             // State of the pin when pressed (HIGH or LOW)
+                    gpio_mode_t pinMode = GPIO_MODE_INPUT,
+                    uint16_t longKeyPressMS = 750,
+                    uint16_t autoRepeatMS =   250,
+                    uint16_t doubleClickMS =  333,
+                    uint32_t debounceUS =     8000);
+    ~InterruptButton();                                               // Class Destructor
+
+    void            enableEvent(events event);                        // Enable the event passed as argument (updates bitmask)
+    void            disableEvent(events event);                       // Disable the event passed as argument (updates bitmask)
+    bool            eventEnabled(events event);                       // Read bitmask and determine if event is enabled
+    void            setLongPressInterval(uint16_t intervalMS);        // Updates LongPress Interval
+    uint16_t        getLongPressInterval(void);
+    void            setAutoRepeatInterval(uint16_t intervalMS);       // Updates autoRepeat Interval
+    uint16_t        getAutoRepeatInterval(void);
+    void            setDoubleClickInterval(uint16_t intervalMS);      // Updates autoRepeat Interval
+    uint16_t        getDoubleClickInterval(void);
+    void            setDebounceEngine(debounceEngines engine);        // Per-button timer (default) or the class-level shared scan engine
+    debounceEngines getDebounceEngine(void);
+    void            setLane(uint8_t lane);                            // Async events of this button are actioned by this lane's task
+    uint8_t         getLane(void);
+    void            setAdaptiveDebounce(bool enable);                 // Decide as soon as samples agree and tune polling to the learned bounce
+    bool            getAdaptiveDebounce(void);
+    uint32_t        getLearnedBounce(void);                           // Learned bounce duration in us (adaptive debounce)
+    void            setStormLimit(uint16_t maxEdges,                  // Disable the interrupt and sample the pin every STORM_POLL_MS
+                                  uint16_t windowMS = STORM_WINDOW_MS);  // once it sees more than maxEdges per window (0 = never)
+    bool            isStorming(void);                                 // Interrupt currently disabled by an edge storm
+    uint32_t        getStormCount(void);                              // Edge storms since the button was created
+#if IB_STATS_COMPILED
+    void            getStats(buttonStats_t &stats);                   // Snapshot of this button's counters
+    void            resetStats(void);
+#endif
+
+
+    // Routines to manage interface with external action functions associated with each event ---
+    void            bind(events     event,                                  // Used to bind an action to an event at a given menulevel
+                         uint8_t    menuLevel,
+                         func_ptr_t action);
+    inline void     bind(events event, func_ptr_t action) { bind(event, m_menuLevel, action); } // Above function defaulting to current menulevel
+    inline void     bind(events event, uint8_t menuLevel,                   // Plain function called with a context pointer
+                         void (*fn)(void* ctx), void* ctx) { bind(event, menuLevel, func_ptr_t([fn, ctx]() { fn(ctx); })); }
+
+    void            unbind(events   event,                                  // Used to unbind an action to an event at a given menulevel
+                           uint8_t  menuLevel);
+    inline void     unbind(events event) { unbind(event, m_menuLevel); };   // Above function defaulting to current menulevel
+    ButtonActions*  setActions(ButtonActions* table);                       // Publish a prebuilt table (nullptr reverts to the button's
+                                                                            // own), returns the table withdrawn (nullptr if its own)
+    ButtonActions*  getActions(void);                                       // Published table, nullptr while the button's own is in use
+
+    // Coroutine interface, eg 'buttonEvent_t evt = co_await btn.next(Event_KeyPress);' (see ButtonAwaiter and ButtonTask.h)
+    ButtonAwaiter   next(events event);                                     // This button's next event of this kind (Event_All for any)
+    template <class... Buttons>
+    static ButtonAwaiter nextOf(events event, Buttons*... buttons);         // Next such event of any of these buttons, eg
+                                                                            // nextOf(Event_KeyPress, &up, &down), at most AWAIT_MAX_BUTTONS
+    static ButtonAwaiter nextOf(events event,                               // Same for an array of buttons, eg a keypad's keys
+                                InterruptButton* const* buttons, uint8_t count);
+};
+
+
+// -- Button Event Awaiter -------------------------------------------------------------------------------------------------
+// Awaitable returned by next() and nextOf(), for C++20 coroutines: 'co_await btn.next(Event_KeyPress)' suspends the
+// coroutine until that event is dispatched and evaluates to its buttonEvent_t record.  Nothing polls for it and no task
+// is added: the event is raised and queued as if an action were bound to it (at every menu level), and the lane task or
+// processSyncEvents() call that dispatches it runs the bound action, if any, then resumes the coroutine right there,
+// in the same context as an action would run.  The waiter lives in the coroutine frame, so a waiting coroutine costs its
+// frame (typically 100 - 200 bytes) rather than an RTOS task and stack.  Only events raised while a coroutine waits are
+// seen: one raised between being resumed and waiting again goes to the bound action alone.  A coroutine destroyed while
+// waiting unlinks itself; one waiting on a deleted button is never resumed by it.  The awaiter only relies on
+// handle.address(), so this header still builds as C++11/17, coroutines themselves need C++20 (see ButtonTask.h).
+// -- ----------------------------------------------------------------------------------------------------------------------
+class ButtonAwaiter {
+  private:
+    eventWaiter_t         m_waiter = {};
+
+    template <class Handle>
+    static void resumeFrame(void* frame) { Handle::from_address(frame).resume(); }
+
+  public:
+    ButtonAwaiter(events event, InterruptButton* const* buttons, uint8_t count);
+    ~ButtonAwaiter() { if(m_waiter.waiting) InterruptButton::removeWaiter(m_waiter); }
+
+    bool            await_ready(void) { return false; }
+    template <class Handle>
+    void            await_suspend(Handle handle) {
+      m_waiter.resume = &resumeFrame<Handle>;
+      m_waiter.frame = handle.address();
+      InterruptButton::addWaiter(m_waiter);                           // May be resumed by a dispatcher from here on
+    }
+    buttonEvent_t   await_resume(void) { return m_waiter.event; }
+};
+
+inline ButtonAwaiter InterruptButton::next(events event) {
+  InterruptButton* self = this;
+  return ButtonAwaiter(event, &self, 1);
+}
+template <class... Buttons>
+inline ButtonAwaiter InterruptButton::nextOf(events event, Buttons*... buttons) {
+  static_assert(sizeof...(buttons) >= 1 && sizeof...(buttons) <= AWAIT_MAX_BUTTONS, "Await 1 to AWAIT_MAX_BUTTONS buttons at once");
+  InterruptButton* list[] = { buttons... };                           // Not a braced list at the call site, those trip up
+  return ButtonAwaiter(event, list, sizeof...(buttons));              // coroutine lowering in some GCC versions
+}
+inline ButtonAwaiter InterruptButton::nextOf(events event, InterruptButton* const* buttons, uint8_t count) {
+  return ButtonAwaiter(event, buttons, count);
+}
+
+#endif // INTERRUPTBUTTON_H_
@@ -0,0 +1,57 @@
+#ifndef INTERRUPTBUTTONHAL_H_
+#define INTERRUPTBUTTONHAL_H_
+
+// -- Hardware Abstraction -------------------------------------------------------------------------------------------------
+// InterruptButton only talks to the hardware through the small subset of ESP-IDF used below:
+//   gpio:     gpio_config, gpio_get_level, gpio_set_level, gpio_set_intr_type, gpio_intr_enable/disable,
+//             gpio_install_isr_service, gpio_isr_handler_add/remove, gpio_reset_pin, gpio_wakeup_enable/disable and
+//             ibhal_read_inputs() (all input levels in one read)
+//   sleep:    esp_sleep_enable_gpio_wakeup, esp_sleep_disable_wakeup_source
+//   delays:   ibhal_delay_us() (busy wait, used to let keypad lines settle)
+//   adc:      ibhal_adc_init() and ibhal_adc_read() (one-shot raw reading of a pin's ADC channel), defined on target by
+//             AnalogButtons.cpp so only it needs the ADC driver (esp_adc, ESP-IDF 5 or later)
+//   timers:   esp_timer_create/start_once/start_periodic/stop/delete, esp_timer_get_time
+//   FreeRTOS: xTaskCreatePinnedToCore, vTaskSuspend/Resume, task notifications, critical sections, xPortInIsrContext
+// On target these are the real IDF/Arduino functions.  Host builds get the same names from host/SimHAL.h, which runs them
+// against a virtual clock, a timer wheel and scripted pin levels so the button logic can be exercised off-target.
+// -- ----------------------------------------------------------------------------------------------------------------------
+
+#if defined(ESP_PLATFORM) || defined(ARDUINO)
+
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+#include "esp_rom_sys.h"
+
+// Include reference req'd for debugging and warnings across serial port.
+#ifdef ARDUINO
+#include "esp32-hal-log.h"
+#else
+#include "esp_log.h"
+#endif
+
+// Reads every GPIO input level in one go (bit n = level of gpio n)
+static inline uint64_t IRAM_ATTR ibhal_read_inputs(void) {
+  uint64_t levels = REG_READ(GPIO_IN_REG);
+#ifdef GPIO_IN1_REG
+  levels |= static_cast<uint64_t>(REG_READ(GPIO_IN1_REG)) << 32;
+#endif
+  return levels;
+}
+
+static inline void IRAM_ATTR ibhal_delay_us(uint32_t us) {
+  esp_rom_delay_us(us);
+}
+
+#else
+
+#include "host/SimHAL.h"
+
+#endif
+
+#endif // INTERRUPTBUTTONHAL_H_
@@ -0,0 +1,106 @@
+#ifndef INTERRUPTBUTTONQUEUE_H_
+#define INTERRUPTBUTTONQUEUE_H_
+
+#include "InterruptButtonHAL.h"
+#include <atomic>
+#include <stdint.h>
+
+enum overflowPolicies {
+  Overflow_DropNewest,                  // Discard the event being added when the queue is full (original behaviour)
+  Overflow_DropOldest,                  // Discard the oldest unserviced event to make room for the new one
+  Overflow_Coalesce                     // Merge into the newest pending event if it is identical, otherwise discard the new one
+};
+
+enum pushResults {
+  Push_Stored,                          // Entry added
+  Push_DroppedOldest,                   // Entry added, but the oldest pending entry was discarded to make room
+  Push_Coalesced,                       // Entry merged into the identical newest pending entry (merge requested, or queue full)
+  Push_DroppedNewest                    // Queue full, entry discarded
+};
+
+
+// -- Event Ring Buffer ----------------------------------------------------------------------------------------------------
+// Fixed depth FIFO indexed by head/tail.  Producers (GPIO ISR and esp_timer task, which may sit on different cores) are
+// serialised by a very short spinlock; the single consumer only takes it to copy an entry out (so a producer never merges
+// into an entry being read), never while the entry is actioned, so a slow bound action can't hold up the ISR.
+// T must provide 'bool coalescesWith(const T& other) const' and 'void mergeWith(const T& other)' for merging pushes and
+// the Overflow_Coalesce policy.
+// -- ----------------------------------------------------------------------------------------------------------------------
+template <typename T, uint16_t DEPTH>
+class EventRingBuffer {
+  private:
+    static constexpr uint16_t SLOTS = DEPTH + 1;                      // One spare slot to tell a full queue from an empty one
+    static uint16_t next(uint16_t idx) { return (idx + 1 == SLOTS) ? 0 : idx + 1; }
+    static uint16_t prev(uint16_t idx) { return (idx == 0) ? SLOTS - 1 : idx - 1; }
+
+    T                       m_slots[SLOTS];
+    std::atomic<uint16_t>   m_head { 0 };                             // Next slot to write, only moved by producers
+    std::atomic<uint16_t>   m_tail { 0 };                             // Next slot to read, moved by consumer (or producer dropping oldest)
+    portMUX_TYPE            m_producerLock = portMUX_INITIALIZER_UNLOCKED;
+
+  public:
+    // Add an entry, reporting whether anything was lost.  With 'merge' an entry identical to the newest pending one is
+    // folded into it even when there is room.  Safe from ISR and task context.
+    pushResults push(const T& item, overflowPolicies policy, bool merge = false) {
+      pushResults result = Push_Stored;
+      portENTER_CRITICAL_SAFE(&m_producerLock);
+      uint16_t head = m_head.load(std::memory_order_relaxed);
+      uint16_t tail = m_tail.load(std::memory_order_relaxed);
+      bool full = next(head) == tail;
+      if((merge || (full && policy == Overflow_Coalesce)) && head != tail && item.coalescesWith(m_slots[prev(head)])) {
+        m_slots[prev(head)].mergeWith(item);
+        portEXIT_CRITICAL_SAFE(&m_producerLock);
+        return Push_Coalesced;
+      }
+      if(full) {                                                      // Queue is full, apply the overflow policy
+        if(policy != Overflow_DropOldest) {
+          portEXIT_CRITICAL_SAFE(&m_producerLock);
+          return Push_DroppedNewest;
+        }
+        m_tail.store(next(tail), std::memory_order_release);
+        result = Push_DroppedOldest;
+      }
+      m_slots[head] = item;
+      m_head.store(next(head), std::memory_order_release);
+      portEXIT_CRITICAL_SAFE(&m_producerLock);
+      return result;
+    }
+
+    // Remove the oldest entry into 'item', returns false if empty.  Single consumer only.
+    bool pop(T& item) {
+      if(isEmpty()) return false;                                     // Nothing to copy, don't contend with the producers
+      portENTER_CRITICAL_SAFE(&m_producerLock);
+      uint16_t tail = m_tail.load(std::memory_order_relaxed);
+      bool found = tail != m_head.load(std::memory_order_relaxed);
+      if(found) {
+        item = m_slots[tail];
+        m_tail.store(next(tail), std::memory_order_release);
+      }
+      portEXIT_CRITICAL_SAFE(&m_producerLock);
+      return found;
+    }
+
+    void clear(void) {
+      portENTER_CRITICAL_SAFE(&m_producerLock);
+      m_tail.store(m_head.load(std::memory_order_relaxed), std::memory_order_release);
+      portEXIT_CRITICAL_SAFE(&m_producerLock);
+    }
+
+    // Apply 'func' to every pending entry, eg to invalidate entries referring to an object being destroyed.
+    template <typename F>
+    void forEach(F func) {
+      portENTER_CRITICAL_SAFE(&m_producerLock);
+      for(uint16_t idx = m_tail.load(std::memory_order_acquire); idx != m_head.load(std::memory_order_relaxed); idx = next(idx))
+        func(m_slots[idx]);
+      portEXIT_CRITICAL_SAFE(&m_producerLock);
+    }
+
+    bool     isEmpty(void) const { return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire); }
+    uint16_t count(void) const {
+      uint16_t head = m_head.load(std::memory_order_acquire), tail = m_tail.load(std::memory_order_acquire);
+      return (head >= tail) ? head - tail : SLOTS - tail + head;
+    }
+    static constexpr uint16_t depth(void) { return DEPTH; }
+};
+
+#endif // INTERRUPTBUTTONQUEUE_H_
@@ -0,0 +1,69 @@
+#ifndef INTERRUPTBUTTONT_H_
+#define INTERRUPTBUTTONT_H_
+
+#include "InterruptButton.h"
+
+// -- Compile-time Button Configuration ------------------------------------------------------------------------------------
+// Derive from this and override the values you need, eg:
+//   struct PowerKey : InterruptButtonConfig {
+//     static constexpr uint8_t  Menus  = 1;
+//     static constexpr uint16_t Events = IB_EVENT_BIT(Event_KeyPress) | IB_EVENT_BIT(Event_LongKeyPress);
+//   };
+//   InterruptButtonT<PowerKey> powerButton(0, LOW);
+// The event queues are shared by every button, so their depths stay the class-wide ASYNC_EVENT_QUEUE_DEPTH and
+// SYNC_EVENT_QUEUE_DEPTH build flags (both statically allocated).
+// -- ----------------------------------------------------------------------------------------------------------------------
+struct InterruptButtonConfig {
+  static constexpr uint8_t      Menus          = 1;                   // Menu levels with their own actions on this button
+  static constexpr uint8_t      TargetPolls    = TARGET_POLLS;        // Polls to decide a press or release
+  static constexpr uint16_t     Events         = IB_COMPILED_EVENTS & ~IB_EVENT_BIT(Event_All);  // Events that may be enabled
+  static constexpr gpio_mode_t  PinMode        = GPIO_MODE_INPUT;
+  static constexpr uint16_t     LongKeyPressMS = 750;
+  static constexpr uint16_t     AutoRepeatMS   = 250;
+  static constexpr uint16_t     DoubleClickMS  = 333;
+  static constexpr uint32_t     DebounceUS     = 8000;
+};
+
+
+// -- Interrupt Button with compile-time configuration ---------------------------------------------------------------------
+// Same behaviour as InterruptButton, but the action table is sized by Config and held inside the object, so a statically
+// allocated InterruptButtonT never touches the heap for its actions, and timers for events outside Config::Events are
+// never created.  Features can be removed from the shared state machine code altogether with the INTERRUPTBUTTON_NO_*
+// build flags; a Config asking for a compiled out event is rejected at compile time.
+// -- ----------------------------------------------------------------------------------------------------------------------
+template <class Config = InterruptButtonConfig>
+class InterruptButtonT : public InterruptButton {
+  private:
+    static constexpr uint16_t POLL_INTERVAL_US = (Config::DebounceUS / Config::TargetPolls > 65535) ? 65535
+                                                                                                    : Config::DebounceUS / Config::TargetPolls;
+    static_assert(Config::Menus >= 1,                           "Config::Menus must be at least 1");
+    static_assert(Config::TargetPolls >= 1,                     "Config::TargetPolls must be at least 1");
+    static_assert((Config::Events & ~IB_COMPILED_EVENTS) == 0,  "Config::Events includes an event compiled out by an INTERRUPTBUTTON_NO_* flag");
+
+    func_ptr_t            m_actionStore[2][Config::Menus * NumEventTypes];  // Flat [menu level][event] tables: the own table,
+    ButtonActions         m_spareActions;                                   // and a spare bind() edits while the other is published
+
+  public:
+    InterruptButtonT(uint8_t pin, uint8_t pressedState) :
+      InterruptButton(pin, pressedState, Config::PinMode, Config::LongKeyPressMS, Config::AutoRepeatMS,
+                      Config::DoubleClickMS, Config::DebounceUS) {
+      m_spareActions.attach(m_actionStore[1], Config::Menus);
+      useStaticStorage(m_actionStore[0], &m_spareActions, Config::Menus, Config::TargetPolls, POLL_INTERVAL_US, Config::Events);
+    }
+    ~InterruptButtonT() {
+      teardown();                                                     // ISRs, timers and dispatchers let go of the tables first
+    }
+
+    using InterruptButton::bind;
+
+    template <events EVENT>                                           // Compile-time checked bind, eg btn.bind<Event_KeyPress>(0, action)
+    void bind(uint8_t menuLevel, func_ptr_t action) {
+      static_assert(EVENT < NumEventTypes && (Config::Events & IB_EVENT_BIT(EVENT)), "Event is not enabled in this button's Config");
+      InterruptButton::bind(EVENT, menuLevel, action);
+    }
+
+    static constexpr uint8_t  menuCount(void)   { return Config::Menus;       }
+    static constexpr uint8_t  targetPolls(void) { return Config::TargetPolls; }
+};
+
+#endif // INTERRUPTBUTTONT_H_
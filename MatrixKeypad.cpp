@@ -0,0 +1,167 @@
+#include "MatrixKeypad.h"
+
+#define ESP_INTR_FLAG_DEFAULT   0
+
+static const char* TAG = "IBKPD";             // IDF log tag
+
+
+// Constructor ------------------------------------------------------------------
+MatrixKeypad::MatrixKeypad(std::initializer_list<uint8_t> rowPins, std::initializer_list<uint8_t> colPins, uint32_t debounceUS) {
+  uint32_t intervalUS = debounceUS / TARGET_POLLS;          // Each scan is one debounce sample for every active key
+  m_scanIntervalUS = (intervalUS > 65535) ? 65535 : (intervalUS == 0) ? 1 : intervalUS;
+
+  bool valid = rowPins.size() > 0 && colPins.size() > 0 && rowPins.size() <= KEYPAD_MAX_LINES &&
+               colPins.size() <= KEYPAD_MAX_LINES && rowPins.size() * colPins.size() <= KEYPAD_MAX_KEYS;
+  if(!valid) ESP_LOGE(TAG, "A keypad needs 1 to %d rows and columns and at most %d keys!", KEYPAD_MAX_LINES, KEYPAD_MAX_KEYS);
+  for(uint8_t pin : rowPins) {
+    if(!valid) break;
+    if(!GPIO_IS_VALID_GPIO(pin)) { ESP_LOGE(TAG, "%d is not valid gpio on this platform", pin); valid = false; }
+    m_rowPins[m_rows++] = static_cast<gpio_num_t>(pin);
+  }
+  for(uint8_t pin : colPins) {
+    if(!valid) break;
+    if(!GPIO_IS_VALID_GPIO(pin)) { ESP_LOGE(TAG, "%d is not valid gpio on this platform", pin); valid = false; }
+    m_colPins[m_cols++] = static_cast<gpio_num_t>(pin);
+    m_colMask |= BIT64(pin);
+  }
+  if(!valid) { m_rows = 0; m_cols = 0; m_colMask = 0; }     // begin() will refuse, key() still returns a (never fed) key
+  for(uint8_t idx = 0; idx < m_rows * m_cols || idx == 0; idx++) m_keys[idx] = new InterruptButton(Debounce_External, debounceUS);
+}
+
+// Destructor --------------------------------------------------------------------
+MatrixKeypad::~MatrixKeypad() {
+  if(m_scanTimer) {
+    esp_timer_stop(m_scanTimer);
+    esp_timer_delete(m_scanTimer);
+  }
+  if(m_begun) {
+    for(uint8_t c = 0; c < m_cols; c++) {
+      gpio_isr_handler_remove(m_colPins[c]);
+      gpio_wakeup_disable(m_colPins[c]);
+      gpio_reset_pin(m_colPins[c]);
+    }
+    for(uint8_t r = 0; r < m_rows; r++) gpio_reset_pin(m_rowPins[r]);
+  }
+  for(uint8_t idx = 0; idx < KEYPAD_MAX_KEYS; idx++) delete m_keys[idx];
+}
+
+// Initialiser -------------------------------------------------------------------
+bool MatrixKeypad::begin(void) {
+  if(m_begun) return true;
+  if(m_rows == 0) {
+    ESP_LOGE(TAG, "Keypad was not constructed with valid pins!");
+    return false;
+  }
+  esp_timer_create_args_t tmrConfig = {};
+    tmrConfig.arg = reinterpret_cast<void*>(this);
+    tmrConfig.callback = &scan;
+    tmrConfig.dispatch_method = ESP_TIMER_TASK;
+    tmrConfig.name = "IB_kpdScan";
+  if(esp_timer_create(&tmrConfig, &m_scanTimer) != ESP_OK) {
+    ESP_LOGE(TAG, "Failed to create keypad scan timer!");
+    m_scanTimer = nullptr;
+    return false;
+  }
+
+  esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT);   // May already be installed by a button
+  if(err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    ESP_LOGE(TAG, "GPIO ISR service install failed with exit status: %d", err);
+    return false;
+  }
+
+  gpio_config_t gpio_conf = {};                             // Rows only ever pull low, so keys held in the same column
+    gpio_conf.mode = GPIO_MODE_INPUT_OUTPUT_OD;             // on different rows can't short a driven row to another
+    for(uint8_t r = 0; r < m_rows; r++) gpio_conf.pin_bit_mask |= BIT64(m_rowPins[r]);
+    gpio_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    gpio_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpio_conf.intr_type = GPIO_INTR_DISABLE;
+  gpio_config(&gpio_conf);
+
+  gpio_conf.mode = GPIO_MODE_INPUT;                         // Columns idle high, a closed key on a driven row pulls them low
+    gpio_conf.pin_bit_mask = m_colMask;
+    gpio_conf.pull_up_en = GPIO_PULLUP_ENABLE;
+    gpio_conf.intr_type = GPIO_INTR_NEGEDGE;
+  gpio_config(&gpio_conf);
+  for(uint8_t c = 0; c < m_cols; c++) {
+    gpio_intr_disable(m_colPins[c]);
+    gpio_isr_handler_add(m_colPins[c], &columnISR, reinterpret_cast<void*>(this));
+  }
+  m_begun = true;
+  armIdle();
+  return true;
+}
+
+
+//-- SCANNING --------------------------------------------------------------------------------------------
+
+//-- Drive every row so any key closing pulls its column low, then wait on the column interrupts ---------
+void IRAM_ATTR MatrixKeypad::armIdle(void) {
+  esp_timer_stop(m_scanTimer);
+  m_scanning = false;
+  for(uint8_t r = 0; r < m_rows; r++) gpio_set_level(m_rowPins[r], 0);
+  ibhal_delay_us(KEYPAD_SETTLE_US);
+  bool wakeup = InterruptButton::getLowPowerMode();         // Only a level interrupt can wake the chip from light sleep
+  for(uint8_t c = 0; c < m_cols; c++) {
+    if(wakeup) {
+      gpio_wakeup_enable(m_colPins[c], GPIO_INTR_LOW_LEVEL);
+    } else {
+      gpio_wakeup_disable(m_colPins[c]);
+      gpio_set_intr_type(m_colPins[c], GPIO_INTR_NEGEDGE);
+    }
+    gpio_intr_enable(m_colPins[c]);
+  }
+  if((ibhal_read_inputs() & m_colMask) != m_colMask) columnISR(this);  // A key closed before the interrupts were armed
+}
+
+//-- Column interrupt, only armed while idle -------------------------------------------------------------
+void IRAM_ATTR MatrixKeypad::columnISR(void* arg) {
+  MatrixKeypad* kpd = reinterpret_cast<MatrixKeypad*>(arg);
+  if(kpd->m_scanning) return;
+  kpd->m_scanning = true;
+  for(uint8_t c = 0; c < kpd->m_cols; c++) gpio_intr_disable(kpd->m_colPins[c]);
+  esp_timer_start_periodic(kpd->m_scanTimer, kpd->m_scanIntervalUS);   // First sample one interval after the edge
+}
+
+//-- Scan timer callback, reads the whole matrix and advances the keys that need it ----------------------
+void MatrixKeypad::scan(void* arg) {
+  MatrixKeypad* kpd = reinterpret_cast<MatrixKeypad*>(arg);
+
+  uint64_t closed = 0;                                      // Bit per key whose contact is closed
+  for(uint8_t r = 0; r < kpd->m_rows; r++) gpio_set_level(kpd->m_rowPins[r], 1);
+  for(uint8_t r = 0; r < kpd->m_rows; r++) {
+    gpio_set_level(kpd->m_rowPins[r], 0);
+    ibhal_delay_us(KEYPAD_SETTLE_US);
+    uint64_t levels = ~ibhal_read_inputs();                 // Bit set where a column is pulled low
+    gpio_set_level(kpd->m_rowPins[r], 1);
+    for(uint8_t c = 0; c < kpd->m_cols; c++)
+      if(levels & BIT64(kpd->m_colPins[c])) closed |= BIT64(r * kpd->m_cols + c);
+  }
+
+  InterruptButton::feedKeys(kpd->m_keys, closed, kpd->m_activeKeys, kpd->m_pressedKeys);
+
+  if(closed == 0 && kpd->m_activeKeys == 0 && kpd->m_pressedKeys == 0) kpd->armIdle();   // All released and settled
+}
+
+
+//-- KEY ACCESS ------------------------------------------------------------------------------------------
+InterruptButton& MatrixKeypad::key(uint8_t row, uint8_t col) {
+  if(m_rows == 0) return *m_keys[0];
+  if(row >= m_rows || col >= m_cols) {
+    ESP_LOGE(TAG, "Key %d,%d is outside the %dx%d keypad!", row, col, m_rows, m_cols);
+    row = 0; col = 0;
+  }
+  return *m_keys[row * m_cols + col];
+}
+
+InterruptButton& MatrixKeypad::key(uint8_t index) {
+  if(m_rows == 0) return *m_keys[0];
+  if(index >= m_rows * m_cols) {
+    ESP_LOGE(TAG, "Key %d is outside the %d key keypad!", index, m_rows * m_cols);
+    index = 0;
+  }
+  return *m_keys[index];
+}
+
+uint64_t MatrixKeypad::getPressedMask(void) {
+  return m_pressedKeys;
+}
@@ -0,0 +1,61 @@
+#ifndef MATRIXKEYPAD_H_
+#define MATRIXKEYPAD_H_
+
+#include "InterruptButton.h"
+#include <initializer_list>
+
+#define KEYPAD_MAX_LINES          16    // Most row (or column) pins a keypad may use
+#define KEYPAD_MAX_KEYS           64    // Most keys a keypad may have (rows x columns), ie one bit each in a uint64_t
+#define KEYPAD_SETTLE_US          2     // Time for the column lines to follow a newly driven row before they are read
+
+
+// -- Matrix Keypad --------------------------------------------------------------------------------------------------------
+// Rows are open-drain outputs and columns are pulled-up inputs, so a closed key pulls its column low while its row is
+// driven low.  When idle every row is driven low and any column falling wakes the keypad through its interrupt; from then
+// on one periodic timer scans the matrix (a row at a time, one register read per row) until every key is released and
+// settled again.  Each key is an InterruptButton fed from the scan instead of its own gpio and ISR, so it has the same
+// debounce, longPress, autoRepeat, double-click, menu level and queue behaviour as any other button and is bound the same
+// way, eg keypad.key(1, 2).bind(Event_KeyPress, action).  A scan costs one read per row plus work only for keys that have
+// changed or are being debounced, so the per-scan CPU time is bounded regardless of how many keys are held.
+//
+// In InterruptButton's low power mode the idle columns wait on level interrupts instead, so a key press also wakes the chip
+// from light sleep (from the next time the keypad goes idle).
+//
+// Without a diode per key, three keys held at the corners of a rectangle make the fourth corner appear pressed (ghosting).
+// -- ----------------------------------------------------------------------------------------------------------------------
+class MatrixKeypad {
+  private:
+    static void columnISR(void* arg);                                 // Any column fell while idle, start scanning
+    static void scan(void* arg);                                      // Scan timer callback, samples every key and feeds them
+    void        armIdle(void);                                        // Drive all rows, re-arm column interrupts and stop scanning
+
+    gpio_num_t          m_rowPins[KEYPAD_MAX_LINES];
+    gpio_num_t          m_colPins[KEYPAD_MAX_LINES];
+    uint8_t             m_rows = 0;
+    uint8_t             m_cols = 0;
+    uint64_t            m_colMask = 0;                                // Bit per column gpio
+    InterruptButton*    m_keys[KEYPAD_MAX_KEYS] = { nullptr };        // Key index is row * columns + column
+    uint64_t            m_activeKeys = 0;                             // Bit per key being debounced (confirming press or release)
+    uint64_t            m_pressedKeys = 0;                            // Bit per key whose debounced state is pressed
+    esp_timer_handle_t  m_scanTimer = nullptr;
+    uint16_t            m_scanIntervalUS;
+    volatile bool       m_scanning = false;
+    bool                m_begun = false;
+
+  public:
+    MatrixKeypad(std::initializer_list<uint8_t> rowPins,              // Row pins (driven) and column pins (read), eg 8 + 8 for 64 keys
+                 std::initializer_list<uint8_t> colPins,
+                 uint32_t debounceUS = 8000);                         // Scanned every debounceUS / TARGET_POLLS while a key is active
+    ~MatrixKeypad();
+
+    bool              begin(void);                                    // Configure pins, interrupts and the scan timer
+    InterruptButton&  key(uint8_t row, uint8_t col);                  // The key at a row and column, bind its events like any button
+    InterruptButton&  key(uint8_t index);                             // The key at row * columns + column
+    uint8_t           rowCount(void)    { return m_rows;          }
+    uint8_t           colCount(void)    { return m_cols;          }
+    uint8_t           keyCount(void)    { return m_rows * m_cols; }
+    uint64_t          getPressedMask(void);                           // Bit per key (row * columns + column) currently pressed
+    bool              isScanning(void)  { return m_scanning;      }
+};
+
+#endif // MATRIXKEYPAD_H_
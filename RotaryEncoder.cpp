@@ -0,0 +1,152 @@
+#include "RotaryEncoder.h"
+
+static const char* TAG = "IBENC";             // IDF log tag
+
+// Direction of each quadrature transition, indexed by (previous AB << 2) | new AB with A in bit 1.  Clockwise (A leading
+// B) runs 11 -> 01 -> 00 -> 10 -> 11.  Unchanged levels give 0, as do both-lines-changed transitions (direction unknown).
+static const int8_t DRAM_ATTR quadratureSteps[16] = { 0, -1,  1,  0,
+                                                      1,  0,  0, -1,
+                                                     -1,  0,  0,  1,
+                                                      0,  1, -1,  0 };
+
+
+// Constructor ------------------------------------------------------------------
+RotaryEncoder::RotaryEncoder(uint8_t pinA, uint8_t pinB, uint8_t stepsPerDetent, bool pullUp) :
+                             m_pinA(static_cast<gpio_num_t>(pinA)),
+                             m_pinB(static_cast<gpio_num_t>(pinB)),
+                             m_pullUp(pullUp),
+                             m_stepsPerDetent((stepsPerDetent == 0) ? 1 : (stepsPerDetent > 64) ? 64 : stepsPerDetent),
+                             m_restState(pullUp ? 3 : 0) {
+}
+
+// Destructor --------------------------------------------------------------------
+RotaryEncoder::~RotaryEncoder() {
+  if(!m_begun) return;
+  gpio_isr_handler_remove(m_pinA);
+  gpio_isr_handler_remove(m_pinB);
+  InterruptButton::m_encoders[m_id] = nullptr;
+  auto forget = [this](buttonEvent_t &evt) { if(evt.source == Source_Encoder && evt.id == m_id) evt.id = 0xFF; };
+  for(uint8_t lane = 0; lane < DISPATCH_LANES; lane++)      // Any step records still queued are skipped, not given to
+    InterruptButton::m_lanes[lane].queue.forEach(forget);   // an encoder later begun in the same slot
+  InterruptButton::m_syncEventQueue.forEach(forget);
+  ButtonActions* table = m_actions.exchange(nullptr);
+  if(table != nullptr) {
+    InterruptButton::retireActions(table);
+    table->m_next = m_retired;
+    m_retired = table;
+  }
+  InterruptButton::awaitReaders();                          // An ISR or dispatcher that found this encoder has let go,
+  ButtonActions::freeRetired(m_retired, true);              // then the tables are freed once no action is running from them
+}
+
+// Initialiser -------------------------------------------------------------------
+bool RotaryEncoder::begin(void) {
+  if(m_begun) return true;
+  if(!GPIO_IS_VALID_GPIO(m_pinA) || !GPIO_IS_VALID_GPIO(m_pinB) || m_pinA == m_pinB ||
+     static_cast<uint8_t>(m_pinA) >= 64 || static_cast<uint8_t>(m_pinB) >= 64) {
+    ESP_LOGE(TAG, "An encoder needs two different, valid gpio's!");
+    return false;
+  }
+  for(uint8_t slot = 0; slot < MAX_ENCODERS; slot++) {
+    if(InterruptButton::m_encoders[slot] == nullptr) { m_id = slot; break; }
+  }
+  if(m_id == 0xFF) {
+    ESP_LOGE(TAG, "No room for another encoder, increase MAX_ENCODERS!");
+    return false;
+  }
+  InterruptButton::initialiseClass();                       // Steps use the button queues, lanes and menu levels
+  m_menus = InterruptButton::m_numMenus;
+
+  gpio_config_t gpio_conf = {};
+    gpio_conf.mode = GPIO_MODE_INPUT;
+    gpio_conf.pin_bit_mask = BIT64(static_cast<uint8_t>(m_pinA)) | BIT64(static_cast<uint8_t>(m_pinB));
+    gpio_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpio_conf.pull_up_en = (m_pullUp) ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
+    gpio_conf.intr_type = GPIO_INTR_ANYEDGE;
+  gpio_config(&gpio_conf);
+  uint64_t levels = ibhal_read_inputs();
+  m_state = (((levels >> m_pinA) & 1) << 1) | ((levels >> m_pinB) & 1);
+  m_transitions = quadratureSteps[(m_restState << 2) | m_state];   // Transitions already made from the detent, if between two
+  InterruptButton::m_encoders[m_id] = this;
+  m_begun = true;
+  gpio_isr_handler_add(m_pinA, RotaryEncoder::decode, reinterpret_cast<void*>(this));
+  gpio_isr_handler_add(m_pinB, RotaryEncoder::decode, reinterpret_cast<void*>(this));
+  return true;
+}
+
+
+//-- INTERRUPT SERVICE ROUTINE ---------------------------------------------------------------------------
+// Both pins are sampled in one register read, so the pair is always consistent even when the ISR runs late.  Bounce on
+// one line just steps back and forth between two neighbouring states, adding and cancelling transitions.  Back at the
+// rest state the count is realigned, so a missed edge costs at most the step it happened in.
+void IRAM_ATTR RotaryEncoder::decode(void* arg) {
+  RotaryEncoder* enc = reinterpret_cast<RotaryEncoder*>(arg);
+  IB_STATS_ONLY(InterruptButton::callbackTimer timing);
+  InterruptButton::readerGuard reading;                       // The destructor waits for this ISR to finish with 'enc'
+  uint64_t levels = ibhal_read_inputs();
+  uint8_t state = (((levels >> enc->m_pinA) & 1) << 1) | ((levels >> enc->m_pinB) & 1);
+  uint8_t transition = (enc->m_state << 2) | state;
+  enc->m_state = state;
+  if(state == (transition >> 2)) return;                      // Other line's edge already handled, or a glitch gone again
+  int8_t transitions = enc->m_transitions;
+  if((state ^ (transition >> 2)) == 3) enc->m_skipped++;      // Both lines changed: an edge was missed, direction unknown
+  else transitions += quadratureSteps[transition];
+  int16_t steps = 0;
+  if(transitions >= enc->m_stepsPerDetent)       steps = 1;
+  else if(transitions <= -enc->m_stepsPerDetent) steps = -1;
+  else if(state == enc->m_restState && transitions != 0) steps = (transitions > 0) ? 1 : -1;   // Short of a whole step
+  if(steps != 0 || state == enc->m_restState) transitions = 0;
+  enc->m_transitions = transitions;
+  if(steps != 0) {
+    enc->m_position += steps;
+    enc->raiseSteps(steps);
+  }
+}
+
+void IRAM_ATTR RotaryEncoder::raiseSteps(int16_t steps) {
+  uint8_t menuLevel = InterruptButton::m_menuLevel;
+  if(!hasAction(menuLevel)) return;                           // Position still counts, nothing to action
+  int32_t delta = steps + m_unsent;
+  buttonEvent_t evt;
+    evt.btn = nullptr;
+    evt.event = Event_Step;
+    evt.menuLevel = menuLevel;
+    evt.source = Source_Encoder;
+    evt.id = m_id;
+    evt.clicks = 0;
+    evt.longMask = 0;
+    evt.timeUS = esp_timer_get_time();
+    evt.durationUS = 0;
+    evt.count = 1;
+    evt.delta = (delta > INT16_MAX) ? INT16_MAX : (delta < INT16_MIN) ? INT16_MIN : delta;
+  pushResults result = InterruptButton::enqueue(evt, InterruptButton::m_mode == Mode_Asynchronous);
+  m_unsent = (result == Push_DroppedNewest) ? evt.delta : 0;  // Carried into the next step record
+}
+
+
+//-- BINDING AND SETTINGS --------------------------------------------------------------------------------
+void RotaryEncoder::bind(uint8_t menuLevel, func_ptr_t action) {
+  if(!begin()) return;
+  if(menuLevel >= m_menus) {
+    ESP_LOGE(TAG, "Specified menu level is greater than the number of menus!");
+    return;
+  }
+  ButtonActions::publishColumn(m_actions, m_retired, m_menus, menuLevel, action);
+}
+
+void RotaryEncoder::unbind(uint8_t menuLevel) {
+  if(m_begun && menuLevel < m_menus) ButtonActions::publishColumn(m_actions, m_retired, m_menus, menuLevel, nullptr);
+}
+
+void RotaryEncoder::setLane(uint8_t lane) {
+  if(lane >= DISPATCH_LANES) {
+    ESP_LOGE(TAG, "setLane(): Lane %d does not exist, DISPATCH_LANES is %d", lane, DISPATCH_LANES);
+    return;
+  }
+  m_lane = lane;
+  InterruptButton::useLane(lane);
+}
+
+void RotaryEncoder::setPosition(int32_t position) {
+  m_position = position;
+}
@@ -0,0 +1,77 @@
+#ifndef ROTARYENCODER_H_
+#define ROTARYENCODER_H_
+
+#include "InterruptButton.h"
+
+#define ENCODER_STEPS_PER_DETENT  4     // Default quadrature transitions per click (most detented encoders rest at every 4th)
+#define ENCODER_STEP_COLUMN       IB_SINGLE_COLUMN          // Step actions are the only column of an encoder's action table
+
+
+// -- Rotary Encoder -------------------------------------------------------------------------------------------------------
+// Quadrature (A/B) encoder decoded in the gpio ISR: both pins interrupt on any edge, one register read samples them
+// together, and a 16 entry table indexed by the previous and new A/B state gives the direction of each transition (or
+// none, for contact bounce or a repeated level), so bounce cancels itself out and the ISR does a fixed, tiny amount of work
+// per edge however fast the shaft turns.  Transitions where both lines changed at once are counted as skipped edges.
+//
+// Every stepsPerDetent transitions make one step.  Steps are raised as Event_Step records (Source_Encoder) on the same
+// queues as InterruptButton events, in the order they happened relative to button events, and are always merged into
+// the newest waiting record while it is this encoder's: a slow consumer sees one record with the summed, signed delta
+// (currentEvent().delta, clockwise - A leading B - positive) rather than a flood of single steps.  A step that finds the
+// queue full (drop-newest policy) is kept and added to the next record.  Bind an action per menu level, eg
+// encoder.bind([]() { volume += InterruptButton::currentEvent().delta; }).  Steps follow setMode() like keyPress (queued
+// for processSyncEvents() in the hybrid and sync modes) and use lane 0 unless moved with setLane().
+//
+// A missed edge leaves the count between detents, so it is realigned each time the encoder is back at its rest state
+// (both lines high with pull-ups, low without): a partial count there becomes one step in its direction.  bind() never
+// edits the actions in place, it publishes a new table in one atomic swap (see ButtonActions), so it is safe while the
+// encoder turns.
+//
+// In InterruptButton's low power mode the encoder keeps its edge interrupts, which can't wake the chip from light sleep.
+// -- ----------------------------------------------------------------------------------------------------------------------
+class RotaryEncoder {
+  friend class InterruptButton;                                       // Resolves Event_Step records to the bound action
+
+  private:
+    static void decode(void* arg);                                    // gpio ISR of both pins, advances the quadrature state
+    void        raiseSteps(int16_t steps);                            // Queues (or merges) a step record (caller holds a readerGuard)
+    inline bool hasAction(uint8_t menuLevel) {                        // (caller holds a readerGuard)
+      ButtonActions* table = m_actions.load(std::memory_order_acquire);
+      return table != nullptr && table->has(menuLevel, ENCODER_STEP_COLUMN);
+    }
+
+    gpio_num_t          m_pinA;
+    gpio_num_t          m_pinB;
+    bool                m_pullUp;
+    uint8_t             m_stepsPerDetent;
+    uint8_t             m_restState;                                  // A/B levels at a detent
+    uint8_t             m_id = 0xFF;                                  // Slot in InterruptButton's encoder table once begun
+    uint8_t             m_lane = 0;
+    volatile uint8_t    m_state = 0;                                  // Last A/B levels, A in bit 1
+    volatile int8_t     m_transitions = 0;                            // Transitions towards the next step (signed)
+    volatile int16_t    m_unsent = 0;                                 // Steps not yet queued (the queue was full)
+    volatile int32_t    m_position = 0;                               // Steps since begin() or setPosition()
+    volatile uint32_t   m_skipped = 0;                                // Transitions where both lines changed between two edges
+    std::atomic<ButtonActions*> m_actions { nullptr };                // Published step actions, one per menu level
+    ButtonActions*      m_retired = nullptr;                          // Withdrawn tables, freed once inUse() is false
+    uint8_t             m_menus = 0;
+    bool                m_begun = false;
+
+  public:
+    RotaryEncoder(uint8_t pinA, uint8_t pinB,
+                  uint8_t stepsPerDetent = ENCODER_STEPS_PER_DETENT,  // 4 for most detented encoders, 2 or 1 for half or quarter steps
+                  bool pullUp = true);                                // Enable the internal pull-ups (common pin to ground)
+    ~RotaryEncoder();
+
+    bool            begin(void);                                      // Configure pins and interrupts (also run by the first bind())
+    void            bind(uint8_t menuLevel, func_ptr_t action);       // Action run for each step record at a given menu level
+    inline void     bind(func_ptr_t action) { bind(InterruptButton::getMenuLevel(), action); }
+    void            unbind(uint8_t menuLevel);
+    inline void     unbind(void) { unbind(InterruptButton::getMenuLevel()); }
+    void            setLane(uint8_t lane);                            // Async step records are actioned by this lane's task
+    uint8_t         getLane(void)         { return m_lane;     }
+    int32_t         getPosition(void)     { return m_position; }      // Steps counted by the ISR, bound or not
+    void            setPosition(int32_t position);
+    uint32_t        getSkippedEdges(void) { return m_skipped;  }      // Turned faster than the ISR could follow
+};
+
+#endif // ROTARYENCODER_H_
@@ -0,0 +1,223 @@
+#include "ButtonSimulator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+ButtonSimulator::ButtonSimulator() {
+  SimHAL::reset();
+}
+
+//-- WAVEFORM SCRIPTING ----------------------------------------------------------------------------------
+void ButtonSimulator::setLevel(gpio_num_t pin, int64_t timeUS, uint8_t level) {
+  addEdge({ timeUS, pin, static_cast<uint8_t>(level ? 1 : 0), GPIO_NUM_NC });
+}
+
+void ButtonSimulator::setLevels(gpio_num_t pinA, uint8_t levelA, gpio_num_t pinB, uint8_t levelB, int64_t timeUS) {
+  addEdge({ timeUS, pinA, static_cast<uint8_t>(levelA ? 1 : 0), GPIO_NUM_NC, -1, pinB, static_cast<uint8_t>(levelB ? 1 : 0) });
+}
+
+void ButtonSimulator::setContact(gpio_num_t row, gpio_num_t col, int64_t timeUS, bool closed) {
+  addEdge({ timeUS, col, static_cast<uint8_t>(closed ? 1 : 0), row });
+}
+
+void ButtonSimulator::addEdge(const simEdge_t &edge) {
+  auto pos = std::upper_bound(m_edges.begin() + m_nextEdge, m_edges.end(), edge,
+                              [](const simEdge_t &a, const simEdge_t &b) { return a.timeUS < b.timeUS; });
+  m_edges.insert(pos, edge);
+}
+
+uint8_t ButtonSimulator::levelAt(gpio_num_t pin, int64_t timeUS) {
+  uint8_t level = SimHAL::getPinLevel(pin);
+  for(size_t i = m_nextEdge; i < m_edges.size() && m_edges[i].timeUS <= timeUS; i++)
+    if(m_edges[i].row == GPIO_NUM_NC && m_edges[i].analog < 0) {
+      if(m_edges[i].pin == pin)  level = m_edges[i].level;
+      if(m_edges[i].pin2 == pin) level = m_edges[i].level2;
+    }
+  return level;
+}
+
+void ButtonSimulator::bounce(gpio_num_t pin, int64_t timeUS, uint8_t toLevel, uint32_t spanUS, uint8_t edges, uint32_t seed) {
+  bounceLine(pin, GPIO_NUM_NC, timeUS, toLevel, spanUS, edges, seed);
+}
+
+std::vector<uint32_t> ButtonSimulator::bounceOffsets(uint32_t spanUS, uint8_t edges, uint32_t seed) {
+  std::vector<uint32_t> offsets;
+  uint32_t rng = seed ? seed : 1;
+  for(uint8_t i = 0; i < edges && spanUS > 0; i++) {
+    rng = rng * 1664525UL + 1013904223UL;                       // Deterministic LCG so a seed always gives the same profile
+    offsets.push_back((rng >> 8) % spanUS);
+  }
+  std::sort(offsets.begin(), offsets.end());
+  return offsets;
+}
+
+void ButtonSimulator::bounceLine(gpio_num_t pin, gpio_num_t row, int64_t timeUS, uint8_t toLevel, uint32_t spanUS,
+                                 uint8_t edges, uint32_t seed) {
+  uint8_t fromLevel = toLevel ? 0 : 1;
+  std::vector<uint32_t> offsets = bounceOffsets(spanUS, edges, seed);
+  for(size_t i = 0; i < offsets.size(); i++)                    // Toggle, starting towards the new level
+    addEdge({ timeUS + offsets[i], pin, static_cast<uint8_t>((i % 2 == 0) ? toLevel : fromLevel), row });
+  addEdge({ timeUS + spanUS, pin, toLevel, row });
+}
+
+void ButtonSimulator::bounceAnalog(gpio_num_t pin, int64_t timeUS, uint16_t toCounts, uint16_t fromCounts, uint32_t spanUS,
+                                   uint8_t edges, uint32_t seed) {
+  std::vector<uint32_t> offsets = bounceOffsets(spanUS, edges, seed);
+  for(size_t i = 0; i < offsets.size(); i++)
+    setAnalog(pin, timeUS + offsets[i], (i % 2 == 0) ? toCounts : fromCounts);
+  setAnalog(pin, timeUS + spanUS, toCounts);
+}
+
+void ButtonSimulator::spike(gpio_num_t pin, int64_t timeUS, uint32_t widthUS) {
+  uint8_t level = levelAt(pin, timeUS);
+  setLevel(pin, timeUS, !level);
+  setLevel(pin, timeUS + widthUS, level);
+}
+
+void ButtonSimulator::press(gpio_num_t pin, uint8_t pressedState, int64_t timeUS, uint32_t holdUS,
+                            uint32_t bounceUS, uint8_t bounceEdges, uint32_t seed) {
+  bounce(pin, timeUS, pressedState, bounceUS, bounceEdges, seed);
+  bounce(pin, timeUS + holdUS, !pressedState, bounceUS, bounceEdges, seed * 7 + 3);
+}
+
+void ButtonSimulator::pressKey(gpio_num_t row, gpio_num_t col, int64_t timeUS, uint32_t holdUS,
+                               uint32_t bounceUS, uint8_t bounceEdges, uint32_t seed) {
+  bounceLine(col, row, timeUS, 1, bounceUS, bounceEdges, seed);
+  bounceLine(col, row, timeUS + holdUS, 0, bounceUS, bounceEdges, seed * 7 + 3);
+}
+
+int64_t ButtonSimulator::rotate(gpio_num_t pinA, gpio_num_t pinB, int64_t timeUS, int16_t detents, uint32_t edgeUS,
+                                uint8_t stepsPerDetent) {
+  static const uint8_t clockwise[4] = { 3, 1, 0, 2 };          // A/B levels (A in bit 1) in clockwise order
+  uint8_t levels = (levelAt(pinA, timeUS) << 1) | levelAt(pinB, timeUS);
+  uint8_t phase = 0;
+  while(clockwise[phase] != levels) phase++;                    // Carry on from wherever the last rotation stopped
+  int32_t edges = (detents < 0 ? -detents : detents) * stepsPerDetent;
+  for(int32_t edge = 0; edge < edges; edge++) {
+    uint8_t from = clockwise[phase];
+    phase = (detents > 0) ? (phase + 1) & 3 : (phase + 3) & 3;
+    uint8_t to = clockwise[phase];
+    if((from ^ to) & 2) setLevel(pinA, timeUS, to >> 1);
+    else                setLevel(pinB, timeUS, to & 1);
+    if(edge + 1 < edges) timeUS += edgeUS;
+  }
+  return timeUS;
+}
+
+void ButtonSimulator::setAnalog(gpio_num_t pin, int64_t timeUS, uint16_t counts) {
+  addEdge({ timeUS, pin, 0, GPIO_NUM_NC, counts });
+}
+
+void ButtonSimulator::pressAnalog(gpio_num_t pin, uint16_t counts, uint16_t idleCounts, int64_t timeUS, uint32_t holdUS,
+                                  uint32_t bounceUS, uint8_t bounceEdges, uint32_t seed) {
+  bounceAnalog(pin, timeUS, counts, idleCounts, bounceUS, bounceEdges, seed);
+  bounceAnalog(pin, timeUS + holdUS, idleCounts, counts, bounceUS, bounceEdges, seed * 7 + 3);
+}
+
+bool ButtonSimulator::loadProfile(const char* path, gpio_num_t pin, int64_t offsetUS, int64_t* endUS) {
+  FILE* file = fopen(path, "r");
+  if(file == nullptr) return false;
+  char line[128];
+  int64_t lastUS = offsetUS;
+  while(fgets(line, sizeof(line), file)) {
+    char* text = line + strspn(line, " \t");
+    if(*text == '#' || *text == '\n' || *text == '\0') continue;
+    long long timeUS;
+    unsigned level;
+    if(sscanf(text, "end %lld", &timeUS) == 1) {
+      if(endUS) *endUS = offsetUS + timeUS;
+    } else if(sscanf(text, "%lld %u", &timeUS, &level) == 2) {
+      setLevel(pin, offsetUS + timeUS, level);
+      lastUS = std::max<int64_t>(lastUS, offsetUS + timeUS);
+    } else {
+      fprintf(stderr, "%s: ignoring unrecognised line: %s", path, line);
+    }
+  }
+  fclose(file);
+  if(endUS && *endUS < lastUS) *endUS = lastUS;
+  return true;
+}
+
+
+//-- EXECUTION -------------------------------------------------------------------------------------------
+void ButtonSimulator::setMainLoopPeriod(uint32_t periodUS, uint16_t maxEvents) {
+  m_loopPeriodUS = periodUS;
+  m_loopMaxEvents = maxEvents;
+  m_nextLoopUS = SimHAL::now() + periodUS;
+}
+
+void ButtonSimulator::run(int64_t untilUS) {
+  while(true) {
+    int64_t nextUS = untilUS;
+    if(m_nextEdge < m_edges.size()) nextUS = std::min(nextUS, m_edges[m_nextEdge].timeUS);
+    if(m_loopPeriodUS)               nextUS = std::min(nextUS, m_nextLoopUS);
+    SimHAL::advanceTo(nextUS);                                  // Timers due at or before an edge fire first
+
+    bool acted = false;
+    while(m_nextEdge < m_edges.size() && m_edges[m_nextEdge].timeUS <= nextUS) {
+      const simEdge_t &edge = m_edges[m_nextEdge];
+      if(edge.analog >= 0)              SimHAL::setAnalogLevel(edge.pin, edge.analog);
+      else if(edge.pin2 != GPIO_NUM_NC) SimHAL::setPinLevels(edge.pin, edge.level, edge.pin2, edge.level2);
+      else if(edge.row == GPIO_NUM_NC)  SimHAL::setPinLevel(edge.pin, edge.level);
+      else                              SimHAL::setContact(edge.row, edge.pin, edge.level);
+      m_nextEdge++;
+      acted = true;
+    }
+    if(m_loopPeriodUS && m_nextLoopUS <= nextUS) {
+      InterruptButton::processSyncEvents(m_loopMaxEvents);
+      m_nextLoopUS += m_loopPeriodUS;
+      acted = true;
+    }
+    if(!acted && nextUS >= untilUS) break;
+  }
+}
+
+
+//-- RECORDING -------------------------------------------------------------------------------------------
+void ButtonSimulator::record(InterruptButton &btn, const char* name, uint16_t eventMask, uint8_t menuLevel) {
+  for(uint8_t evt = 0; evt < NumEventTypes; evt++) {
+    if(!(eventMask & (1U << evt))) continue;
+    btn.bind(static_cast<events>(evt), menuLevel, [this, name]() {
+      const buttonEvent_t &raised = InterruptButton::currentEvent();
+      simEvent_t entry = { SimHAL::now(), raised.timeUS, raised.durationUS, name, raised.event, raised.menuLevel,
+                           raised.count, raised.id, raised.clicks, raised.longMask, raised.delta };
+      std::lock_guard<std::mutex> lock(m_eventsLock);
+      m_events.push_back(entry);
+    });
+  }
+}
+
+void ButtonSimulator::record(RotaryEncoder &encoder, const char* name, uint8_t menuLevel) {
+  encoder.bind(menuLevel, [this, name]() {
+    const buttonEvent_t &raised = InterruptButton::currentEvent();
+    simEvent_t entry = { SimHAL::now(), raised.timeUS, raised.durationUS, name, raised.event, raised.menuLevel,
+                         raised.count, raised.id, raised.clicks, raised.longMask, raised.delta };
+    std::lock_guard<std::mutex> lock(m_eventsLock);
+    m_events.push_back(entry);
+  });
+}
+
+std::vector<simEvent_t> ButtonSimulator::recorded(void) {
+  std::lock_guard<std::mutex> lock(m_eventsLock);
+  return m_events;
+}
+
+void ButtonSimulator::clearEvents(void) {
+  std::lock_guard<std::mutex> lock(m_eventsLock);
+  m_events.clear();
+}
+
+const char* ButtonSimulator::eventName(events event) {
+  switch(event) {
+    case Event_KeyDown:         return "keyDown";
+    case Event_KeyUp:           return "keyUp";
+    case Event_KeyPress:        return "keyPress";
+    case Event_LongKeyPress:    return "longKeyPress";
+    case Event_AutoRepeatPress: return "autoRepeatPress";
+    case Event_DoubleClick:     return "doubleClick";
+    case Event_Pattern:         return "pattern";
+    case Event_Step:            return "step";
+    default:                    return "unknown";
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef BUTTONSIMULATOR_H_
+#define BUTTONSIMULATOR_H_
+
+#include "InterruptButton.h"
+#include "RotaryEncoder.h"
+#include <mutex>
+#include <vector>
+
+struct simEdge_t {                      // Scripted level change of a pin, a key contact opening/closing, or an ADC reading
+  int64_t     timeUS;
+  gpio_num_t  pin;                      // Pin, or the column of a key contact
+  uint8_t     level;                    // Pin level, or 1 when the contact closes
+  gpio_num_t  row;                      // Row of a key contact, GPIO_NUM_NC for a pin level
+  int32_t     analog = -1;              // Raw ADC reading of the pin from this time, -1 unless an analog change
+  gpio_num_t  pin2 = GPIO_NUM_NC;       // Second pin changing at the same instant (see setLevels()), or GPIO_NUM_NC
+  uint8_t     level2 = 0;
+};
+
+struct simEvent_t {                     // Event recorded when a bound action ran
+  int64_t     timeUS;                   // Virtual time the action ran
+  int64_t     raisedUS;                 // currentEvent().timeUS, ie when the event was raised
+  uint32_t    durationUS;
+  const char* button;
+  events      event;
+  uint8_t     menuLevel;
+  uint16_t    count;                    // currentEvent().count, events merged into the record
+  uint8_t     id;                       // currentEvent().id, chord or pattern number
+  uint8_t     clicks;                   // currentEvent().clicks and longMask, for Event_Pattern
+  uint8_t     longMask;
+  int16_t     delta;                    // currentEvent().delta, summed encoder steps for Event_Step
+};
+
+
+// -- Button Simulator -----------------------------------------------------------------------------------------------------
+// Scripts pin waveforms (clean edges, contact bounce, noise spikes, held keys or recorded profiles) against the virtual
+// clock of SimHAL and plays them through the real InterruptButton logic, recording every action that runs.
+// -- ----------------------------------------------------------------------------------------------------------------------
+class ButtonSimulator {
+  public:
+    ButtonSimulator();                                                // Resets the virtual clock, pins and timers (no buttons may exist yet)
+
+    // Waveform scripting, times are absolute virtual times in us
+    void  setLevel(gpio_num_t pin, int64_t timeUS, uint8_t level);    // Clean transition
+    void  setLevels(gpio_num_t pinA, uint8_t levelA,                  // Two pins changing together, too close for the ISR to see
+                    gpio_num_t pinB, uint8_t levelB, int64_t timeUS); //  them apart (eg an encoder edge that is missed)
+    void  bounce(gpio_num_t pin, int64_t timeUS, uint8_t toLevel,     // Contact bounce of 'edges' random toggles settling at
+                 uint32_t spanUS, uint8_t edges, uint32_t seed = 1);  // 'toLevel' by timeUS + spanUS
+    void  spike(gpio_num_t pin, int64_t timeUS, uint32_t widthUS);    // Noise glitch that returns to the prior level
+    void  press(gpio_num_t pin, uint8_t pressedState, int64_t timeUS, // Press, hold and release, bouncing on make and break
+                uint32_t holdUS, uint32_t bounceUS = 0, uint8_t bounceEdges = 0, uint32_t seed = 1);
+    bool  loadProfile(const char* path, gpio_num_t pin,               // Recorded profile: '<timeUS> <level>' per line, '#' comments,
+                      int64_t offsetUS = 0, int64_t* endUS = nullptr);//  optional 'end <timeUS>' line
+    uint8_t levelAt(gpio_num_t pin, int64_t timeUS);                  // Scripted level of a pin at a given time
+    void  setContact(gpio_num_t row, gpio_num_t col, int64_t timeUS,  // Keypad key switch between a row and column pin
+                     bool closed);
+    void  pressKey(gpio_num_t row, gpio_num_t col, int64_t timeUS,    // Keypad key press, hold and release, bouncing on make and break
+                   uint32_t holdUS, uint32_t bounceUS = 0, uint8_t bounceEdges = 0, uint32_t seed = 1);
+    void  setAnalog(gpio_num_t pin, int64_t timeUS, uint16_t counts); // ADC reading of a pin from this time on
+    void  pressAnalog(gpio_num_t pin, uint16_t counts,                // Resistor ladder press: the reading moves from idleCounts
+                      uint16_t idleCounts, int64_t timeUS,            // to counts and back, bouncing between the two on make and break
+                      uint32_t holdUS, uint32_t bounceUS = 0, uint8_t bounceEdges = 0, uint32_t seed = 1);
+    int64_t rotate(gpio_num_t pinA, gpio_num_t pinB, int64_t timeUS,  // Quadrature encoder turned 'detents' clicks (negative
+                   int16_t detents, uint32_t edgeUS,                  // anticlockwise) from its scripted levels, one edge every
+                   uint8_t stepsPerDetent = ENCODER_STEPS_PER_DETENT);//  edgeUS, returns the time of the last edge
+
+    // Execution
+    void  setMainLoopPeriod(uint32_t periodUS,                        // Call processSyncEvents() this often (0 = never),
+                            uint16_t maxEvents = 0);                  // actioning at most maxEvents per call (0 = all)
+    void  run(int64_t untilUS);                                       // Play edges, timers and main loop calls up to 'untilUS'
+
+    // Recording
+    void  record(InterruptButton &btn, const char* name,              // Bind a recorder to the events set in 'eventMask'
+                 uint16_t eventMask, uint8_t menuLevel = 0);          // (bit per event, as used by enableEvent())
+    void  record(RotaryEncoder &encoder, const char* name,            // Bind a recorder to an encoder's step records
+                 uint8_t menuLevel = 0);
+    std::vector<simEvent_t> recorded(void);
+    void  clearEvents(void);
+    static const char* eventName(events event);
+
+  private:
+    void  addEdge(const simEdge_t &edge);
+    void  bounceLine(gpio_num_t pin, gpio_num_t row, int64_t timeUS,  // Bounce of a pin level or a key contact
+                     uint8_t toLevel, uint32_t spanUS, uint8_t edges, uint32_t seed);
+    void  bounceAnalog(gpio_num_t pin, int64_t timeUS, uint16_t toCounts,   // Bounce of an ADC reading between two values
+                       uint16_t fromCounts, uint32_t spanUS, uint8_t edges, uint32_t seed);
+    static std::vector<uint32_t> bounceOffsets(uint32_t spanUS, uint8_t edges, uint32_t seed);
+
+    std::vector<simEdge_t>  m_edges;                                  // Sorted by time, equal times kept in scripting order
+    size_t                  m_nextEdge = 0;
+    uint32_t                m_loopPeriodUS = 0;
+    int64_t                 m_nextLoopUS = 0;
+    uint16_t                m_loopMaxEvents = 0;
+    std::mutex              m_eventsLock;                             // Actions may run on the simulated RTOS task
+    std::vector<simEvent_t> m_events;
+};
+
+#endif // BUTTONSIMULATOR_H_
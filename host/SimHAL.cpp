@@ -0,0 +1,639 @@
+#include "SimHAL.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SIM_CYCLES()  __rdtsc()
+#else
+#define SIM_CYCLES()  0ULL
+#endif
+
+//-- CALLBACK TIMING -------------------------------------------------------------------------------------
+// Host time spent inside ISR handlers and timer callbacks, measured around each call while enabled, so a benchmark gets
+// the library's own cost without having to subtract the stand-in's.
+static bool                   s_timeCallbacks = false;
+static std::atomic<uint64_t>  s_callbackNS      { 0 };
+static std::atomic<uint64_t>  s_callbackCycles  { 0 };
+
+struct callbackTiming_t {
+  bool                                  enabled = s_timeCallbacks;
+  uint64_t                              startCycles = enabled ? SIM_CYCLES() : 0;
+  std::chrono::steady_clock::time_point start = enabled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+  ~callbackTiming_t() {
+    if(!enabled) return;
+    s_callbackNS += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    s_callbackCycles += SIM_CYCLES() - startCycles;
+  }
+};
+
+//-- VIRTUAL CLOCK AND TIMER WHEEL -----------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+#define WHEEL_SLOTS       256         // Timers are hashed into slots by expiry, one lap covers WHEEL_SLOTS x WHEEL_TICK_US
+#define WHEEL_TICK_US     100
+
+struct esp_timer {
+  esp_timer_cb_t  callback;
+  void*           arg;
+  const char*     name;
+  int64_t         expiryUS;
+  uint64_t        periodUS;           // 0 for one-shot timers
+  uint64_t        sequence;           // Arming order, breaks ties between timers expiring at the same time
+  bool            armed;
+};
+
+static std::atomic<int64_t>     s_nowUS           { 0 };
+static std::recursive_mutex     s_timerLock;
+static std::vector<esp_timer*>  s_wheel[WHEEL_SLOTS];
+static uint64_t                 s_timerSequence   = 0;
+static uint16_t                 s_armedTimers     = 0;
+static std::atomic<uint32_t>    s_timerCallbacks  { 0 };
+
+static uint16_t wheelSlot(int64_t expiryUS) { return static_cast<uint16_t>((expiryUS / WHEEL_TICK_US) % WHEEL_SLOTS); }
+
+static void wheelInsert(esp_timer* timer) {
+  timer->sequence = s_timerSequence++;
+  timer->armed = true;
+  s_wheel[wheelSlot(timer->expiryUS)].push_back(timer);
+  s_armedTimers++;
+}
+
+static void wheelRemove(esp_timer* timer) {
+  std::vector<esp_timer*> &slot = s_wheel[wheelSlot(timer->expiryUS)];
+  for(size_t i = 0; i < slot.size(); i++) {
+    if(slot[i] == timer) {
+      slot.erase(slot.begin() + i);
+      s_armedTimers--;
+      break;
+    }
+  }
+  timer->armed = false;
+}
+
+static bool earlier(const esp_timer* a, const esp_timer* b) {
+  return (b == nullptr) || a->expiryUS < b->expiryUS || (a->expiryUS == b->expiryUS && a->sequence < b->sequence);
+}
+
+// Walks the wheel one lap from the current time, falling back to a full search for timers more than a lap away.
+static esp_timer* wheelNext(void) {
+  if(s_armedTimers == 0) return nullptr;
+  int64_t tick = s_nowUS / WHEEL_TICK_US;
+  for(uint16_t i = 0; i < WHEEL_SLOTS; i++) {
+    int64_t lapEndUS = (tick + i + 1) * WHEEL_TICK_US;
+    esp_timer* best = nullptr;
+    for(esp_timer* timer : s_wheel[(tick + i) % WHEEL_SLOTS])
+      if(timer->expiryUS < lapEndUS && earlier(timer, best)) best = timer;
+    if(best) return best;
+  }
+  esp_timer* best = nullptr;
+  for(uint16_t i = 0; i < WHEEL_SLOTS; i++)
+    for(esp_timer* timer : s_wheel[i])
+      if(earlier(timer, best)) best = timer;
+  return best;
+}
+
+int64_t esp_timer_get_time(void) {
+  return s_nowUS;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle) {
+  if(create_args == nullptr || create_args->callback == nullptr || out_handle == nullptr) return ESP_ERR_INVALID_ARG;
+  esp_timer* timer = new esp_timer();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t timeoutUS, uint64_t periodUS) {
+  if(timer == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+  if(timer->armed) return ESP_ERR_INVALID_STATE;
+  timer->expiryUS = s_nowUS + static_cast<int64_t>(timeoutUS);
+  timer->periodUS = periodUS;
+  wheelInsert(timer);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) { return startTimer(timer, timeout_us, 0);  }
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)  { return startTimer(timer, period, period); }
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if(timer == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+  if(!timer->armed) return ESP_ERR_INVALID_STATE;
+  wheelRemove(timer);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if(timer == nullptr) return ESP_ERR_INVALID_ARG;
+  std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+  if(timer->armed) return ESP_ERR_INVALID_STATE;
+  delete timer;
+  return ESP_OK;
+}
+
+
+//-- FREERTOS TASKS (threads that the simulator waits on) ------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+struct simTask_t {
+  TaskFunction_t          function;
+  void*                   param;
+  std::string             name;
+  std::mutex              lock;
+  std::condition_variable changed;
+  uint32_t                notifyCount = 0;
+  bool                    waiting = false;        // Blocked in ulTaskNotifyTake()
+  bool                    suspended = false;
+  bool                    finished = false;
+};
+
+static std::mutex               s_tasksLock;
+static std::vector<simTask_t*>  s_tasks;
+static thread_local simTask_t*  t_currentTask = nullptr;
+static thread_local bool        t_inIsr = false;
+static int                      s_mainTaskTag;    // Handle returned for the thread driving the simulation
+
+BaseType_t xPortInIsrContext(void) {
+  return t_inIsr ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask, BaseType_t xCoreID) {
+  simTask_t* task = new simTask_t();
+    task->function = pvTaskCode;
+    task->param = pvParameters;
+    task->name = pcName ? pcName : "";
+  {
+    std::lock_guard<std::mutex> lock(s_tasksLock);
+    s_tasks.push_back(task);
+  }
+  if(pvCreatedTask) *pvCreatedTask = task;
+  std::thread([task]() {
+    t_currentTask = task;
+    task->function(task->param);
+    std::lock_guard<std::mutex> lock(task->lock);
+    task->finished = true;
+    task->changed.notify_all();
+  }).detach();
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete) {
+  simTask_t* task = xTaskToDelete ? static_cast<simTask_t*>(xTaskToDelete) : t_currentTask;
+  if(task == nullptr) return;
+  {
+    std::lock_guard<std::mutex> lock(s_tasksLock);
+    for(size_t i = 0; i < s_tasks.size(); i++) if(s_tasks[i] == task) { s_tasks.erase(s_tasks.begin() + i); break; }
+  }
+  std::unique_lock<std::mutex> lock(task->lock);
+  task->finished = true;
+  task->changed.notify_all();
+  if(task == t_currentTask) task->changed.wait(lock, []() { return false; });   // A deleted task never runs again
+}
+
+void vTaskSuspend(TaskHandle_t xTaskToSuspend) {
+  simTask_t* task = xTaskToSuspend ? static_cast<simTask_t*>(xTaskToSuspend) : t_currentTask;
+  if(task == nullptr) return;
+  std::unique_lock<std::mutex> lock(task->lock);
+  task->suspended = true;
+  task->changed.notify_all();
+  if(task == t_currentTask) task->changed.wait(lock, [task]() { return !task->suspended; });
+}
+
+void vTaskResume(TaskHandle_t xTaskToResume) {
+  simTask_t* task = static_cast<simTask_t*>(xTaskToResume);
+  if(task == nullptr) return;
+  std::lock_guard<std::mutex> lock(task->lock);
+  task->suspended = false;
+  task->changed.notify_all();
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+  std::this_thread::yield();                      // Tasks don't consume virtual time
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  return t_currentTask ? static_cast<TaskHandle_t>(t_currentTask) : static_cast<TaskHandle_t>(&s_mainTaskTag);
+}
+
+// Only infinite waits are modelled, a finite wait returns immediately if nothing is pending.
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+  simTask_t* task = t_currentTask;
+  if(task == nullptr) return 0;
+  std::unique_lock<std::mutex> lock(task->lock);
+  if(xTicksToWait != portMAX_DELAY && task->notifyCount == 0) return 0;
+  task->waiting = true;
+  task->changed.notify_all();
+  task->changed.wait(lock, [task]() { return task->notifyCount > 0 && !task->suspended; });
+  task->waiting = false;
+  uint32_t count = task->notifyCount;
+  task->notifyCount = xClearCountOnExit ? 0 : count - 1;
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  simTask_t* task = static_cast<simTask_t*>(xTaskToNotify);
+  if(task == nullptr) return pdFAIL;
+  std::lock_guard<std::mutex> lock(task->lock);
+  task->notifyCount++;
+  task->changed.notify_all();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken) {
+  xTaskNotifyGive(xTaskToNotify);
+  if(pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+static std::recursive_mutex s_criticalLock;
+
+void simEnterCritical(portMUX_TYPE* mux) { s_criticalLock.lock();   }
+void simExitCritical(portMUX_TYPE* mux)  { s_criticalLock.unlock(); }
+
+
+//-- GPIO ------------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+struct simPin_t {
+  uint8_t         level = 0;
+  bool            driven = false;     // Level set by the simulator (or an output), otherwise follows the pull resistors
+  gpio_mode_t     mode = GPIO_MODE_DISABLE;
+  gpio_int_type_t intrType = GPIO_INTR_DISABLE;
+  bool            intrEnabled = false;
+  bool            wakeup = false;     // Light sleep wakeup source (level interrupt type)
+  gpio_isr_t      handler = nullptr;
+  void*           handlerArg = nullptr;
+};
+
+static simPin_t               s_pins[GPIO_NUM_MAX];
+static bool                   s_gpioWakeup = false;
+static uint64_t               s_contacts[GPIO_NUM_MAX];     // Bit per column gpio joined to each row gpio by a closed key
+static uint64_t               s_contactRows = 0;            // Pins wired into a key matrix
+static uint64_t               s_contactCols = 0;
+static uint16_t               s_analog[GPIO_NUM_MAX];       // Raw ADC reading of each pin
+static bool                   s_isrServiceInstalled = false;
+static std::atomic<uint32_t>  s_isrCount { 0 };
+
+static bool validPin(gpio_num_t pin) { return GPIO_IS_VALID_GPIO(pin); }
+
+static bool levelIntrActive(const simPin_t &pin) {
+  return (pin.intrType == GPIO_INTR_LOW_LEVEL && pin.level == 0) || (pin.intrType == GPIO_INTR_HIGH_LEVEL && pin.level == 1);
+}
+
+static void runIsr(simPin_t &pin) {
+  if(!s_isrServiceInstalled || !pin.intrEnabled || pin.handler == nullptr) return;
+  bool wasInIsr = t_inIsr;
+  t_inIsr = true;
+  s_isrCount++;
+  {
+    callbackTiming_t timing;
+    pin.handler(pin.handlerArg);
+  }
+  t_inIsr = wasInIsr;
+}
+
+// Level triggered interrupts keep firing while the level is held, bounded so a handler that never masks it can't hang
+static void serviceLevelIntr(simPin_t &pin) {
+  for(uint16_t i = 0; i < 1000 && pin.intrEnabled && levelIntrActive(pin); i++) runIsr(pin);
+}
+
+static bool storeLevel(gpio_num_t gpio, uint8_t level) {
+  simPin_t &pin = s_pins[gpio];
+  uint8_t previous = pin.level;
+  pin.level = level ? 1 : 0;
+  pin.driven = true;
+  return previous != pin.level;
+}
+
+static void serviceEdge(simPin_t &pin) {
+  if(!pin.intrEnabled) return;
+  switch(pin.intrType) {
+    case GPIO_INTR_ANYEDGE:   runIsr(pin);                    break;
+    case GPIO_INTR_POSEDGE:   if(pin.level == 1) runIsr(pin); break;
+    case GPIO_INTR_NEGEDGE:   if(pin.level == 0) runIsr(pin); break;
+    case GPIO_INTR_LOW_LEVEL:
+    case GPIO_INTR_HIGH_LEVEL: serviceLevelIntr(pin);         break;
+    default:                                                  break;
+  }
+}
+
+static void changeLevel(gpio_num_t gpio, uint8_t level) {
+  if(storeLevel(gpio, level)) serviceEdge(s_pins[gpio]);
+}
+
+// A column wired to key contacts reads low while a closed contact joins it to a row that is driving low, otherwise it
+// follows its pull-up (rows are open-drain, so a row at level 1 is released rather than driven high)
+static void updateContacts(void) {
+  for(uint64_t cols = s_contactCols; cols; cols &= cols - 1) {
+    uint8_t col = __builtin_ctzll(cols);
+    uint8_t level = 1;
+    for(uint64_t rows = s_contactRows; rows; rows &= rows - 1) {
+      uint8_t row = __builtin_ctzll(rows);
+      if((s_contacts[row] & BIT64(col)) && (s_pins[row].mode & GPIO_MODE_OUTPUT) && s_pins[row].level == 0) level = 0;
+    }
+    changeLevel(static_cast<gpio_num_t>(col), level);
+  }
+}
+
+esp_err_t gpio_config(const gpio_config_t* pGPIOConfig) {
+  if(pGPIOConfig == nullptr) return ESP_ERR_INVALID_ARG;
+  for(uint8_t gpio = 0; gpio < GPIO_NUM_MAX; gpio++) {
+    if(!(pGPIOConfig->pin_bit_mask & BIT64(gpio))) continue;
+    simPin_t &pin = s_pins[gpio];
+    pin.mode = pGPIOConfig->mode;
+    if(!pin.driven) {
+      if(pGPIOConfig->pull_up_en)        pin.level = 1;
+      else if(pGPIOConfig->pull_down_en) pin.level = 0;
+    }
+    pin.intrType = pGPIOConfig->intr_type;
+    pin.intrEnabled = (pGPIOConfig->intr_type != GPIO_INTR_DISABLE);
+  }
+  return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  simPin_t &pin = s_pins[gpio_num];
+  pin.mode = GPIO_MODE_DISABLE;
+  pin.intrType = GPIO_INTR_DISABLE;
+  pin.intrEnabled = false;
+  pin.wakeup = false;
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+  return validPin(gpio_num) ? s_pins[gpio_num].level : 0;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  changeLevel(gpio_num, level ? 1 : 0);
+  if(s_contactRows & BIT64(gpio_num)) updateContacts();
+  return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].intrType = intr_type;
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  simPin_t &pin = s_pins[gpio_num];
+  pin.intrEnabled = true;
+  if(levelIntrActive(pin) && !t_inIsr) serviceLevelIntr(pin);
+  return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].intrEnabled = false;
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+  if(!validPin(gpio_num) || (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].intrType = intr_type;                    // As on target, wakeup needs (and sets) a level interrupt
+  s_pins[gpio_num].wakeup = true;
+  return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].wakeup = false;                          // Interrupt type is left as it was, as on target
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+  s_gpioWakeup = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+  if(source == ESP_SLEEP_WAKEUP_GPIO || source == ESP_SLEEP_WAKEUP_ALL) s_gpioWakeup = false;
+  return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+  if(s_isrServiceInstalled) return ESP_ERR_INVALID_STATE;
+  s_isrServiceInstalled = true;
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  if(!s_isrServiceInstalled) return ESP_ERR_INVALID_STATE;
+  s_pins[gpio_num].handler = isr_handler;
+  s_pins[gpio_num].handlerArg = args;
+  return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num) {
+  if(!validPin(gpio_num)) return ESP_ERR_INVALID_ARG;
+  s_pins[gpio_num].handler = nullptr;
+  s_pins[gpio_num].handlerArg = nullptr;
+  return ESP_OK;
+}
+
+uint64_t ibhal_read_inputs(void) {
+  uint64_t levels = 0;
+  for(uint8_t gpio = 0; gpio < GPIO_NUM_MAX; gpio++) if(s_pins[gpio].level) levels |= BIT64(gpio);
+  return levels;
+}
+
+void ibhal_delay_us(uint32_t us) {
+  (void)us;                                                   // Virtual time only moves between callbacks
+}
+
+bool ibhal_adc_init(gpio_num_t pin) {
+  return validPin(pin);
+}
+
+int ibhal_adc_read(gpio_num_t pin) {
+  return validPin(pin) ? s_analog[pin] : -1;
+}
+
+
+//-- LOGGING ---------------------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+static esp_log_level_t s_logLevel = ESP_LOG_WARN;
+static std::atomic<uint32_t> s_errorsLogged { 0 };
+
+void simLog(esp_log_level_t level, const char* tag, const char* format, ...) {
+  if(level == ESP_LOG_ERROR) s_errorsLogged++;
+  if(level > s_logLevel) return;
+  static const char letters[] = "NEWIDV";
+  fprintf(stderr, "%c (%lld) %s: ", letters[level], static_cast<long long>(s_nowUS.load()), tag);
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+
+//-- SIMULATOR CONTROL -----------------------------------------------------------------------------------
+//--------------------------------------------------------------------------------------------------------
+void SimHAL::reset(void) {
+  waitForTasksIdle();
+  {
+    std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+    for(uint16_t i = 0; i < WHEEL_SLOTS; i++) {
+      for(esp_timer* timer : s_wheel[i]) timer->armed = false;
+      s_wheel[i].clear();
+    }
+    s_armedTimers = 0;
+    s_nowUS = 0;
+  }
+  for(uint8_t gpio = 0; gpio < GPIO_NUM_MAX; gpio++) {
+    s_pins[gpio].driven = false;
+    s_contacts[gpio] = 0;
+    s_analog[gpio] = 4095;
+  }
+  s_contactRows = 0;
+  s_contactCols = 0;
+  s_gpioWakeup = false;
+  s_isrCount = 0;
+  s_errorsLogged = 0;
+  s_timerCallbacks = 0;
+  s_callbackNS = 0;
+  s_callbackCycles = 0;
+}
+
+int64_t SimHAL::now(void) {
+  return s_nowUS;
+}
+
+void SimHAL::advanceTo(int64_t timeUS) {
+  while(true) {
+    esp_timer_cb_t callback;
+    void* arg;
+    {
+      std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+      esp_timer* timer = wheelNext();
+      if(timer == nullptr || timer->expiryUS > timeUS) break;
+      wheelRemove(timer);
+      if(timer->expiryUS > s_nowUS) s_nowUS = timer->expiryUS;
+      if(timer->periodUS) {                                 // Periodic timers are re-armed before the callback, as on target
+        timer->expiryUS += timer->periodUS;
+        wheelInsert(timer);
+      }
+      callback = timer->callback;
+      arg = timer->arg;
+    }
+    s_timerCallbacks++;
+    {
+      callbackTiming_t timing;
+      callback(arg);
+    }
+    waitForTasksIdle();
+  }
+  if(timeUS > s_nowUS) s_nowUS = timeUS;
+}
+
+int64_t SimHAL::nextTimerExpiry(void) {
+  std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+  esp_timer* timer = wheelNext();
+  return timer ? timer->expiryUS : -1;
+}
+
+uint16_t SimHAL::armedTimerCount(void) {
+  std::lock_guard<std::recursive_mutex> lock(s_timerLock);
+  return s_armedTimers;
+}
+
+void SimHAL::setPinLevel(gpio_num_t pin, uint8_t level) {
+  if(!validPin(pin)) return;
+  changeLevel(pin, level);
+  waitForTasksIdle();
+}
+
+void SimHAL::setPinLevels(gpio_num_t pinA, uint8_t levelA, gpio_num_t pinB, uint8_t levelB) {
+  if(!validPin(pinA) || !validPin(pinB)) return;
+  bool changedA = storeLevel(pinA, levelA);
+  bool changedB = storeLevel(pinB, levelB);
+  if(changedA) serviceEdge(s_pins[pinA]);
+  if(changedB) serviceEdge(s_pins[pinB]);
+  waitForTasksIdle();
+}
+
+void SimHAL::setContact(gpio_num_t row, gpio_num_t col, bool closed) {
+  if(!validPin(row) || !validPin(col)) return;
+  s_contactRows |= BIT64(row);
+  s_contactCols |= BIT64(col);
+  if(closed) s_contacts[row] |= BIT64(col);
+  else       s_contacts[row] &= ~BIT64(col);
+  updateContacts();
+  waitForTasksIdle();
+}
+
+bool SimHAL::canWakeFromSleep(gpio_num_t pin) {
+  return validPin(pin) && s_gpioWakeup && s_pins[pin].wakeup;
+}
+
+void SimHAL::setAnalogLevel(gpio_num_t pin, uint16_t counts) {
+  if(validPin(pin)) s_analog[pin] = counts;                   // Only seen by the next sample, an ADC raises no interrupt
+}
+
+uint8_t SimHAL::getPinLevel(gpio_num_t pin) {
+  return gpio_get_level(pin);
+}
+
+void SimHAL::waitForTasksIdle(void) {
+  bool settled = false;
+  while(!settled) {                                           // Repeat until a full pass finds nothing running, as one
+    settled = true;                                           // task's action may well notify another.
+    std::vector<simTask_t*> tasks;
+    {
+      std::lock_guard<std::mutex> lock(s_tasksLock);
+      tasks = s_tasks;
+    }
+    for(simTask_t* task : tasks) {
+      if(task == t_currentTask) continue;
+      std::unique_lock<std::mutex> lock(task->lock);
+      auto idle = [task]() { return task->finished || (task->waiting && (task->notifyCount == 0 || task->suspended)); };
+      if(!idle()) {
+        settled = false;
+        task->changed.wait(lock, idle);
+      }
+    }
+  }
+}
+
+void SimHAL::setLogLevel(esp_log_level_t level) {
+  s_logLevel = level;
+}
+
+uint32_t SimHAL::isrCount(void) {
+  return s_isrCount;
+}
+
+uint32_t SimHAL::errorsLogged(void) {
+  return s_errorsLogged;
+}
+
+uint32_t SimHAL::timerCallbackCount(void) {
+  return s_timerCallbacks;
+}
+
+void SimHAL::setCallbackTiming(bool enable) {
+  s_timeCallbacks = enable;
+}
+
+uint64_t SimHAL::callbackNS(void) {
+  return s_callbackNS;
+}
+
+uint64_t SimHAL::callbackCycles(void) {
+  return s_callbackCycles;
+}
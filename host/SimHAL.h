@@ -0,0 +1,185 @@
+#ifndef SIMHAL_H_
+#define SIMHAL_H_
+
+// -- Host (Linux) implementation of the InterruptButton HAL -----------------------------------------------------------------
+// Provides the ESP-IDF names listed in InterruptButtonHAL.h so InterruptButton.cpp compiles unmodified on a workstation.
+// Time is virtual: it only moves when the simulator advances it, timers are held in a hashed timer wheel and fired in
+// expiry order, pin levels are set by the simulator and fire the registered gpio ISR exactly as the hardware would.
+// FreeRTOS tasks run as threads, but the simulator waits for every task to block again after each ISR or timer callback,
+// so the order of bound actions is fully deterministic.
+// -- ----------------------------------------------------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stddef.h>
+
+// -- esp_err / attributes --------------------------------------------------------------------------------------------------
+typedef int esp_err_t;
+#define ESP_OK                    0
+#define ESP_FAIL                  -1
+#define ESP_ERR_NO_MEM            0x101
+#define ESP_ERR_INVALID_ARG       0x102
+#define ESP_ERR_INVALID_STATE     0x103
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define BIT64(nr)                 (1ULL << (nr))
+
+// -- gpio ------------------------------------------------------------------------------------------------------------------
+typedef enum {
+  GPIO_NUM_NC = -1,
+  GPIO_NUM_0 = 0,
+  GPIO_NUM_MAX = 64
+} gpio_num_t;
+#define GPIO_IS_VALID_GPIO(gpio_num)  ((gpio_num) >= 0 && (gpio_num) < GPIO_NUM_MAX)
+
+typedef enum {
+  GPIO_MODE_DISABLE = 0,
+  GPIO_MODE_INPUT = 1,
+  GPIO_MODE_OUTPUT = 2,
+  GPIO_MODE_INPUT_OUTPUT = 3,
+  GPIO_MODE_OUTPUT_OD = 6,
+  GPIO_MODE_INPUT_OUTPUT_OD = 7
+} gpio_mode_t;
+
+typedef enum {
+  GPIO_INTR_DISABLE = 0,
+  GPIO_INTR_POSEDGE,
+  GPIO_INTR_NEGEDGE,
+  GPIO_INTR_ANYEDGE,
+  GPIO_INTR_LOW_LEVEL,
+  GPIO_INTR_HIGH_LEVEL
+} gpio_int_type_t;
+
+typedef enum { GPIO_PULLUP_DISABLE = 0,   GPIO_PULLUP_ENABLE = 1   } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE = 1 } gpio_pulldown_t;
+
+typedef struct {
+  uint64_t        pin_bit_mask;
+  gpio_mode_t     mode;
+  gpio_pullup_t   pull_up_en;
+  gpio_pulldown_t pull_down_en;
+  gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+
+esp_err_t gpio_config(const gpio_config_t* pGPIOConfig);
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num);
+int       gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num);
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args);
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num);
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num);
+uint64_t  ibhal_read_inputs(void);
+void      ibhal_delay_us(uint32_t us);
+bool      ibhal_adc_init(gpio_num_t pin);
+int       ibhal_adc_read(gpio_num_t pin);
+
+// -- esp_sleep -------------------------------------------------------------------------------------------------------------
+typedef enum { ESP_SLEEP_WAKEUP_ALL = 0, ESP_SLEEP_WAKEUP_GPIO = 7 } esp_sleep_source_t;
+esp_err_t esp_sleep_enable_gpio_wakeup(void);
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source);
+
+// -- esp_timer -------------------------------------------------------------------------------------------------------------
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+
+typedef struct {
+  esp_timer_cb_t        callback;
+  void*                 arg;
+  esp_timer_dispatch_t  dispatch_method;
+  const char*           name;
+  bool                  skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t   esp_timer_get_time(void);
+
+// -- FreeRTOS --------------------------------------------------------------------------------------------------------------
+typedef uint32_t  TickType_t;
+typedef int       BaseType_t;
+typedef unsigned  UBaseType_t;
+typedef void*     TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdTRUE                    1
+#define pdFALSE                   0
+#define pdPASS                    1
+#define pdFAIL                    0
+#define portMAX_DELAY             ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ        1000
+#define portTICK_PERIOD_MS        ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)         ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+typedef struct { int owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED  { 0 }
+
+void       simEnterCritical(portMUX_TYPE* mux);
+void       simExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux)       simEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)        simExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)   simEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)    simExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux)  simEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)   simExitCritical(mux)
+#define portYIELD_FROM_ISR()
+
+BaseType_t    xPortInIsrContext(void);
+BaseType_t    xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth, void* pvParameters,
+                                      UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask, BaseType_t xCoreID);
+void          vTaskDelete(TaskHandle_t xTaskToDelete);
+void          vTaskSuspend(TaskHandle_t xTaskToSuspend);
+void          vTaskResume(TaskHandle_t xTaskToResume);
+void          vTaskDelay(TickType_t xTicksToDelay);
+TaskHandle_t  xTaskGetCurrentTaskHandle(void);
+uint32_t      ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+BaseType_t    xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+void          vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken);
+
+// -- esp_log ---------------------------------------------------------------------------------------------------------------
+typedef enum { ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO, ESP_LOG_DEBUG, ESP_LOG_VERBOSE } esp_log_level_t;
+void simLog(esp_log_level_t level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+#define ESP_LOGE(tag, format, ...)  simLog(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  simLog(ESP_LOG_WARN,  tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  simLog(ESP_LOG_INFO,  tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  simLog(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  simLog(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+
+// -- Simulator control ------------------------------------------------------------------------------------------------------
+// Everything above is what the library sees, this is how a host program drives it.
+class SimHAL {
+  public:
+    static void     reset(void);                                      // Clock back to zero, pins idle and timers discarded
+    static int64_t  now(void);                                        // Current virtual time (us)
+    static void     advanceTo(int64_t timeUS);                        // Fire every timer due up to 'timeUS' in order, then set the clock
+    static int64_t  nextTimerExpiry(void);                            // Expiry of the earliest armed timer, or -1 if none armed
+    static uint16_t armedTimerCount(void);
+    static void     setPinLevel(gpio_num_t pin, uint8_t level);       // Drive an input at the current time (fires the ISR if armed)
+    static void     setPinLevels(gpio_num_t pinA, uint8_t levelA,    // Drive two inputs at once, both changed before either
+                                 gpio_num_t pinB, uint8_t levelB);    // pin's ISR runs (edges closer than the ISR latency)
+    static uint8_t  getPinLevel(gpio_num_t pin);
+    static void     setAnalogLevel(gpio_num_t pin, uint16_t counts);  // Raw ADC reading of a pin from now on (reset to 4095, full scale)
+    static void     setContact(gpio_num_t row, gpio_num_t col,       // Open or close a key switch between a keypad row and column
+                               bool closed);                          // (the column reads low while the row drives low)
+    static void     waitForTasksIdle(void);                           // Block until every task is waiting on a notification again
+    static void     setLogLevel(esp_log_level_t level);
+    static uint32_t isrCount(void);                                   // Number of gpio ISR invocations since reset()
+    static uint32_t errorsLogged(void);                               // Number of ESP_LOGE calls since reset() (whatever the log level)
+    static bool     canWakeFromSleep(gpio_num_t pin);                 // Pin is a light sleep wakeup source and gpio wakeup is enabled
+    static uint32_t timerCallbackCount(void);                         // Number of timer callbacks fired since reset()
+    static void     setCallbackTiming(bool enable);                   // Time each ISR handler and timer callback call (for ibbench)
+    static uint64_t callbackNS(void);                                 // Host ns spent in them since reset() while timing was on
+    static uint64_t callbackCycles(void);                             // Same in TSC cycles (0 on hosts without one)
+};
+
+#endif // SIMHAL_H_
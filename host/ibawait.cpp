@@ -0,0 +1,103 @@
+// ibawait - runs coroutines written against the co_await interface (ButtonTask.h, InterruptButton::next()/nextOf())
+// through the real InterruptButton logic on a Linux host, and checks what they saw.  Needs C++20, unlike the rest of
+// the host build.
+//
+//   ibawait [--mode async|hybrid|sync]
+//     --mode async|hybrid|sync     Dispatch mode (default async); in hybrid and sync modes a 10 ms main loop calls
+//                                  processSyncEvents()
+//
+// Three coroutines wait on two buttons: one counts keyPress of either button (nextOf), one waits for a long press and
+// then the next event of any kind, and one is destroyed while waiting, which must unlink it.  Every check is printed
+// with ok or FAIL, and the exit status is 1 if any failed.
+
+#include "ButtonSimulator.h"
+#include "ButtonTask.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define PIN_A   static_cast<gpio_num_t>(4)
+#define PIN_B   static_cast<gpio_num_t>(5)
+
+static int      s_failures = 0;
+static uint32_t s_pressesA = 0, s_pressesB = 0;
+static bool     s_longSeen = false;
+static events   s_afterLong = NumEventTypes;
+static bool     s_destroyedResumed = false;
+
+static void check(bool ok, const char* what) {
+  printf("# ibawait: %s %s\n", ok ? "ok  " : "FAIL", what);
+  if(!ok) s_failures++;
+}
+
+ButtonTask counter(InterruptButton &a, InterruptButton &b) {
+  while(true) {
+    buttonEvent_t evt = co_await InterruptButton::nextOf(Event_KeyPress, &a, &b);
+    if(evt.btn == &a) s_pressesA++;
+    if(evt.btn == &b) s_pressesB++;
+  }
+}
+
+ButtonTask sequence(InterruptButton &a) {
+  co_await a.next(Event_LongKeyPress);
+  s_longSeen = true;
+  buttonEvent_t evt = co_await a.next(Event_All);
+  s_afterLong = evt.event;
+}
+
+struct HeldTask {                       // Coroutine left suspended at the end so its owner can destroy it
+  struct promise_type {
+    HeldTask            get_return_object(void) { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+    std::suspend_never  initial_suspend(void) noexcept { return {}; }
+    std::suspend_always final_suspend(void) noexcept { return {}; }
+    void                return_void(void) {}
+    void                unhandled_exception(void) { std::terminate(); }
+  };
+  std::coroutine_handle<promise_type> handle;
+};
+
+HeldTask doomed(InterruptButton &b) {
+  co_await b.next(Event_KeyPress);
+  s_destroyedResumed = true;
+}
+
+int main(int argc, char** argv) {
+  modes mode = Mode_Asynchronous;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--mode") && i + 1 < argc) {
+      const char* value = argv[++i];
+      mode = !strcmp(value, "sync") ? Mode_Synchronous : !strcmp(value, "hybrid") ? Mode_Hybrid : Mode_Asynchronous;
+    } else {
+      fprintf(stderr, "usage: ibawait [--mode async|hybrid|sync]\n");
+      return 2;
+    }
+  }
+
+  ButtonSimulator sim;
+  sim.setMainLoopPeriod(mode == Mode_Asynchronous ? 0 : 10000);
+  InterruptButton::setMode(mode);
+  InterruptButton a(PIN_A, 0), b(PIN_B, 0);
+  sim.record(a, "a", IB_EVENT_BIT(Event_KeyUp));              // A bound action still runs alongside the coroutines
+  counter(a, b);
+  sequence(a);
+  HeldTask held = doomed(b);
+  held.handle.destroy();
+
+  sim.press(PIN_A, 0, 100000, 100000, 2000, 4, 1);
+  sim.press(PIN_B, 0, 500000, 100000, 2000, 4, 3);
+  sim.press(PIN_A, 0, 1000000, 900000, 2000, 4, 5);           // Long press at 1.75 s, released before the first repeat
+  sim.press(PIN_A, 0, 3000000, 100000, 2000, 4, 7);
+  sim.run(4000000);
+  InterruptButton::processSyncEvents();
+
+  check(s_pressesA == 2 && s_pressesB == 1, "nextOf() saw each keyPress of either button once");
+  check(s_longSeen && s_afterLong == Event_KeyUp, "next() saw the long press, then its keyUp");
+  check(!s_destroyedResumed, "a destroyed coroutine is never resumed");
+  uint32_t keyUps = 0;
+  for(const simEvent_t &evt : sim.recorded()) if(evt.event == Event_KeyUp) keyUps++;
+  check(keyUps == 3, "bound keyUp action ran for every release");
+  printf("# ibawait: %d failed checks\n", s_failures);
+
+  fflush(stdout);
+  _Exit(s_failures ? 1 : 0);                                    // Skip static destructors, the RTOS task thread is still parked
+}
@@ -0,0 +1,404 @@
+// ibbench - host microbenchmarks of the InterruptButton hot paths, printed as one JSON document so runs can be stored and
+// compared to catch regressions.
+//
+//   ibbench [--presses N] [--quick]
+//     --presses N                  Presses per timed figure (default 5000)
+//     --quick                      Same as --presses 500
+//
+// Everything runs on the simulated HAL in host/ (gpio, esp_timer and FreeRTOS stand-ins), so times are host times: compare
+// runs made on the same machine, not against the target.  ibbench links its own copy of the library, built -O2 without
+// INTERRUPTBUTTON_STATS or INTERRUPTBUTTON_TRACE (the flags are recorded under "build").  readButton() is timed by SimHAL
+// around each ISR handler and timer callback call, so nothing is subtracted; every timed figure is the median of
+// BENCH_REPEATS runs, and a host time that still comes out zero or negative is listed under "rejected" (exit status 1)
+// rather than reported.  Results:
+//   footprint.*       Bytes per button and in total from getMemoryFootprint(), for several menu and button counts
+//                     (each measured in a forked child, as the menu count is fixed once the first button initialises)
+//   readButton.*      Cost of one gpio ISR or timer callback of the debounce state machine, clean and bouncing presses,
+//                     with the default polling engine and the edge timestamp engine (readButton.edge.*)
+//   action.enqueue    Extra cost per event of raising and queueing it (bound events against none bound)
+//   queue.*           EventRingBuffer push and pop in bursts, and pushes into a full queue under each overflow policy
+//   dispatch.*        processSyncEvents() cost per event, async lane handoff time, and the virtual latency from an event
+//                     being raised to its action running in each mode (sync and hybrid with a 10ms main loop)
+
+#include "ButtonSimulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_PIN       static_cast<gpio_num_t>(4)
+#define BENCH_HOLD_US   30000                                     // Well inside the 750ms longPress default
+#define BENCH_REPEATS   7                                         // Timed figures are the median of this many runs
+#ifndef IBBENCH_FLAGS
+#define IBBENCH_FLAGS   "unknown"                                 // Compiler flags of the build, set by CMakeLists.txt
+#endif
+#ifdef __OPTIMIZE__
+#define BENCH_BUILD_OPTIMIZED   "true"
+#else
+#define BENCH_BUILD_OPTIMIZED   "false"                           // Timings of an unoptimised build mean little
+#endif
+#ifdef INTERRUPTBUTTON_STATS
+#define BENCH_BUILD_STATS       "true"
+#else
+#define BENCH_BUILD_STATS       "false"
+#endif
+#ifdef INTERRUPTBUTTON_TRACE
+#define BENCH_BUILD_TRACE       "true"
+#else
+#define BENCH_BUILD_TRACE       "false"
+#endif
+#ifdef INTERRUPTBUTTON_COMPACT_CALLBACK
+#define BENCH_BUILD_COMPACT     "true"
+#else
+#define BENCH_BUILD_COMPACT     "false"
+#endif
+
+struct benchResult_t {
+  std::string name;
+  double      value;
+  const char* unit;
+};
+static std::vector<benchResult_t> s_results;
+static std::vector<std::string>   s_rejected;
+
+// A host time that isn't positive measured nothing (clock resolution, or a difference lost in noise), so it is listed
+// as rejected instead of stored.
+static void report(const std::string &name, double value, const char* unit) {
+  bool hostTime = !strcmp(unit, "ns") || !strcmp(unit, "cycles");
+  if(hostTime && !(value > 0)) {
+    fprintf(stderr, "ibbench: %s rejected, %.2f %s is not positive\n", name.c_str(), value, unit);
+    s_rejected.push_back(name);
+    return;
+  }
+  s_results.push_back({ name, value, unit });
+}
+
+template <typename Measure>
+static double medianOf(Measure measure) {
+  double values[BENCH_REPEATS];
+  for(uint8_t rep = 0; rep < BENCH_REPEATS; rep++) values[rep] = measure();
+  std::sort(values, values + BENCH_REPEATS);
+  return values[BENCH_REPEATS / 2];
+}
+
+struct stopwatch_t {                                              // Accumulates host time over timed sections
+  uint64_t    ns = 0;
+  std::chrono::steady_clock::time_point start;
+  void begin(void) { start = std::chrono::steady_clock::now(); }
+  void end(void) { ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(); }
+};
+
+static void noop(void*) {}
+
+
+//-- FOOTPRINT -------------------------------------------------------------------------------------------
+// Run before anything else, so the children are forked from a single threaded process.
+static bool measureFootprint(uint8_t menus, uint16_t buttons, memoryFootprint_t &footprint) {
+  int fds[2];
+  if(pipe(fds) != 0) return false;
+  pid_t child = fork();
+  if(child == 0) {
+    close(fds[0]);
+    InterruptButton::setMenuCount(menus);
+    for(uint16_t idx = 0; idx < buttons; idx++) {
+      InterruptButton* btn = new InterruptButton(idx, 0);
+      btn->bind(Event_KeyPress, 0, noop, nullptr);                // Binding initialises the button
+    }
+    memoryFootprint_t result;
+    InterruptButton::getMemoryFootprint(result);
+    ssize_t written = write(fds[1], &result, sizeof(result));
+    _Exit(written == sizeof(result) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t got = (child > 0) ? read(fds[0], &footprint, sizeof(footprint)) : -1;
+  close(fds[0]);
+  int status = 1;
+  if(child > 0) waitpid(child, &status, 0);
+  return got == sizeof(footprint) && status == 0;
+}
+
+static void benchFootprint(void) {
+  report("footprint.sizeof.InterruptButton", sizeof(InterruptButton), "bytes");
+  report("footprint.sizeof.func_ptr_t", sizeof(func_ptr_t), "bytes");
+  report("footprint.sizeof.buttonEvent_t", sizeof(buttonEvent_t), "bytes");
+  const uint8_t menuCounts[] = { 1, 4, 16 };
+  const uint16_t buttonCounts[] = { 1, 8, 32 };
+  for(uint8_t menus : menuCounts) {
+    for(uint16_t buttons : buttonCounts) {
+      memoryFootprint_t footprint;
+      if(!measureFootprint(menus, buttons, footprint)) {
+        fprintf(stderr, "footprint: child for %u menus, %u buttons failed\n", menus, buttons);
+        continue;
+      }
+      uint32_t perButton = footprint.buttonBytes + footprint.heapActionBytes + footprint.poolBytes;
+      std::string name = "footprint.menus" + std::to_string(menus) + ".buttons" + std::to_string(buttons);
+      report(name + ".per_button", static_cast<double>(perButton) / buttons, "bytes");
+      report(name + ".total", perButton + footprint.chordBytes + footprint.staticBytes, "bytes");
+    }
+  }
+}
+
+
+//-- STATE MACHINE AND ENQUEUE ---------------------------------------------------------------------------
+struct pressRun_t {
+  uint64_t    callNS = 0;                                         // Inside the button's ISR and timer callbacks
+  uint64_t    callCycles = 0;
+  stopwatch_t drain;                                              // processSyncEvents()
+  uint32_t    presses = 0;
+  uint32_t    isrs = 0;
+  uint32_t    callbacks = 0;
+  uint32_t    events = 0;
+};
+
+static void edge(uint8_t level, int64_t &timeUS, uint32_t stepUS) {
+  SimHAL::setPinLevel(BENCH_PIN, level);
+  SimHAL::advanceTo(timeUS += stepUS);
+}
+
+// Presses and releases the button, each contact bouncing 'bounces' times first.  Sync mode, so the queue is drained
+// outside the timed callbacks and no task runs.
+static pressRun_t runPresses(uint32_t presses, uint8_t bounces, bool bound,
+                             debounceEngines engine = Debounce_PerButtonTimer) {
+  SimHAL::reset();
+  InterruptButton::setMode(Mode_Synchronous);
+  static uint32_t actioned;
+  actioned = 0;
+  pressRun_t run;
+  run.presses = presses;
+  {
+    InterruptButton btn(BENCH_PIN, 0);
+    SimHAL::setPinLevel(BENCH_PIN, 1);
+    if(bound) {
+      auto count = []() { actioned++; };
+      btn.bind(Event_KeyDown, count);
+      btn.bind(Event_KeyUp, count);
+      btn.bind(Event_KeyPress, count);
+    } else {
+      btn.bind(Event_KeyDown, nullptr);                           // Initialises the button, nothing is raised
+    }
+    btn.setDebounceEngine(engine);
+    int64_t timeUS = SimHAL::now();
+    uint32_t isrs = SimHAL::isrCount(), callbacks = SimHAL::timerCallbackCount();
+    uint64_t callNS = SimHAL::callbackNS(), callCycles = SimHAL::callbackCycles();
+    SimHAL::setCallbackTiming(true);
+    for(uint32_t press = 0; press < presses; press++) {
+      for(uint8_t level = 0; level < 2; level++) {
+        for(uint8_t bounce = 0; bounce < bounces; bounce++) {
+          edge(level, timeUS, 150);
+          edge(!level, timeUS, 150);
+        }
+        edge(level, timeUS, BENCH_HOLD_US);
+      }
+      run.drain.begin();
+      InterruptButton::processSyncEvents();
+      run.drain.end();
+    }
+    SimHAL::setCallbackTiming(false);
+    run.callNS = SimHAL::callbackNS() - callNS;
+    run.callCycles = SimHAL::callbackCycles() - callCycles;
+    run.isrs = SimHAL::isrCount() - isrs;
+    run.callbacks = SimHAL::timerCallbackCount() - callbacks;
+    run.events = actioned;
+  }
+  return run;
+}
+
+// Median (by callback time) of several shorter runs, so a scheduling hiccup on the host spoils at most a few of them.
+static pressRun_t medianRun(uint32_t presses, uint8_t bounces, bool bound,
+                            debounceEngines engine = Debounce_PerButtonTimer) {
+  pressRun_t runs[BENCH_REPEATS];
+  for(uint8_t rep = 0; rep < BENCH_REPEATS; rep++) runs[rep] = runPresses(presses / BENCH_REPEATS + 1, bounces, bound, engine);
+  std::sort(runs, runs + BENCH_REPEATS, [](const pressRun_t &a, const pressRun_t &b) { return a.callNS < b.callNS; });
+  return runs[BENCH_REPEATS / 2];
+}
+
+static void benchReadButton(uint32_t presses) {
+  const char* names[] = { "clean", "bounce4", "edge.clean", "edge.bounce4" };
+  const uint8_t bounces[] = { 0, 4, 0, 4 };
+  const debounceEngines engines[] = { Debounce_PerButtonTimer, Debounce_PerButtonTimer, Debounce_EdgeTimestamp, Debounce_EdgeTimestamp };
+  runPresses(presses / 10 + 1, 0, false);                         // Warm up caches and the timer wheel
+  for(uint8_t variant = 0; variant < 4; variant++) {
+    pressRun_t run = medianRun(presses, bounces[variant], false, engines[variant]);
+    uint32_t calls = run.isrs + run.callbacks;
+    std::string name = std::string("readButton.") + names[variant];
+    report(name + ".per_call", static_cast<double>(run.callNS) / calls, "ns");
+    if(run.callCycles != 0) report(name + ".per_call_cycles", static_cast<double>(run.callCycles) / calls, "cycles");
+    report(name + ".calls_per_press", static_cast<double>(calls) / run.presses, "calls");
+    report(name + ".timer_callbacks_per_press", static_cast<double>(run.callbacks) / run.presses, "calls");
+    report(name + ".per_press", static_cast<double>(run.callNS) / run.presses, "ns");
+  }
+
+  // Bound and unbound runs are paired, so the difference is taken between runs made moments apart
+  double drainNS[BENCH_REPEATS];
+  uint8_t rep = 0;
+  double enqueueNS = medianOf([&]() {
+    pressRun_t unbound = runPresses(presses / BENCH_REPEATS + 1, 0, false);
+    pressRun_t run = runPresses(presses / BENCH_REPEATS + 1, 0, true);
+    drainNS[rep++] = static_cast<double>(run.drain.ns) / (run.events ? run.events : 1);
+    double eventsPerPress = static_cast<double>(run.events ? run.events : 1) / run.presses;
+    return (static_cast<double>(run.callNS) / run.presses - static_cast<double>(unbound.callNS) / unbound.presses) / eventsPerPress;
+  });
+  report("action.enqueue", enqueueNS, "ns");
+  std::sort(drainNS, drainNS + BENCH_REPEATS);
+  report("dispatch.sync.per_event", drainNS[BENCH_REPEATS / 2], "ns");
+}
+
+
+//-- QUEUES ----------------------------------------------------------------------------------------------
+static EventRingBuffer<buttonEvent_t, SYNC_EVENT_QUEUE_DEPTH> s_queue;
+
+static buttonEvent_t queueEvent(void) {
+  buttonEvent_t evt = {};
+  evt.event = Event_AutoRepeatPress;
+  evt.count = 1;
+  return evt;
+}
+
+static void benchQueue(uint32_t iterations) {
+  buttonEvent_t evt = queueEvent(), out;
+  uint32_t bursts = iterations / BENCH_REPEATS + 1;
+  for(uint16_t idx = 0; idx < SYNC_EVENT_QUEUE_DEPTH; idx++) s_queue.push(evt, Overflow_DropNewest);   // Warm up
+  while(s_queue.pop(out)) {}
+  double pushNS = medianOf([&]() {                                // Fill completely, then drain completely
+    stopwatch_t push;
+    for(uint32_t burst = 0; burst < bursts; burst++) {
+      push.begin();
+      for(uint16_t idx = 0; idx < SYNC_EVENT_QUEUE_DEPTH; idx++) { evt.timeUS = idx; s_queue.push(evt, Overflow_DropNewest); }
+      push.end();
+      while(s_queue.pop(out)) {}
+    }
+    return static_cast<double>(push.ns) / (bursts * SYNC_EVENT_QUEUE_DEPTH);
+  });
+  double popNS = medianOf([&]() {
+    stopwatch_t pop;
+    for(uint32_t burst = 0; burst < bursts; burst++) {
+      for(uint16_t idx = 0; idx < SYNC_EVENT_QUEUE_DEPTH; idx++) s_queue.push(evt, Overflow_DropNewest);
+      pop.begin();
+      while(s_queue.pop(out)) {}
+      pop.end();
+    }
+    return static_cast<double>(pop.ns) / (bursts * SYNC_EVENT_QUEUE_DEPTH);
+  });
+  report("queue.burst.push", pushNS, "ns");
+  report("queue.burst.pop", popNS, "ns");
+
+  const char* names[] = { "drop_newest", "drop_oldest", "coalesce" };
+  for(uint8_t policy = Overflow_DropNewest; policy <= Overflow_Coalesce; policy++) {
+    double fullNS = medianOf([&]() {
+      while(s_queue.pop(out)) {}
+      for(uint16_t idx = 0; idx < SYNC_EVENT_QUEUE_DEPTH; idx++) s_queue.push(evt, Overflow_DropNewest);
+      stopwatch_t full;
+      full.begin();
+      for(uint32_t idx = 0; idx < bursts * SYNC_EVENT_QUEUE_DEPTH; idx++)
+        s_queue.push(evt, static_cast<overflowPolicies>(policy));
+      full.end();
+      return static_cast<double>(full.ns) / (bursts * SYNC_EVENT_QUEUE_DEPTH);
+    });
+    report(std::string("queue.full_push.") + names[policy], fullNS, "ns");
+  }
+  while(s_queue.pop(out)) {}
+}
+
+
+//-- DISPATCH --------------------------------------------------------------------------------------------
+static std::chrono::steady_clock::time_point s_edgeAt;
+static uint64_t s_handoffNS = 0;
+
+static double runHandoff(uint32_t presses) {
+  SimHAL::reset();
+  InterruptButton::setMode(Mode_Asynchronous);
+  s_handoffNS = 0;
+  {
+    InterruptButton btn(BENCH_PIN, 0);
+    SimHAL::setPinLevel(BENCH_PIN, 1);
+    btn.bind(Event_KeyUp, []() {                                  // Raised straight from the release edge's ISR
+      s_handoffNS += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_edgeAt).count();
+    });
+    int64_t timeUS = SimHAL::now();
+    for(uint32_t press = 0; press < presses; press++) {
+      SimHAL::setPinLevel(BENCH_PIN, 0);
+      SimHAL::advanceTo(timeUS += BENCH_HOLD_US);
+      s_edgeAt = std::chrono::steady_clock::now();
+      SimHAL::setPinLevel(BENCH_PIN, 1);
+      SimHAL::advanceTo(timeUS += BENCH_HOLD_US);
+    }
+  }
+  return static_cast<double>(s_handoffNS) / presses;
+}
+
+static void benchHandoff(uint32_t presses) {
+  report("dispatch.async.handoff", medianOf([presses]() { return runHandoff(presses / BENCH_REPEATS + 1); }), "ns");
+}
+
+static void benchModeLatency(uint32_t presses) {
+  const char* names[] = { "async", "hybrid", "sync" };
+  const modes modeList[] = { Mode_Asynchronous, Mode_Hybrid, Mode_Synchronous };
+  for(uint8_t idx = 0; idx < 3; idx++) {
+    ButtonSimulator sim;
+    sim.setMainLoopPeriod(modeList[idx] == Mode_Asynchronous ? 0 : 10000);
+    std::vector<simEvent_t> recorded;
+    {
+      InterruptButton btn(BENCH_PIN, 0);
+      sim.record(btn, "bench", IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyUp) | IB_EVENT_BIT(Event_KeyPress));
+      InterruptButton::setMode(modeList[idx]);
+      for(uint32_t press = 0; press < presses; press++)
+        sim.press(BENCH_PIN, 0, 100000 + press * 100000LL, BENCH_HOLD_US, 2000, 4, press + 1);
+      sim.run(100000 + presses * 100000LL + 100000);
+      recorded = sim.recorded();
+    }
+    double sumUS = 0, maxUS = 0;
+    for(const simEvent_t &evt : recorded) {
+      double latencyUS = static_cast<double>(evt.timeUS - evt.raisedUS);
+      sumUS += latencyUS;
+      if(latencyUS > maxUS) maxUS = latencyUS;
+    }
+    std::string name = std::string("dispatch.") + names[idx];
+    report(name + ".latency_mean", recorded.empty() ? 0 : sumUS / recorded.size(), "virtual_us");
+    report(name + ".latency_max", maxUS, "virtual_us");
+    report(name + ".events", recorded.size(), "events");
+  }
+}
+
+
+int main(int argc, char** argv) {
+  uint32_t presses = 5000;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--quick"))                      presses = 500;
+    else if(!strcmp(argv[i], "--presses") && i + 1 < argc) presses = strtoul(argv[++i], nullptr, 10);
+    else {
+      fprintf(stderr, "usage: ibbench [--presses N] [--quick]\n");
+      return 2;
+    }
+  }
+  if(presses == 0) presses = 1;
+
+  SimHAL::setLogLevel(ESP_LOG_WARN);
+  benchFootprint();
+  benchReadButton(presses);
+  benchQueue(presses);
+  benchHandoff(presses / 5 ? presses / 5 : 1);                    // Thread handoffs are slow on the host, fewer do
+  benchModeLatency(presses / 10 ? presses / 10 : 1);
+
+  printf("{\n  \"benchmark\": \"ibbench\",\n  \"presses\": %u,\n", presses);
+  printf("  \"config\": { \"TARGET_POLLS\": %d, \"DISPATCH_LANES\": %d, \"ASYNC_EVENT_QUEUE_DEPTH\": %d, "
+         "\"SYNC_EVENT_QUEUE_DEPTH\": %d, \"IB_CALLBACK_WORDS\": %d },\n", TARGET_POLLS, DISPATCH_LANES,
+         ASYNC_EVENT_QUEUE_DEPTH, SYNC_EVENT_QUEUE_DEPTH, IB_CALLBACK_WORDS);
+  printf("  \"build\": { \"flags\": \"%s\", \"compiler\": \"%s\", \"optimized\": %s, \"INTERRUPTBUTTON_STATS\": %s, "
+         "\"INTERRUPTBUTTON_TRACE\": %s, \"INTERRUPTBUTTON_COMPACT_CALLBACK\": %s },\n", IBBENCH_FLAGS, __VERSION__,
+         BENCH_BUILD_OPTIMIZED, BENCH_BUILD_STATS, BENCH_BUILD_TRACE, BENCH_BUILD_COMPACT);
+  printf("  \"results\": [\n");
+  for(size_t idx = 0; idx < s_results.size(); idx++)
+    printf("    { \"name\": \"%s\", \"value\": %.2f, \"unit\": \"%s\" }%s\n", s_results[idx].name.c_str(), s_results[idx].value,
+           s_results[idx].unit, (idx + 1 < s_results.size()) ? "," : "");
+  printf("  ],\n  \"rejected\": [");
+  for(size_t idx = 0; idx < s_rejected.size(); idx++) printf("%s\"%s\"", idx ? ", " : " ", s_rejected[idx].c_str());
+  printf("%s]\n}\n", s_rejected.empty() ? "" : " ");
+  fflush(stdout);
+  _Exit(s_rejected.empty() ? 0 : 1);                             // Skip static destructors, the RTOS task threads are still parked
+}
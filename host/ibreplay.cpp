@@ -0,0 +1,175 @@
+// ibreplay - feeds a trace dumped by InterruptButton::printTrace() (INTERRUPTBUTTON_TRACE builds) back through the real
+// InterruptButton logic on a Linux host, and reports where the replayed events differ from the recorded ones.
+//
+//   ibreplay [--quiet] dump.txt
+//     --quiet                      Only print the mismatches and the per-button summary
+//
+// Lines other than the 'B' (button settings) and 'T' (trace entry) lines of the dump are ignored, so a captured serial
+// log can be used as it is.  Each gpio button is rebuilt with its recorded settings and actions bound to the events that
+// had one (at the menu level current when the dump was taken).  Its pin is then driven with the recorded level at every
+// traced edge, and with each debounce sample's level just after the sample before it, so every replayed sample reads
+// what the real one read.  Replay of a button starts at its first traced press (an earlier, half traced press is
+// skipped).  Adaptive debounce only replays exactly if the trace reaches back to the start of the learning.
+
+#include "ButtonSimulator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+// A traced button rebuilt with its own debounce polling, which need not be this build's TARGET_POLLS (eg an
+// InterruptButtonT).
+class ReplayButton : public InterruptButton {
+  public:
+    ReplayButton(uint8_t pin, uint8_t pressedState, uint16_t longMS, uint16_t repeatMS, uint16_t doubleMS,
+                 uint8_t targetPolls, uint16_t pollUS) :
+      InterruptButton(pin, pressedState, GPIO_MODE_INPUT, longMS, repeatMS, doubleMS, static_cast<uint32_t>(pollUS) * targetPolls) {
+      setPolling(targetPolls, pollUS);
+    }
+};
+
+struct replayEntry_t {
+  int64_t   timeUS;                     // Unwrapped from the 32 bit trace time
+  uint8_t   button;
+  char      kind[8];
+  unsigned  a;
+  unsigned  b;
+};
+
+struct replayButton_t {
+  unsigned  id, pin, pressedState, engine, adaptive, pollUS, targetPolls, longMS, repeatMS, doubleMS, eventMask, boundMask;
+  char      name[8];
+  std::vector<replayEntry_t> entries;   // This button's entries, oldest first
+  size_t    start = 0;                  // Entry replay starts from (the edge of the first fully traced press)
+  std::vector<replayEntry_t> expected;  // Events recorded in the trace from 'start' on
+};
+
+static bool loadDump(const char* path, std::vector<replayButton_t> &buttons, std::vector<replayEntry_t> &entries) {
+  FILE* file = fopen(path, "r");
+  if(file == nullptr) return false;
+  char line[256];
+  uint32_t lastRaw = 0;
+  int64_t  timeUS = -1;
+  while(fgets(line, sizeof(line), file)) {
+    replayButton_t btn;
+    replayEntry_t entry;
+    unsigned raw, id;
+    if(sscanf(line, "B %u %u %u %u %u %u %u %u %u %u %x %x", &btn.id, &btn.pin, &btn.pressedState, &btn.engine, &btn.adaptive,
+              &btn.pollUS, &btn.targetPolls, &btn.longMS, &btn.repeatMS, &btn.doubleMS, &btn.eventMask, &btn.boundMask) == 12) {
+      snprintf(btn.name, sizeof(btn.name), "%u", btn.id);
+      buttons.push_back(btn);
+    } else if(sscanf(line, "T %u %u %7s %u %u", &raw, &id, entry.kind, &entry.a, &entry.b) == 5) {
+      timeUS = (timeUS < 0) ? raw : timeUS + static_cast<uint32_t>(raw - lastRaw);   // The 32 bit time wraps every 71 minutes
+      lastRaw = raw;
+      entry.timeUS = timeUS;
+      entry.button = id;
+      entries.push_back(entry);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool quiet = false;
+  const char* path = nullptr;
+  for(int i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "--quiet")) quiet = true;
+    else if(argv[i][0] != '-')      path = argv[i];
+    else { fprintf(stderr, "Unknown option %s\n", argv[i]); return 2; }
+  }
+  if(path == nullptr) {
+    fprintf(stderr, "usage: ibreplay [--quiet] dump.txt\n");
+    return 2;
+  }
+
+  std::vector<replayButton_t> buttons;
+  std::vector<replayEntry_t> entries;
+  if(!loadDump(path, buttons, entries)) { fprintf(stderr, "%s: can't open dump\n", path); return 2; }
+  if(buttons.empty()) { fprintf(stderr, "%s: no button settings ('B' lines) found\n", path); return 2; }
+
+  for(replayButton_t &btn : buttons) {
+    for(const replayEntry_t &entry : entries) if(entry.button == btn.id) btn.entries.push_back(entry);
+    btn.start = btn.entries.size();
+    for(size_t idx = 1; idx < btn.entries.size(); idx++) {    // First Released -> ConfirmingPress, preceded by its edge
+      const replayEntry_t &entry = btn.entries[idx];
+      if(!strcmp(entry.kind, "state") && entry.a == 1 && entry.b == 0 && !strcmp(btn.entries[idx - 1].kind, "edge")) {
+        btn.start = idx - 1;
+        break;
+      }
+    }
+  }
+  int64_t baseUS = INT64_MAX, endUS = 0;
+  for(const replayButton_t &btn : buttons) {
+    if(btn.start < btn.entries.size()) baseUS = std::min(baseUS, btn.entries[btn.start].timeUS);
+    if(!btn.entries.empty())           endUS = std::max(endUS, btn.entries.back().timeUS);
+  }
+  if(baseUS == INT64_MAX) { fprintf(stderr, "%s: no complete press traced\n", path); return 1; }
+  int64_t offsetUS = 100000 - baseUS;                         // Replay from 100ms, leaving time to initialise
+
+  ButtonSimulator sim;
+  std::vector<InterruptButton*> live;
+  for(replayButton_t &btn : buttons) {
+    gpio_num_t pin = static_cast<gpio_num_t>(btn.pin);
+    InterruptButton* button = new ReplayButton(btn.pin, btn.pressedState, btn.longMS, btn.repeatMS, btn.doubleMS,
+                                               btn.targetPolls, btn.pollUS);
+    sim.record(*button, btn.name, btn.boundMask);
+    if(btn.engine == Debounce_SharedScan || btn.engine == Debounce_EdgeTimestamp)
+      button->setDebounceEngine(static_cast<debounceEngines>(btn.engine));
+    button->setAdaptiveDebounce(btn.adaptive);
+    for(uint8_t evt = 0; evt <= Event_All; evt++) {           // Exactly the recorded enables, whatever binding turned on
+      if(evt == NumEventTypes) continue;
+      if(btn.eventMask & IB_EVENT_BIT(evt)) button->enableEvent(static_cast<events>(evt));
+      else                                  button->disableEvent(static_cast<events>(evt));
+    }
+    live.push_back(button);
+
+    uint8_t level = btn.pressedState ? 0 : 1;                 // Released before the first traced press
+    int64_t previousUS = 0;
+    for(size_t idx = btn.start; idx < btn.entries.size(); idx++) {
+      const replayEntry_t &entry = btn.entries[idx];
+      int64_t timeUS = entry.timeUS + offsetUS;
+      if(!strcmp(entry.kind, "edge")) {
+        if(entry.a == level) sim.setLevel(pin, timeUS, !level);  // Edge whose glitch was already gone when it was read
+        sim.setLevel(pin, timeUS, entry.a);
+        level = entry.a;
+        previousUS = timeUS;
+      } else if(!strcmp(entry.kind, "sample")) {
+        if(entry.a != level) sim.setLevel(pin, previousUS + 1, entry.a);
+        level = entry.a;
+        previousUS = timeUS;
+      } else if(!strcmp(entry.kind, "event")) {
+        btn.expected.push_back(entry);
+      }
+    }
+  }
+  sim.run(endUS + offsetUS + 3000000);                        // Leave time for long press and double-click timeouts
+
+  int mismatches = 0;
+  std::vector<simEvent_t> replayed = sim.recorded();
+  for(const replayButton_t &btn : buttons) {
+    std::vector<simEvent_t> got;
+    for(const simEvent_t &evt : replayed) if(!strcmp(evt.button, btn.name)) got.push_back(evt);
+    size_t count = std::max(got.size(), btn.expected.size());
+    int buttonMismatches = 0;
+    for(size_t idx = 0; idx < count; idx++) {
+      const replayEntry_t* want = (idx < btn.expected.size()) ? &btn.expected[idx] : nullptr;
+      const simEvent_t*    have = (idx < got.size()) ? &got[idx] : nullptr;
+      bool same = want && have && want->a == have->event;
+      if(!same) buttonMismatches++;
+      if(quiet && same) continue;
+      printf("%s\t%s\t%-14s %lld\t%-14s %lld", same ? "ok" : "DIFF", btn.name,
+             want ? ButtonSimulator::eventName(static_cast<events>(want->a)) : "-", want ? static_cast<long long>(want->timeUS + offsetUS) : 0LL,
+             have ? ButtonSimulator::eventName(have->event) : "-", have ? static_cast<long long>(have->raisedUS) : 0LL);
+      if(want && have) printf("\t%+lldus", static_cast<long long>(have->raisedUS - (want->timeUS + offsetUS)));
+      printf("\n");
+    }
+    printf("# button %s: %zu recorded, %zu replayed, %d mismatches\n", btn.name, btn.expected.size(), got.size(), buttonMismatches);
+    mismatches += buttonMismatches;
+  }
+
+  fflush(stdout);
+  _Exit(mismatches ? 1 : 0);                                    // Skip static destructors, the RTOS task thread is still parked
+}
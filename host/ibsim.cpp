@@ -0,0 +1,818 @@
+// ibsim - plays recorded or synthetic pin waveforms through the real InterruptButton logic on a Linux host.
+//
+//   ibsim [options] [profile...]
+//     --mode async|hybrid|sync     Dispatch mode (default async)
+//     --engine timer|scan|edge     Debounce engine (default timer)
+//     --pressed 0|1                Pin level when pressed (default 0)
+//     --debounce US                Debounce window in us (default 8000)
+//     --adaptive                   Enable adaptive debounce (early decision, learned bounce)
+//     --lowpower                   Enable low power mode (released buttons wait on light sleep wakeup interrupts)
+//     --lane N                     Dispatch lane of the button's async events (default 0)
+//     --events LIST                Events to bind, all or a comma separated list from down,up,press,long,repeat,double,
+//                                  pattern (default all but pattern); an unknown name is an error
+//     --loop US                    Main loop period used to call processSyncEvents() (default 10000)
+//     --budget N                   Action at most N sync events per main loop call (default 0, all)
+//     --coalesce LIST              Events merged into a waiting repeat, same names as --events (default none)
+//     --random N                   Also run N synthetic profiles of bouncing presses and check each gave the expected events
+//     --scenario NAME              Run one built-in scenario and check its expectations instead: chord, heldchord, pattern,
+//                                  keypad, analog, lanes, coalesce, storm, encoder, rebind, static, budget or pool (the
+//                                  exit status is 1 on a failed check)
+//     --seed S                     Seed for --random (default 1)
+//     --quiet                      Only print the per-profile summary
+//     --stats                      Print the button, queue and memory statistics after each profile
+//     --trace                      Dump the edge trace after each profile, for ibreplay (needs an INTERRUPTBUTTON_TRACE build)
+//
+// Profiles are text files of '<timeUS> <level>' lines ('#' comments, optional 'end <timeUS>').  Each event is printed as
+// '<profile> <actionTimeUS> <event> <raisedTimeUS> <durationUS>' (plus 'x<count>' for merged events, and the clicks, long presses
+// and pattern id of Event_Pattern) so runs can be diffed against a known good output.
+
+#include "ButtonSimulator.h"
+#include "MatrixKeypad.h"
+#include "AnalogButtons.h"
+#include "InterruptButtonT.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define SIM_PIN                 static_cast<gpio_num_t>(4)
+#define RANDOM_PRESS_PERIOD_US  1200000   // Synthetic presses start this far apart
+#define RANDOM_LONG_MARGIN_US   20000     // Holds this close to the long press interval aren't checked for keyPress/longKeyPress
+
+struct simOptions_t {
+  modes           mode = Mode_Asynchronous;
+  debounceEngines engine = Debounce_PerButtonTimer;
+  uint8_t         pressedState = 0;
+  uint32_t        debounceUS = 8000;
+  uint16_t        eventMask = ((1U << NumEventTypes) - 1) & ~IB_EVENT_BIT(Event_Pattern);
+  uint32_t        loopUS = 10000;
+  uint16_t        budget = 0;
+  uint16_t        coalesceMask = 0;
+  uint32_t        randomProfiles = 0;
+  uint32_t        seed = 1;
+  bool            quiet = false;
+  bool            stats = false;
+  bool            trace = false;
+  bool            adaptive = false;
+  bool            lowPower = false;
+  uint8_t         lane = 0;
+  const char*     scenario = nullptr;
+};
+
+// Parses a comma separated list of event names (or "all") into a bit per event, false on an unknown name.
+static bool parseEvents(const char* list, uint16_t &mask) {
+  static const char* names[NumEventTypes] = { "down", "up", "press", "long", "repeat", "double", "pattern" };
+  mask = 0;
+  std::string items(list);
+  size_t start = 0;
+  while(start <= items.size()) {
+    size_t end = items.find(',', start);
+    std::string item = items.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    uint16_t bits = (item == "all") ? ((1U << NumEventTypes) - 1) : 0;
+    for(uint8_t evt = 0; evt < NumEventTypes; evt++) if(item == names[evt]) bits = (1U << evt);
+    if(bits == 0) {
+      fprintf(stderr, "Unknown event '%s', expected all or a list from down,up,press,long,repeat,double,pattern\n", item.c_str());
+      return false;
+    }
+    mask |= bits;
+    if(end == std::string::npos) break;
+    start = end + 1;
+  }
+  return true;
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: ibsim [--mode async|hybrid|sync] [--engine timer|scan|edge] [--pressed 0|1] [--debounce US] [--adaptive]\n"
+                  "             [--lowpower] [--lane N] [--events LIST] [--loop US] [--budget N]\n"
+                  "             [--coalesce LIST] [--random N] [--seed S] [--quiet] [--stats] [--trace]\n"
+                  "             [profile...]\n"
+                  "       ibsim [--engine timer|scan|edge] [--quiet] --scenario NAME\n");
+}
+
+static bool parseMode(const char* value, modes &mode) {
+  if(!strcmp(value, "async"))       mode = Mode_Asynchronous;
+  else if(!strcmp(value, "hybrid")) mode = Mode_Hybrid;
+  else if(!strcmp(value, "sync"))   mode = Mode_Synchronous;
+  else {
+    fprintf(stderr, "Unknown mode '%s', expected async, hybrid or sync\n", value);
+    return false;
+  }
+  return true;
+}
+
+static bool parseEngine(const char* value, debounceEngines &engine) {
+  if(!strcmp(value, "timer"))     engine = Debounce_PerButtonTimer;
+  else if(!strcmp(value, "scan")) engine = Debounce_SharedScan;
+  else if(!strcmp(value, "edge")) engine = Debounce_EdgeTimestamp;
+  else {
+    fprintf(stderr, "Unknown engine '%s', expected timer, scan or edge\n", value);
+    return false;
+  }
+  return true;
+}
+
+static void printHistogram(const char* name, const ibHistogram_t &hist) {
+  printf("#   %-10s n=%u max=%uus", name, hist.count, hist.maxUS);
+  for(uint8_t bin = 0; bin < IB_STATS_BINS; bin++)
+    if(hist.bins[bin]) printf(" <%u:%u", 1u << bin, hist.bins[bin]);
+  printf("\n");
+}
+
+static void printStats(InterruptButton &btn) {
+  buttonStats_t stats;
+  btn.getStats(stats);
+  printf("#   button     presses=%u falseAlarms=%u polls=%u maxPolls=%u events=", stats.presses, stats.falseAlarms,
+         stats.polls, stats.maxPolls);
+  for(uint8_t evt = 0; evt < NumEventTypes; evt++) printf("%s%u", evt ? "," : "", stats.events[evt]);
+  printf("\n");
+  classStats_t classStats;
+  InterruptButton::getClassStats(classStats);
+  for(uint8_t q = 0; q <= DISPATCH_LANES; q++) {
+    const queueStats_t &queue = (q < DISPATCH_LANES) ? classStats.asyncQueues[q] : classStats.syncQueue;
+    char name[16], latency[16];
+    if(q < DISPATCH_LANES) { snprintf(name, sizeof(name), "asyncLane%u", q); snprintf(latency, sizeof(latency), "lane%uLatency", q); }
+    else                   { snprintf(name, sizeof(name), "syncQueue");      snprintf(latency, sizeof(latency), "syncLatency");     }
+    printf("#   %-10s depth=%u highWater=%u queued=%u coalesced=%u dropped=%u\n", name,
+           queue.depth, queue.highWater, queue.queued, queue.coalesced, queue.dropped);
+    printHistogram(latency, queue.latencyUS);
+  }
+  printHistogram("isr", classStats.isrUS);
+  printHistogram("timer", classStats.timerUS);
+  memoryFootprint_t footprint;
+  InterruptButton::getMemoryFootprint(footprint);
+  printf("#   memory     buttons=%u buttonBytes=%u callbackBytes=%u poolBytes=%u pooled=%u/%u heapActionBytes=%u staticBytes=%u\n",
+         footprint.buttons, footprint.buttonBytes, footprint.callbackBytes, footprint.poolBytes, footprint.pooledButtons,
+         footprint.poolCapacity, footprint.heapActionBytes, footprint.staticBytes);
+}
+
+// Runs one profile on a fresh button, returns the recorded events.
+template <typename Script>
+static std::vector<simEvent_t> runProfile(const simOptions_t &opts, Script script) {
+  ButtonSimulator sim;
+  sim.setMainLoopPeriod(opts.mode == Mode_Asynchronous ? 0 : opts.loopUS, opts.budget);
+  std::vector<simEvent_t> recorded;
+  {
+    InterruptButton btn(SIM_PIN, opts.pressedState, GPIO_MODE_INPUT, 750, 250, 333, opts.debounceUS);
+    sim.record(btn, "btn", opts.eventMask);
+    btn.setDebounceEngine(opts.engine);
+    btn.setAdaptiveDebounce(opts.adaptive);
+    btn.setLane(opts.lane);
+    InterruptButton::setMode(opts.mode);
+    InterruptButton::setLowPowerMode(opts.lowPower);
+    InterruptButton::setCoalescedEvents(opts.coalesceMask);
+    InterruptButton::resetClassStats();
+    IB_TRACE_ONLY(if(opts.trace) { InterruptButton::clearTrace(); InterruptButton::setTracing(true); })
+    int64_t endUS = script(sim);
+    sim.run(endUS);
+    InterruptButton::processSyncEvents();
+    recorded = sim.recorded();
+    if(opts.stats) printStats(btn);
+    IB_TRACE_ONLY(if(opts.trace) InterruptButton::printTrace());
+  }
+  return recorded;
+}
+
+static void printEvents(const char* profile, const std::vector<simEvent_t> &recorded) {
+  for(const simEvent_t &evt : recorded) {
+    printf("%s\t%lld\t%s\t%lld\t%u", profile, static_cast<long long>(evt.timeUS), ButtonSimulator::eventName(evt.event),
+           static_cast<long long>(evt.raisedUS), evt.durationUS);
+    if(evt.count > 1) printf("\tx%u", evt.count);
+    if(evt.event == Event_Pattern) printf("\tclicks=%u long=0x%02x id=%u", evt.clicks, evt.longMask, evt.id);
+    printf("\n");
+  }
+}
+
+
+//-- SCENARIOS -------------------------------------------------------------------------------------------
+// Scripted runs of the features the random profiles don't reach, each checking its own expectations.  Chords and
+// patterns are class-wide registries, so a process runs one scenario (ctest starts one ibsim per scenario).
+static int s_checkFailures = 0;
+
+static void check(const char* scenario, bool ok, const char* what) {
+  printf("# %s: %s %s\n", scenario, ok ? "ok  " : "FAIL", what);
+  if(!ok) s_checkFailures++;
+}
+
+// Events of one button (all buttons for nullptr) raised in [fromUS, toUS), merged records counted in full.
+static uint32_t countEvents(const std::vector<simEvent_t> &recorded, const char* button, events event,
+                            int64_t fromUS = 0, int64_t toUS = INT64_MAX) {
+  uint32_t count = 0;
+  for(const simEvent_t &evt : recorded)
+    if((button == nullptr || !strcmp(evt.button, button)) && evt.event == event && evt.raisedUS >= fromUS && evt.raisedUS < toUS)
+      count += evt.count;
+  return count;
+}
+
+static void printButtonEvents(const char* scenario, const std::vector<simEvent_t> &recorded) {
+  for(const simEvent_t &evt : recorded)
+    printf("%s\t%lld\t%s\t%s\t%lld\t%u\tx%u\tid=%u\tdelta=%d\n", scenario, static_cast<long long>(evt.timeUS), evt.button,
+           ButtonSimulator::eventName(evt.event), static_cast<long long>(evt.raisedUS), evt.durationUS, evt.count, evt.id, evt.delta);
+}
+
+#define ALL_EVENTS  static_cast<uint16_t>((1U << NumEventTypes) - 1)
+
+// Two buttons pressed together fire their chord instead of their own keyPress/longKeyPress; pressed too far apart
+// they are two ordinary presses.
+static std::vector<simEvent_t> scenarioChord(const simOptions_t &opts, ButtonSimulator &sim) {
+  static uint32_t hits = 0;
+  InterruptButton a(4, 0), b(5, 0);
+  a.setDebounceEngine(opts.engine); b.setDebounceEngine(opts.engine);
+  sim.record(a, "a", ALL_EVENTS & ~IB_EVENT_BIT(Event_Pattern));
+  sim.record(b, "b", ALL_EVENTS & ~IB_EVENT_BIT(Event_Pattern));
+  int8_t chord = InterruptButton::addChord({ &a, &b });
+  InterruptButton::bindChord(chord, 0, []() { hits++; });
+  sim.press(static_cast<gpio_num_t>(4), 0, 10000, 1000000, 2000, 5, 3);
+  sim.press(static_cast<gpio_num_t>(5), 0, 60000, 400000, 2000, 5, 9);
+  sim.press(static_cast<gpio_num_t>(4), 0, 3000000, 1000000);           // b joins 500 ms late, no chord
+  sim.press(static_cast<gpio_num_t>(5), 0, 3500000, 200000);
+  sim.run(6000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  check("chord", chord >= 0 && hits == 1, "one chord fired");
+  check("chord", countEvents(recorded, nullptr, Event_KeyPress, 0, 3000000) == 0 &&
+                 countEvents(recorded, nullptr, Event_LongKeyPress, 0, 3000000) == 0, "no keyPress or longKeyPress from the chord");
+  check("chord", countEvents(recorded, "a", Event_KeyDown) == 2 && countEvents(recorded, "b", Event_KeyUp) == 2, "keyDown/keyUp still raised");
+  check("chord", countEvents(recorded, "b", Event_KeyPress, 3000000) == 1 &&
+                 countEvents(recorded, "a", Event_LongKeyPress, 3000000) == 1, "late press is an ordinary keyPress");
+  return recorded;
+}
+
+// A chord held past the long press interval raises no longKeyPress or autoRepeatPress on any member, including the
+// one whose press completed it.
+static std::vector<simEvent_t> scenarioHeldChord(const simOptions_t &opts, ButtonSimulator &sim) {
+  static uint32_t hits = 0;
+  InterruptButton a(4, 0), b(5, 0);
+  a.setDebounceEngine(opts.engine); b.setDebounceEngine(opts.engine);
+  sim.record(a, "a", ALL_EVENTS & ~IB_EVENT_BIT(Event_Pattern));
+  sim.record(b, "b", ALL_EVENTS & ~IB_EVENT_BIT(Event_Pattern));
+  InterruptButton::bindChord(InterruptButton::addChord({ &a, &b }), 0, []() { hits++; });
+  sim.press(static_cast<gpio_num_t>(4), 0, 10000, 2000000, 2000, 5, 3);
+  sim.press(static_cast<gpio_num_t>(5), 0, 50000, 2000000, 2000, 5, 9);
+  sim.run(4000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  check("heldchord", hits == 1, "one chord fired");
+  for(const char* member : { "a", "b" })
+    check("heldchord", countEvents(recorded, member, Event_LongKeyPress) == 0 && countEvents(recorded, member, Event_AutoRepeatPress) == 0 &&
+                       countEvents(recorded, member, Event_KeyPress) == 0, member);
+  return recorded;
+}
+
+// Registered patterns are raised with their id, unregistered multi-click sequences with id 0xFF, single clicks as keyPress
+// (even when a glitch is being confirmed as the double-click timeout fires).
+static std::vector<simEvent_t> scenarioPattern(const simOptions_t &opts, ButtonSimulator &sim) {
+  InterruptButton btn(SIM_PIN, 0, GPIO_MODE_INPUT, 750, 250, 333);
+  btn.setDebounceEngine(opts.engine);
+  int8_t ssl = InterruptButton::addPattern("SSL");
+  int8_t sl = InterruptButton::addPattern("sl");
+  check("pattern", ssl >= 0 && sl >= 0 && ssl != sl, "patterns registered");
+  check("pattern", InterruptButton::addPattern("SSL") == ssl, "a repeated pattern keeps its id");
+  check("pattern", InterruptButton::addPattern("SX") < 0, "an invalid pattern is refused");
+  sim.record(btn, "btn", IB_EVENT_BIT(Event_KeyPress) | IB_EVENT_BIT(Event_Pattern) | IB_EVENT_BIT(Event_LongKeyPress));
+  int64_t t = 100000;
+  sim.press(SIM_PIN, 0, t, 80000, 1000, 3, 1); t += 1000000;                              // Single click
+  for(int i = 0; i < 3; i++) { sim.press(SIM_PIN, 0, t, 80000, 1000, 3, i); t += 200000; }  // Unregistered triple
+  t += 1000000;
+  int64_t sslUS = t;
+  sim.press(SIM_PIN, 0, t, 80000, 1000, 3, 5); t += 200000;
+  sim.press(SIM_PIN, 0, t, 80000, 1000, 3, 6); t += 200000;
+  sim.press(SIM_PIN, 0, t, 900000, 1000, 3, 7); t += 2000000;
+  int64_t slUS = t;
+  sim.press(SIM_PIN, 0, t, 80000, 1000, 3, 8); t += 200000;
+  sim.press(SIM_PIN, 0, t, 900000, 1000, 3, 9); t += 2000000;
+  int64_t glitchUS = t;                                                  // A click, then a glitch while its double-click
+  sim.press(SIM_PIN, 0, t, 80000);                                       // timeout fires (the release is decided 8 ms after
+  sim.spike(SIM_PIN, t + 80000 + 8000 + 330000, 2000); t += 2000000;     // its edge): it is still finished as a keyPress,
+  sim.press(SIM_PIN, 0, t, 80000); t += 2000000;                         // not continued by the next click
+  sim.run(t + 2000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  auto patternAt = [&recorded](int64_t fromUS, int64_t toUS, uint8_t clicks, uint8_t longMask, uint8_t id) {
+    for(const simEvent_t &evt : recorded)
+      if(evt.event == Event_Pattern && evt.raisedUS >= fromUS && evt.raisedUS < toUS)
+        return evt.clicks == clicks && evt.longMask == longMask && evt.id == id;
+    return false;
+  };
+  check("pattern", countEvents(recorded, "btn", Event_KeyPress, 0, glitchUS) == 1, "single click is a keyPress");
+  check("pattern", patternAt(1100000, sslUS, 3, 0, 0xFF), "unregistered triple click raised with id 0xFF");
+  check("pattern", patternAt(sslUS, slUS, 3, 0x04, ssl), "SSL matched");
+  check("pattern", patternAt(slUS, INT64_MAX, 2, 0x02, sl), "SL matched");
+  check("pattern", countEvents(recorded, "btn", Event_Pattern) == 3, "no other patterns");
+  check("pattern", countEvents(recorded, "btn", Event_KeyPress, glitchUS) == 2, "click finished despite a glitch over its timeout");
+  return recorded;
+}
+
+// Two overlapping key presses on a 2x2 matrix, each seen once with its own timing; scanning stops once released.
+static std::vector<simEvent_t> scenarioKeypad(const simOptions_t &opts, ButtonSimulator &sim) {
+  (void)opts;
+  MatrixKeypad keypad({ 12, 13 }, { 14, 15 });
+  uint16_t mask = IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyUp) | IB_EVENT_BIT(Event_KeyPress);
+  sim.record(keypad.key(1, 0), "k10", mask);
+  sim.record(keypad.key(0, 1), "k01", mask);
+  sim.record(keypad.key(0, 0), "k00", mask);
+  sim.record(keypad.key(1, 1), "k11", mask);
+  check("keypad", keypad.begin(), "begin()");
+  sim.pressKey(static_cast<gpio_num_t>(13), static_cast<gpio_num_t>(14), 100000, 100000, 2000, 5, 1);
+  sim.pressKey(static_cast<gpio_num_t>(12), static_cast<gpio_num_t>(15), 150000, 200000, 2000, 5, 2);
+  sim.run(2000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  for(const char* key : { "k10", "k01" })
+    check("keypad", countEvents(recorded, key, Event_KeyDown) == 1 && countEvents(recorded, key, Event_KeyUp) == 1 &&
+                    countEvents(recorded, key, Event_KeyPress) == 1, key);
+  check("keypad", countEvents(recorded, "k00", Event_KeyDown) == 0 && countEvents(recorded, "k11", Event_KeyDown) == 0, "no ghost keys");
+  check("keypad", !keypad.isScanning(), "back to idle interrupts");
+  return recorded;
+}
+
+// Resistor ladder: a click, a long press, a reading hovering on a band edge and a double-click.
+static std::vector<simEvent_t> scenarioAnalog(const simOptions_t &opts, ButtonSimulator &sim) {
+  (void)opts;
+  const gpio_num_t pin = static_cast<gpio_num_t>(34);
+  AnalogButtons ladder(34, { 0, 820, 1640, 2460 }, 4095);
+  const char* names[] = { "b0", "b1", "b2", "b3" };
+  for(uint8_t i = 0; i < 4; i++) sim.record(ladder.button(i), names[i], ALL_EVENTS & ~IB_EVENT_BIT(Event_Pattern) & ~IB_EVENT_BIT(Event_AutoRepeatPress));
+  check("analog", ladder.begin(), "begin()");
+  sim.pressAnalog(pin, 820, 4095, 100000, 100000, 2000, 6, 3);           // b1 click
+  sim.pressAnalog(pin, 2460, 4095, 1000000, 1000000, 2000, 6, 4);        // b3 long press
+  sim.setAnalog(pin, 3000000, 1250);                                     // Hovering around the b1/b2 boundary (1230)
+  sim.setAnalog(pin, 3000500, 1200);
+  sim.setAnalog(pin, 3001000, 1260);
+  sim.setAnalog(pin, 3300000, 4095);
+  sim.pressAnalog(pin, 0, 4095, 4000000, 80000, 1000, 4, 5);             // b0 double-click
+  sim.pressAnalog(pin, 0, 4095, 4200000, 80000, 1000, 4, 6);
+  sim.run(6000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  check("analog", countEvents(recorded, "b1", Event_KeyPress, 0, 1000000) == 1, "b1 click");
+  check("analog", countEvents(recorded, "b3", Event_LongKeyPress) == 1 && countEvents(recorded, "b3", Event_KeyPress) == 0, "b3 long press");
+  check("analog", countEvents(recorded, nullptr, Event_KeyDown, 3000000, 4000000) == 1 &&
+                  countEvents(recorded, "b2", Event_KeyDown) == 0, "hovering reading is one press, no chatter");
+  check("analog", countEvents(recorded, "b0", Event_DoubleClick) == 1 && countEvents(recorded, "b0", Event_KeyPress) == 0, "b0 double-click");
+  check("analog", !ladder.isSamplingFast() && ladder.getBand() == -1, "idle sampling once released");
+  return recorded;
+}
+
+// Buttons on different lanes are actioned by different tasks, and every event still arrives.
+static std::vector<simEvent_t> scenarioLanes(const simOptions_t &opts, ButtonSimulator &sim) {
+  static TaskHandle_t tasks[2] = {};
+  static bool mixed = false;
+  InterruptButton a(4, 0), b(5, 0);
+  a.setDebounceEngine(opts.engine); b.setDebounceEngine(opts.engine);
+  b.setLane(1);
+  uint16_t mask = IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyUp);
+  sim.record(a, "a", mask);
+  sim.record(b, "b", mask);
+  a.bind(Event_KeyPress, []() { TaskHandle_t task = xTaskGetCurrentTaskHandle(); mixed |= (tasks[0] && tasks[0] != task); tasks[0] = task; });
+  b.bind(Event_KeyPress, []() { TaskHandle_t task = xTaskGetCurrentTaskHandle(); mixed |= (tasks[1] && tasks[1] != task); tasks[1] = task; });
+  InterruptButton::resetClassStats();
+  for(int i = 0; i < 4; i++) {
+    sim.press(static_cast<gpio_num_t>(4), 0, 100000 + i * 600000LL, 60000, 2000, 4, i + 1);
+    sim.press(static_cast<gpio_num_t>(5), 0, 120000 + i * 600000LL, 60000, 2000, 4, i + 11);
+  }
+  sim.run(4000000);
+  std::vector<simEvent_t> recorded = sim.recorded();
+  classStats_t stats;
+  InterruptButton::getClassStats(stats);
+  check("lanes", countEvents(recorded, "a", Event_KeyUp) == 4 && countEvents(recorded, "b", Event_KeyUp) == 4, "every press seen");
+  check("lanes", tasks[0] != nullptr && tasks[1] != nullptr && tasks[0] != tasks[1] && !mixed, "one task per lane");
+  check("lanes", stats.asyncQueues[0].queued == 12 && stats.asyncQueues[1].queued == 12, "each lane queued its own button");
+  return recorded;
+}
+
+// Auto repeats queued faster than a slow main loop takes them merge into one counted record, losing none.
+static std::vector<simEvent_t> scenarioCoalesce(const simOptions_t &opts, ButtonSimulator &sim) {
+  InterruptButton::setMode(Mode_Synchronous);
+  sim.setMainLoopPeriod(400000);
+  InterruptButton btn(SIM_PIN, 0, GPIO_MODE_INPUT, 750, 50, 333);
+  btn.setDebounceEngine(opts.engine);
+  sim.record(btn, "btn", IB_EVENT_BIT(Event_AutoRepeatPress) | IB_EVENT_BIT(Event_KeyUp));
+  InterruptButton::setCoalescedEvents(IB_EVENT_BIT(Event_AutoRepeatPress));
+  sim.press(SIM_PIN, 0, 100000, 3000000, 2000, 4, 1);
+  sim.run(4000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  uint32_t repeats = 0, records = 0;
+  for(const simEvent_t &evt : recorded) if(evt.event == Event_AutoRepeatPress) { repeats += evt.count; records++; }
+  uint32_t expected = 3000000 / 50000;                                   // No long press bound, so repeats start from keyDown
+  check("coalesce", repeats >= expected - 2 && repeats <= expected, "every repeat counted");
+  check("coalesce", records > 0 && records < repeats / 4, "repeats merged");
+  check("coalesce", countEvents(recorded, "btn", Event_KeyUp) == 1, "keyUp kept apart");
+  return recorded;
+}
+
+// 1 kHz noise trips the storm limit of a button that enabled it: its interrupt is masked, a press during the storm is
+// still seen by the storm poll, and the interrupt comes back once the sampled level is steady (which 50 us spikes can
+// make happen more than once during the noise).  A button left at the default
+// limit (off) under the same noise never storms.
+static std::vector<simEvent_t> scenarioStorm(const simOptions_t &opts, ButtonSimulator &sim) {
+  static uint32_t reported[2] = {};
+  static bool stormingMidway = false;
+  InterruptButton btn(4, 0), plain(5, 0);
+  btn.setDebounceEngine(opts.engine); plain.setDebounceEngine(opts.engine);
+  uint16_t mask = IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyUp);
+  sim.record(btn, "btn", mask);
+  sim.record(plain, "plain", mask);
+  btn.setStormLimit(40, 1000);
+  InterruptButton::setStormHandler([](InterruptButton*, bool storming) { reported[storming ? 1 : 0]++; });
+  sim.press(static_cast<gpio_num_t>(4), 0, 1400000, 300000, 1000, 4, 7);   // Pressed while storming (scripted first, so the
+  sim.press(static_cast<gpio_num_t>(4), 0, 3000000, 300000, 1000, 4, 9);   // spikes return to the pressed level) and after
+  for(int64_t t = 100000; t < 2500000; t += 997) {                       // ~1 kHz, not phase locked to the debounce timers
+    sim.spike(static_cast<gpio_num_t>(4), t, 50);
+    sim.spike(static_cast<gpio_num_t>(5), t, 50);
+  }
+  sim.run(1500000);
+  stormingMidway = btn.isStorming();
+  sim.run(5000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  check("storm", stormingMidway && !btn.isStorming() && btn.getStormCount() >= 1, "storming during the noise, not after it");
+  check("storm", reported[1] == btn.getStormCount() && reported[0] == reported[1], "handler told of each start and end");
+  check("storm", countEvents(recorded, "btn", Event_KeyDown, 1400000, 1800000) == 1 &&
+                 countEvents(recorded, "btn", Event_KeyUp, 1400000, 1800000) == 1, "press during the storm seen");
+  check("storm", countEvents(recorded, "btn", Event_KeyDown, 3000000) == 1 && countEvents(recorded, "btn", Event_KeyUp, 3000000) == 1,
+        "press after the storm seen");
+  check("storm", countEvents(recorded, "btn", Event_KeyDown) == 2, "noise raised no presses");
+  check("storm", plain.getStormCount() == 0 && countEvents(recorded, "plain", Event_KeyDown) == 0, "storm limit off by default");
+  return recorded;
+}
+
+// An encoder turned three detents, then one detent where an edge is missed (both lines seen changing together), then
+// back two: the missed edge costs nothing once the count realigns at the detent, and reversing is not thrown off by it.
+// Steps keep counting but are not recorded once the action is unbound.  A deleted encoder frees its tables.
+static std::vector<simEvent_t> scenarioEncoder(const simOptions_t &opts, ButtonSimulator &sim) {
+  (void)opts;
+  const gpio_num_t pinA = static_cast<gpio_num_t>(25), pinB = static_cast<gpio_num_t>(26);
+  RotaryEncoder enc(25, 26);
+  check("encoder", enc.begin(), "begin()");
+  sim.record(enc, "enc");
+  sim.rotate(pinA, pinB, 100000, 3, 2000);
+  sim.setLevel(pinA, 300000, 0);                                         // 11 -> 01
+  sim.setLevels(pinA, 1, pinB, 0, 302000);                               // 01 -> 10, the 00 between is missed
+  sim.setLevel(pinB, 304000, 1);                                         // 10 -> 11, back at the detent
+  sim.rotate(pinA, pinB, 500000, -2, 2000);
+  sim.run(700000);
+  int32_t turned = enc.getPosition();
+  enc.unbind(0);
+  sim.rotate(pinA, pinB, 800000, 1, 2000);
+  sim.run(1000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  auto stepsBetween = [&recorded](int64_t fromUS, int64_t toUS) {
+    int32_t steps = 0;
+    for(const simEvent_t &evt : recorded) if(evt.event == Event_Step && evt.raisedUS >= fromUS && evt.raisedUS < toUS) steps += evt.delta;
+    return steps;
+  };
+  check("encoder", stepsBetween(0, 300000) == 3, "three clockwise detents");
+  check("encoder", stepsBetween(300000, 500000) == 1 && enc.getSkippedEdges() == 1, "detent with a missed edge is one step");
+  check("encoder", stepsBetween(500000, 700000) == -2, "two anticlockwise detents after it");
+  check("encoder", turned == 2 && enc.getPosition() == 3, "position counts every step, bound or not");
+  check("encoder", stepsBetween(700000, INT64_MAX) == 0, "nothing recorded once unbound");
+  memoryFootprint_t before, after;
+  InterruptButton::getMemoryFootprint(before);
+  RotaryEncoder* second = new RotaryEncoder(27, 14);
+  sim.record(*second, "second");
+  second->unbind(0);                                                     // Leaves a withdrawn table behind
+  delete second;
+  InterruptButton::getMemoryFootprint(after);
+  check("encoder", after.heapActionBytes == before.heapActionBytes && SimHAL::errorsLogged() == 0, "deleted encoder freed its tables");
+  return recorded;
+}
+
+// keyPress actions that rebind keyPress from inside themselves, alternating between two lambdas: each must run once per
+// press and still see its own captures after replacing itself.  Then two prebuilt tables are swapped in from keyUp
+// actions running out of the table being withdrawn, which must report it still in use until the action returns.  The
+// keyPress raised along with the keyUp that brings the own table back is actioned from the own table.
+static uint32_t s_rebindHits[2] = {};
+static bool     s_rebindIntact = true;
+
+static void rebindSecond(InterruptButton* btn);
+static void rebindFirst(InterruptButton* btn) {
+  btn->bind(Event_KeyPress, 0, [btn, tag = "first"]() {
+    s_rebindHits[0]++;
+    rebindSecond(btn);
+    s_rebindIntact &= !strcmp(tag, "first");
+  });
+}
+static void rebindSecond(InterruptButton* btn) {
+  btn->bind(Event_KeyPress, 0, [btn, tag = "second"]() {
+    s_rebindHits[1]++;
+    rebindFirst(btn);
+    s_rebindIntact &= !strcmp(tag, "second");
+  });
+}
+
+static std::vector<simEvent_t> scenarioRebind(const simOptions_t &opts, ButtonSimulator &sim) {
+  static InterruptButton* btn = nullptr;
+  static ButtonActions* screens[2] = {};
+  static bool swapsOk[2] = {};
+  InterruptButton button(SIM_PIN, 0);
+  btn = &button;
+  button.setDebounceEngine(opts.engine);
+  sim.record(button, "btn", IB_EVENT_BIT(Event_KeyDown));
+  rebindFirst(btn);
+  for(ButtonActions* &screen : screens) screen = new ButtonActions(InterruptButton::getMenuCount());
+  screens[0]->bind(Event_KeyUp, 0, []() {
+    ButtonActions* previous = btn->setActions(screens[1]);
+    swapsOk[0] = previous == screens[0] && previous->inUse() && btn->getActions() == screens[1];
+  });
+  screens[1]->bind(Event_KeyUp, 0, []() {
+    ButtonActions* previous = btn->setActions(nullptr);
+    swapsOk[1] = previous == screens[1] && previous->inUse() && btn->getActions() == nullptr;
+  });
+  for(int i = 0; i < 5; i++) sim.press(SIM_PIN, 0, 100000 + i * 600000LL, 80000, 2000, 4, i + 1);
+  sim.run(1300000);                                                      // Two presses on the own table
+  InterruptButton::processSyncEvents();
+  check("rebind", s_rebindHits[0] == 1 && s_rebindHits[1] == 1 && s_rebindIntact, "keyPress rebinding itself");
+  check("rebind", btn->setActions(screens[0]) == nullptr && !screens[1]->inUse(), "screen published");
+  sim.run(2500000);                                                      // Two presses swapping the screens
+  InterruptButton::processSyncEvents();
+  check("rebind", swapsOk[0] && swapsOk[1], "screens swapped by their own actions");
+  check("rebind", !screens[0]->inUse() && !screens[1]->inUse() && btn->getActions() == nullptr, "screens idle once withdrawn");
+  sim.run(4000000);                                                      // Own table is back
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  memoryFootprint_t footprint;
+  InterruptButton::getMemoryFootprint(footprint);
+  uint32_t tableBytes = InterruptButton::getMenuCount() * NumEventTypes * sizeof(func_ptr_t);
+  check("rebind", s_rebindHits[0] == 2 && s_rebindHits[1] == 2 && s_rebindIntact, "own table rebinds kept");
+  check("rebind", countEvents(recorded, "btn", Event_KeyDown) == 3, "keyDown only from the own table");
+  check("rebind", footprint.heapActionBytes <= 4 * tableBytes, "at most one spare copy of the own table");
+  return recorded;
+}
+
+// An InterruptButtonT with two menus and 4 polls per decision: its events arrive at each menu level, a long press action
+// that unbinds itself and moves to menu 1 needs no heap, and deleting the button mid-press stops it cleanly (its timers
+// never fire into the freed static tables).
+struct SimStaticConfig : InterruptButtonConfig {
+  static constexpr uint8_t  Menus       = 2;
+  static constexpr uint8_t  TargetPolls = 4;
+  static constexpr uint16_t Events      = IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyUp) |
+                                          IB_EVENT_BIT(Event_KeyPress) | IB_EVENT_BIT(Event_LongKeyPress);
+  static constexpr uint32_t DebounceUS  = 4000;
+};
+
+static std::vector<simEvent_t> scenarioStatic(const simOptions_t &opts, ButtonSimulator &sim) {
+  static InterruptButtonT<SimStaticConfig>* btn = nullptr;
+  static uint32_t longPresses = 0;
+  InterruptButton::setMenuCount(SimStaticConfig::Menus);
+  btn = new InterruptButtonT<SimStaticConfig>(SIM_PIN, 0);
+  btn->setDebounceEngine(opts.engine);
+  uint16_t mask = IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyPress);
+  sim.record(*btn, "menu0", mask, 0);
+  sim.record(*btn, "menu1", mask, 1);
+  btn->bind<Event_LongKeyPress>(0, []() {
+    longPresses++;
+    btn->unbind(Event_LongKeyPress, 0);
+    InterruptButton::setMenuLevel(1);
+  });
+  sim.press(SIM_PIN, 0, 100000, 80000, 1000, 3, 1);                      // Menu 0 click
+  sim.press(SIM_PIN, 0, 1000000, 1000000, 1000, 3, 2);                   // Long press, to menu 1
+  sim.press(SIM_PIN, 0, 3000000, 80000, 1000, 3, 3);                     // Menu 1 click
+  sim.press(SIM_PIN, 0, 4000000, 2000000, 1000, 3, 4);                   // Deleted while held
+  sim.run(4200000);
+  InterruptButton::processSyncEvents();
+#if IB_STATS_COMPILED
+  buttonStats_t stats;
+  btn->getStats(stats);
+#endif
+  btn->bind<Event_KeyUp>(1, []() {});                                    // Publishes the second static table
+  delete btn;
+  uint32_t errors = SimHAL::errorsLogged();
+  sim.run(7000000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  memoryFootprint_t footprint;
+  InterruptButton::getMemoryFootprint(footprint);
+  check("static", InterruptButtonT<SimStaticConfig>::menuCount() == 2 && InterruptButtonT<SimStaticConfig>::targetPolls() == 4, "config");
+  check("static", countEvents(recorded, "menu0", Event_KeyDown) == 2 && countEvents(recorded, "menu0", Event_KeyPress) == 1, "menu 0 events");
+  check("static", longPresses == 1 && countEvents(recorded, "menu1", Event_KeyPress) == 1, "long press moved to menu 1");
+  check("static", countEvents(recorded, "menu1", Event_KeyDown) == 2, "keyDown of the deleted button's press");
+  check("static", countEvents(recorded, nullptr, Event_KeyPress, 4000000) == 0 && errors == 0 && SimHAL::errorsLogged() == 0,
+        "deleted mid-press without errors");
+  check("static", footprint.heapActionBytes == 0 && footprint.buttons == 0, "no heap tables, nothing left live");
+#if IB_STATS_COMPILED
+  if(opts.engine == Debounce_PerButtonTimer)
+    check("static", stats.presses == 3 && stats.maxPolls == 2 * SimStaticConfig::TargetPolls, "4 polls per make and break");
+#endif
+  return recorded;
+}
+
+// Three presses queue nine synchronous records (keyDown, keyUp, keyPress) with no main loop to take them.  An event
+// budget and then a time budget (each action here takes 1 ms of virtual time) stop processSyncEvents() part way, leaving
+// the rest queued in order for the next call.
+static std::vector<simEvent_t> scenarioBudget(const simOptions_t &opts, ButtonSimulator &sim) {
+  static uint32_t actioned = 0;
+  static int64_t lastRaisedUS = 0;
+  static bool inOrder = true;
+  InterruptButton::setMode(Mode_Synchronous);
+  sim.setMainLoopPeriod(0);
+  InterruptButton btn(SIM_PIN, 0);
+  btn.setDebounceEngine(opts.engine);
+  for(events event : { Event_KeyDown, Event_KeyUp, Event_KeyPress }) {
+    btn.bind(event, 0, []() {
+      actioned++;
+      inOrder &= InterruptButton::currentEvent().timeUS >= lastRaisedUS;
+      lastRaisedUS = InterruptButton::currentEvent().timeUS;
+      SimHAL::advanceTo(SimHAL::now() + 1000);                           // A slow action
+    });
+  }
+  for(int i = 0; i < 3; i++) sim.press(SIM_PIN, 0, 100000 + i * 600000LL, 80000, 2000, 4, i + 1);
+  sim.run(2000000);
+  uint16_t afterCount = InterruptButton::processSyncEvents(4);
+  uint32_t countActioned = actioned;
+  uint16_t afterTime = InterruptButton::processSyncEvents(0, 2500);
+  uint32_t timeActioned = actioned - countActioned;
+  uint16_t afterAll = InterruptButton::processSyncEvents(0, 0);
+  check("budget", countActioned == 4 && afterCount == 5, "event budget leaves the rest queued");
+  check("budget", timeActioned == 3 && afterTime == 2, "time budget stops once spent");
+  check("budget", afterAll == 0 && actioned == 9 && inOrder, "remainder actioned in order");
+  return sim.recorded();
+}
+
+// A shared action pool of two slots: the first two buttons take them, the third gets its own heap table, and binding
+// (published tables are copied) leaves no heap copies behind.  A deleted button's slot goes, emptied, to the next button.
+static std::vector<simEvent_t> scenarioPool(const simOptions_t &opts, ButtonSimulator &sim) {
+  check("pool", InterruptButton::setActionPool(2), "pool sized before the first button");
+  uint16_t mask = IB_EVENT_BIT(Event_KeyDown) | IB_EVENT_BIT(Event_KeyPress);
+  memoryFootprint_t footprint;
+  InterruptButton a(4, 0), c(6, 0);
+  InterruptButton* b = new InterruptButton(5, 0);
+  for(InterruptButton* btn : { &a, b, &c }) btn->setDebounceEngine(opts.engine);
+  sim.record(a, "a", mask);
+  sim.record(*b, "b", mask);
+  sim.record(c, "c", mask);
+  uint32_t tableBytes = InterruptButton::getMenuCount() * NumEventTypes * sizeof(func_ptr_t);  // Menus fixed by now
+  InterruptButton::getMemoryFootprint(footprint);
+  check("pool", !InterruptButton::setActionPool(4), "pool can't be resized once in use");
+  check("pool", footprint.poolCapacity == 2 && footprint.pooledButtons == 2 && footprint.heapActionBytes == tableBytes,
+        "two buttons pooled, the third on the heap");
+  for(int pin = 4; pin <= 6; pin++) sim.press(static_cast<gpio_num_t>(pin), 0, 100000 + (pin - 4) * 200000LL, 80000, 2000, 4, pin);
+  sim.run(1000000);
+  delete b;
+  InterruptButton d(7, 0);
+  d.setDebounceEngine(opts.engine);
+  sim.record(d, "d", IB_EVENT_BIT(Event_KeyDown));
+  InterruptButton::getMemoryFootprint(footprint);
+  check("pool", footprint.pooledButtons == 2 && footprint.heapActionBytes == tableBytes && SimHAL::errorsLogged() == 1,
+        "deleted button's slot reused");
+  sim.press(static_cast<gpio_num_t>(5), 0, 1100000, 80000, 2000, 4, 8);  // Gone
+  sim.press(static_cast<gpio_num_t>(7), 0, 1400000, 80000, 2000, 4, 9);
+  sim.run(2500000);
+  InterruptButton::processSyncEvents();
+  std::vector<simEvent_t> recorded = sim.recorded();
+  for(const char* name : { "a", "b", "c" })
+    check("pool", countEvents(recorded, name, Event_KeyDown, 0, 1000000) == 1 && countEvents(recorded, name, Event_KeyPress, 0, 1000000) == 1, name);
+  check("pool", countEvents(recorded, "d", Event_KeyDown) == 1 && countEvents(recorded, "d", Event_KeyPress) == 0 &&
+                countEvents(recorded, "b", Event_KeyDown, 1000000) == 0, "reused slot starts empty");
+  return recorded;
+}
+
+typedef std::vector<simEvent_t> (*scenario_t)(const simOptions_t &opts, ButtonSimulator &sim);
+static const struct { const char* name; scenario_t run; } s_scenarios[] = {
+  { "chord",    scenarioChord    },
+  { "heldchord", scenarioHeldChord },
+  { "pattern",  scenarioPattern  },
+  { "keypad",   scenarioKeypad   },
+  { "analog",   scenarioAnalog   },
+  { "lanes",    scenarioLanes    },
+  { "coalesce", scenarioCoalesce },
+  { "storm",    scenarioStorm    },
+  { "encoder",  scenarioEncoder  },
+  { "rebind",   scenarioRebind   },
+  { "static",   scenarioStatic   },
+  { "budget",   scenarioBudget   },
+  { "pool",     scenarioPool     },
+};
+
+static int runScenario(const simOptions_t &opts, const char* name) {
+  for(const auto &scenario : s_scenarios) {
+    if(strcmp(scenario.name, name)) continue;
+    ButtonSimulator sim;
+    std::vector<simEvent_t> recorded = scenario.run(opts, sim);
+    if(!opts.quiet || s_checkFailures) printButtonEvents(name, recorded);
+    printf("# %s: %d failed checks\n", name, s_checkFailures);
+    return s_checkFailures ? 1 : 0;
+  }
+  fprintf(stderr, "Unknown scenario %s, expected one of", name);
+  for(const auto &scenario : s_scenarios) fprintf(stderr, " %s", scenario.name);
+  fprintf(stderr, "\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  simOptions_t opts;
+  std::vector<const char*> profiles;
+
+  for(int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if(!strcmp(arg, "--quiet")) { opts.quiet = true; continue; }
+    if(!strcmp(arg, "--stats")) { opts.stats = true; continue; }
+    if(!strcmp(arg, "--trace")) { opts.trace = true; continue; }
+    if(!strcmp(arg, "--adaptive")) { opts.adaptive = true; continue; }
+    if(!strcmp(arg, "--lowpower")) { opts.lowPower = true; continue; }
+    if(arg[0] != '-') { profiles.push_back(arg); continue; }
+    if(value == nullptr) { fprintf(stderr, "%s requires a value\n", arg); return 2; }
+    i++;
+    if(!strcmp(arg, "--mode"))          { if(!parseMode(value, opts.mode)) { usage(); return 2; } }
+    else if(!strcmp(arg, "--engine"))   { if(!parseEngine(value, opts.engine)) { usage(); return 2; } }
+    else if(!strcmp(arg, "--pressed"))  opts.pressedState = atoi(value) ? 1 : 0;
+    else if(!strcmp(arg, "--debounce")) opts.debounceUS = strtoul(value, nullptr, 10);
+    else if(!strcmp(arg, "--events"))   { if(!parseEvents(value, opts.eventMask)) return 2; }
+    else if(!strcmp(arg, "--loop"))     opts.loopUS = strtoul(value, nullptr, 10);
+    else if(!strcmp(arg, "--budget"))   opts.budget = strtoul(value, nullptr, 10);
+    else if(!strcmp(arg, "--coalesce")) { if(!parseEvents(value, opts.coalesceMask)) return 2; }
+    else if(!strcmp(arg, "--random"))   opts.randomProfiles = strtoul(value, nullptr, 10);
+    else if(!strcmp(arg, "--seed"))     opts.seed = strtoul(value, nullptr, 10);
+    else if(!strcmp(arg, "--lane"))     opts.lane = strtoul(value, nullptr, 10);
+    else if(!strcmp(arg, "--scenario")) opts.scenario = value;
+    else { fprintf(stderr, "Unknown option %s\n", arg); return 2; }
+  }
+  if(opts.scenario != nullptr) {
+    int result = runScenario(opts, opts.scenario);
+    fflush(stdout);
+    _Exit(result);
+  }
+  if(profiles.empty() && opts.randomProfiles == 0) {
+    usage();
+    return 2;
+  }
+
+  int failures = 0;
+  for(const char* profile : profiles) {
+    bool loaded = true;
+    std::vector<simEvent_t> recorded = runProfile(opts, [&](ButtonSimulator &sim) {
+      int64_t endUS = 0;
+      loaded = sim.loadProfile(profile, SIM_PIN, 0, &endUS);
+      return endUS + 2000000;                                   // Leave time for long press and double-click timeouts
+    });
+    if(!loaded) { fprintf(stderr, "%s: can't open profile\n", profile); failures++; continue; }
+    if(!opts.quiet) printEvents(profile, recorded);
+    printf("# %s: %zu events\n", profile, recorded.size());
+  }
+
+  // Synthetic presses: random hold times, bounce spans and bounce edge counts, with the occasional noise spike between
+  // presses.  Every press must give exactly one keyDown and one keyUp, spikes none; with keyPress and longKeyPress both
+  // bound a press held clearly short of the long press interval gives one keyPress and no long press, one held clearly
+  // past it the reverse (holds within RANDOM_LONG_MARGIN_US of the interval could go either way and aren't checked), and
+  // presses 1.2 s apart never make a double-click.  A run that had nothing it could check fails.
+  bool checkEdges = (opts.eventMask & IB_EVENT_BIT(Event_KeyDown)) && (opts.eventMask & IB_EVENT_BIT(Event_KeyUp));
+  bool checkHolds = (opts.eventMask & IB_EVENT_BIT(Event_KeyPress)) && (opts.eventMask & IB_EVENT_BIT(Event_LongKeyPress));
+  bool checkDoubles = (opts.eventMask & IB_EVENT_BIT(Event_DoubleClick));
+  if(opts.randomProfiles && !checkEdges && !checkHolds && !checkDoubles) {
+    fprintf(stderr, "--random needs down and up, press and long, or double in --events to have something to check\n");
+    return 2;
+  }
+  uint32_t rng = opts.seed ? opts.seed : 1;
+  auto random = [&rng](uint32_t range) { rng = rng * 1664525UL + 1013904223UL; return (rng >> 8) % range; };
+  uint32_t compared = 0;
+  for(uint32_t n = 0; n < opts.randomProfiles; n++) {
+    uint32_t presses = 1 + random(5);
+    std::vector<uint32_t> holds;
+    std::vector<simEvent_t> recorded = runProfile(opts, [&](ButtonSimulator &sim) {
+      int64_t timeUS = 10000;
+      for(uint32_t p = 0; p < presses; p++) {
+        holds.push_back(40000 + random(900000));
+        sim.press(SIM_PIN, opts.pressedState, timeUS, holds.back(), random(3000), random(12), random(1u << 30));
+        timeUS += RANDOM_PRESS_PERIOD_US;
+        if(random(4) == 0) sim.spike(SIM_PIN, timeUS - 100000, 5 + random(200));
+      }
+      return timeUS + 2000000;
+    });
+    char name[32];
+    snprintf(name, sizeof(name), "random-%u", n);
+    bool ok = true;
+    for(uint32_t p = 0; p < presses; p++) {                     // Events raised during a press's period belong to it
+      uint32_t counts[NumEventTypes] = {};
+      int64_t startUS = 10000 + static_cast<int64_t>(p) * RANDOM_PRESS_PERIOD_US;
+      for(const simEvent_t &evt : recorded)
+        if(evt.raisedUS >= startUS && evt.raisedUS < startUS + RANDOM_PRESS_PERIOD_US) counts[evt.event] += evt.count;
+      bool longHold = holds[p] > 750000 + RANDOM_LONG_MARGIN_US;
+      bool shortHold = holds[p] < 750000 - RANDOM_LONG_MARGIN_US;
+      bool pressOk = true;
+      if(checkEdges)   { compared++; pressOk &= (counts[Event_KeyDown] == 1 && counts[Event_KeyUp] == 1); }
+      if(checkHolds && (longHold || shortHold)) {
+        compared++;
+        pressOk &= (counts[Event_KeyPress] == (shortHold ? 1u : 0u) && counts[Event_LongKeyPress] == (longHold ? 1u : 0u));
+      }
+      if(checkDoubles) { compared++; pressOk &= (counts[Event_DoubleClick] == 0); }
+      if(!pressOk) printf("# %s: MISMATCH press %u held %uus: %u keyDown, %u keyUp, %u keyPress, %u longKeyPress, %u doubleClick\n",
+                          name, p, holds[p], counts[Event_KeyDown], counts[Event_KeyUp], counts[Event_KeyPress],
+                          counts[Event_LongKeyPress], counts[Event_DoubleClick]);
+      ok &= pressOk;
+    }
+    if(!ok) failures++;
+    if(!opts.quiet || !ok) printEvents(name, recorded);
+  }
+  if(opts.randomProfiles && compared == 0) {
+    printf("# random: nothing was compared\n");
+    failures++;
+  }
+  if(opts.randomProfiles) printf("# random: %u profiles, %u checks, %d mismatches\n", opts.randomProfiles, compared, failures);
+
+  fflush(stdout);
+  _Exit(failures ? 1 : 0);                                      // Skip static destructors, the RTOS task thread is still parked
+}